@@ -0,0 +1,145 @@
+#include "wx/wx.h"
+#include "wx/cmdline.h"
+#include "wx/stopwatch.h"
+#include <iostream>
+#include <string>
+#include <string.h>
+#include "execution_lexer.h"
+
+/**
+ * Measure how fast ExecutionLexer splits a dump-style script, against
+ * the time taken simply to scan the same buffer for newlines.
+ */
+class BenchExecutionLexerApp : public wxAppConsole {
+public:
+  BenchExecutionLexerApp() : megabytes(100), iterations(3) {}
+  int OnRun();
+  void OnInitCmdLine(wxCmdLineParser &parser);
+  bool OnCmdLineParsed(wxCmdLineParser &parser);
+private:
+  long megabytes;
+  long iterations;
+
+  class Script {
+  public:
+    Script() : statements(0), copies(0) {}
+    std::string text;
+    unsigned long statements;
+    unsigned long copies;
+  };
+
+  void Generate(Script &script) const;
+  unsigned long Lex(const Script &script, unsigned long &copies) const;
+};
+
+IMPLEMENT_APP(BenchExecutionLexerApp)
+
+void BenchExecutionLexerApp::Generate(Script &script) const
+{
+  static const char * const names[] = { "alpha", "bravo", "charlie", "delta", "echo", "foxtrot" };
+  unsigned nameCount = sizeof(names) / sizeof(names[0]);
+  size_t target = (size_t) megabytes * 1024 * 1024;
+  unsigned seed = 12345;
+  char line[256];
+
+  script.text.reserve(target + 4096);
+  while (script.text.length() < target) {
+    seed = seed * 1103515245 + 12345;
+    const char *name = names[(seed >> 16) % nameCount];
+    switch ((seed >> 8) % 4) {
+    case 0:
+      snprintf(line, sizeof(line), "--\n-- Name: %s; Type: TABLE; Schema: public\n--\n\nCREATE TABLE %s (\n    id integer NOT NULL,\n    name text,\n    created timestamp with time zone DEFAULT now()\n);\n\n", name, name);
+      script.text += line;
+      ++script.statements;
+      break;
+    case 1:
+      snprintf(line, sizeof(line), "CREATE FUNCTION %s_touch() RETURNS trigger\n    LANGUAGE plpgsql\n    AS $_$\nBEGIN\n  NEW.created := now(); -- keep; \"it\"\n  RETURN NEW;\nEND\n$_$;\n\n", name);
+      script.text += line;
+      ++script.statements;
+      break;
+    case 2:
+      snprintf(line, sizeof(line), "INSERT INTO %s (id, name) VALUES (%u, 'it''s %s; /* not a comment */');\n", name, seed >> 4, name);
+      script.text += line;
+      ++script.statements;
+      break;
+    default:
+      snprintf(line, sizeof(line), "COPY %s (id, name, created) FROM stdin;\n", name);
+      script.text += line;
+      for (unsigned row = 0; row < 200; row++) {
+        snprintf(line, sizeof(line), "%u\t%s row %u\\twith tab\t2012-01-31 12:34:56.789+00\n", row, name, row);
+        script.text += line;
+      }
+      script.text += "\\.\n\n";
+      ++script.statements;
+      ++script.copies;
+      break;
+    }
+  }
+}
+
+unsigned long BenchExecutionLexerApp::Lex(const Script &script, unsigned long &copies) const
+{
+  ExecutionLexer lexer(script.text.data(), script.text.length());
+  unsigned long statements = 0;
+  copies = 0;
+  do {
+    ExecutionLexer::Token t = lexer.Pull();
+    if (t.type == ExecutionLexer::Token::END) break;
+    ++statements;
+    if (t.type == ExecutionLexer::Token::SQL && strncmp(script.text.data() + t.offset, "COPY ", 5) == 0) {
+      if (lexer.ReadCopyData().type == ExecutionLexer::Token::END) break;
+      ++copies;
+    }
+  } while (true);
+  return statements;
+}
+
+int BenchExecutionLexerApp::OnRun()
+{
+  Script script;
+  Generate(script);
+  double scanned = script.text.length() * (double) iterations / (1024 * 1024);
+
+  unsigned long lines = 0;
+  wxStopWatch stopwatch;
+  for (long n = 0; n < iterations; n++) {
+    const char *p = script.text.data();
+    const char *end = p + script.text.length();
+    while ((p = (const char*) memchr(p, '\n', end - p)) != NULL) {
+      ++p;
+      ++lines;
+    }
+  }
+  long scanTime = stopwatch.Time();
+
+  unsigned long statements = 0, copies = 0;
+  stopwatch.Start();
+  for (long n = 0; n < iterations; n++)
+    statements = Lex(script, copies);
+  long lexTime = stopwatch.Time();
+
+  std::cout << script.text.length() / (1024 * 1024) << "MB, " << lines / iterations << " lines x " << iterations << std::endl;
+  std::cout << "  memchr newlines: " << scanTime << "ms (" << (scanTime > 0 ? scanned * 1000 / scanTime : 0) << " MB/s)" << std::endl;
+  std::cout << "  ExecutionLexer:  " << lexTime << "ms (" << (lexTime > 0 ? scanned * 1000 / lexTime : 0) << " MB/s)" << std::endl;
+  if (statements != script.statements || copies != script.copies)
+    std::cout << "  MISMATCH: " << statements << " statements, " << copies << " copies; expected " << script.statements << ", " << script.copies << std::endl;
+
+  return 0;
+}
+
+void BenchExecutionLexerApp::OnInitCmdLine(wxCmdLineParser &parser) {
+  parser.AddOption(_T("s"), _T("size"), _("Size of script to generate, in megabytes"), wxCMD_LINE_VAL_NUMBER);
+  parser.AddOption(_T("n"), _T("iterations"), _("Number of passes over the script"), wxCMD_LINE_VAL_NUMBER);
+  wxAppConsole::OnInitCmdLine(parser);
+}
+
+bool BenchExecutionLexerApp::OnCmdLineParsed(wxCmdLineParser &parser) {
+  parser.Found(_T("s"), &megabytes);
+  parser.Found(_T("n"), &iterations);
+  return true;
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
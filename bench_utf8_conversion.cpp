@@ -0,0 +1,116 @@
+#include "wx/wx.h"
+#include "wx/cmdline.h"
+#include "wx/stopwatch.h"
+#include <iostream>
+#include <vector>
+#include "utf8_conversion.h"
+
+/**
+ * Compare converting result cells with wxConvUTF8 against Utf8ToWxString.
+ */
+class BenchUtf8ConversionApp : public wxAppConsole {
+public:
+  BenchUtf8ConversionApp() : cellCount(200000), iterations(10) {}
+  int OnRun();
+  void OnInitCmdLine(wxCmdLineParser &parser);
+  bool OnCmdLineParsed(wxCmdLineParser &parser);
+private:
+  long cellCount;
+  long iterations;
+
+  class Corpus {
+  public:
+    std::vector<char> buffer;
+    std::vector<size_t> offsets;
+    std::vector<size_t> lengths;
+    size_t Bytes() const { return buffer.size() - offsets.size(); }
+  };
+
+  void Generate(Corpus &corpus, bool includeMultibyte) const;
+  void Run(const char *label, const Corpus &corpus) const;
+};
+
+IMPLEMENT_APP(BenchUtf8ConversionApp)
+
+void BenchUtf8ConversionApp::Generate(Corpus &corpus, bool includeMultibyte) const
+{
+  static const char * const words[] = { "pg_catalog", "information_schema", "public", "relname", "active", "idle in transaction",
+                                        "2012-01-31 12:34:56.789+00", "SELECT 1", "pg_toast_2619_index", "CREATE INDEX" };
+  static const char * const multibyte = "caf\xc3\xa9 \xe2\x82\xac";
+  unsigned wordCount = sizeof(words) / sizeof(words[0]);
+  unsigned seed = 12345;
+  for (long i = 0; i < cellCount; i++) {
+    seed = seed * 1103515245 + 12345;
+    std::string cell(words[(seed >> 16) % wordCount]);
+    if ((seed >> 8) % 3 == 0) cell += words[(seed >> 20) % wordCount];
+    if (includeMultibyte && (seed >> 4) % 10 == 0) cell += multibyte;
+    corpus.offsets.push_back(corpus.buffer.size());
+    corpus.lengths.push_back(cell.length());
+    corpus.buffer.insert(corpus.buffer.end(), cell.begin(), cell.end());
+    corpus.buffer.push_back('\0');
+  }
+}
+
+void BenchUtf8ConversionApp::Run(const char *label, const Corpus &corpus) const
+{
+  const char *base = &corpus.buffer[0];
+  size_t cells = corpus.offsets.size();
+  double megabytes = corpus.Bytes() * (double) iterations / (1024 * 1024);
+  size_t total = 0;
+
+  wxStopWatch stopwatch;
+  for (long n = 0; n < iterations; n++) {
+    for (size_t i = 0; i < cells; i++)
+      total += wxString(base + corpus.offsets[i], wxConvUTF8, corpus.lengths[i]).length();
+  }
+  long generalTime = stopwatch.Time();
+
+  stopwatch.Start();
+  for (long n = 0; n < iterations; n++) {
+    for (size_t i = 0; i < cells; i++)
+      total -= Utf8ToWxString(base + corpus.offsets[i], corpus.lengths[i]).length();
+  }
+  long fastTime = stopwatch.Time();
+
+  unsigned mismatches = 0;
+  for (size_t i = 0; i < cells; i++) {
+    if (wxString(base + corpus.offsets[i], wxConvUTF8, corpus.lengths[i]) != Utf8ToWxString(base + corpus.offsets[i], corpus.lengths[i]))
+      ++mismatches;
+  }
+
+  std::cout << label << ": " << cells << " cells x " << iterations << std::endl;
+  std::cout << "  wxConvUTF8:     " << generalTime << "ms (" << (generalTime > 0 ? megabytes * 1000 / generalTime : 0) << " MB/s)" << std::endl;
+  std::cout << "  Utf8ToWxString: " << fastTime << "ms (" << (fastTime > 0 ? megabytes * 1000 / fastTime : 0) << " MB/s)" << std::endl;
+  if (mismatches > 0 || total != 0)
+    std::cout << "  MISMATCHES: " << mismatches << std::endl;
+}
+
+int BenchUtf8ConversionApp::OnRun()
+{
+  Corpus ascii;
+  Generate(ascii, false);
+  Run("ASCII", ascii);
+
+  Corpus mixed;
+  Generate(mixed, true);
+  Run("10% multibyte", mixed);
+
+  return 0;
+}
+
+void BenchUtf8ConversionApp::OnInitCmdLine(wxCmdLineParser &parser) {
+  parser.AddOption(_T("c"), _T("cells"), _("Number of cells to convert"), wxCMD_LINE_VAL_NUMBER);
+  parser.AddOption(_T("n"), _T("iterations"), _("Number of passes over the cells"), wxCMD_LINE_VAL_NUMBER);
+  wxAppConsole::OnInitCmdLine(parser);
+}
+
+bool BenchUtf8ConversionApp::OnCmdLineParsed(wxCmdLineParser &parser) {
+  parser.Found(_T("c"), &cellCount);
+  parser.Found(_T("n"), &iterations);
+  return true;
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
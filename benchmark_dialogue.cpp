@@ -0,0 +1,93 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#include "wx/xrc/xmlres.h"
+#include "wx/config.h"
+#include "wx/spinctrl.h"
+
+#include "benchmark_dialogue.h"
+
+BEGIN_EVENT_TABLE(BenchmarkDialogue, wxDialog)
+  EVT_CHOICE(XRCID("mode"), BenchmarkDialogue::OnModeChanged)
+  EVT_BUTTON(wxID_OK, BenchmarkDialogue::OnOk)
+END_EVENT_TABLE()
+
+BenchmarkDialogue::BenchmarkDialogue(wxWindow *parent)
+{
+  InitXRC(parent);
+  LoadSettings();
+  UpdateMode();
+}
+
+void BenchmarkDialogue::InitXRC(wxWindow *parent)
+{
+  wxXmlResource::Get()->LoadDialog(this, parent, _T("benchmark"));
+  modeInput = XRCCTRL(*this, "mode", wxChoice);
+  executionsInput = XRCCTRL(*this, "executions", wxSpinCtrl);
+  durationInput = XRCCTRL(*this, "duration", wxSpinCtrl);
+  warmupInput = XRCCTRL(*this, "warmup", wxSpinCtrl);
+  connectionsInput = XRCCTRL(*this, "connections", wxSpinCtrl);
+}
+
+void BenchmarkDialogue::LoadSettings()
+{
+  wxConfigBase *cfg = wxConfig::Get();
+  long value;
+  if (cfg->Read(_T("Benchmark/Mode"), &value)) modeInput->SetSelection(value == MODE_DURATION ? MODE_DURATION : MODE_EXECUTIONS);
+  if (cfg->Read(_T("Benchmark/Executions"), &value)) executionsInput->SetValue(value);
+  if (cfg->Read(_T("Benchmark/Duration"), &value)) durationInput->SetValue(value);
+  if (cfg->Read(_T("Benchmark/Warmup"), &value)) warmupInput->SetValue(value);
+  if (cfg->Read(_T("Benchmark/Connections"), &value)) connectionsInput->SetValue(value);
+}
+
+void BenchmarkDialogue::SaveSettings()
+{
+  wxConfigBase *cfg = wxConfig::Get();
+  cfg->Write(_T("Benchmark/Mode"), (long) modeInput->GetSelection());
+  cfg->Write(_T("Benchmark/Executions"), (long) executionsInput->GetValue());
+  cfg->Write(_T("Benchmark/Duration"), (long) durationInput->GetValue());
+  cfg->Write(_T("Benchmark/Warmup"), (long) warmupInput->GetValue());
+  cfg->Write(_T("Benchmark/Connections"), (long) connectionsInput->GetValue());
+}
+
+void BenchmarkDialogue::UpdateMode()
+{
+  bool duration = modeInput->GetSelection() == MODE_DURATION;
+  executionsInput->Enable(!duration);
+  durationInput->Enable(duration);
+}
+
+void BenchmarkDialogue::OnModeChanged(wxCommandEvent &event)
+{
+  UpdateMode();
+}
+
+void BenchmarkDialogue::OnOk(wxCommandEvent &event)
+{
+  SaveSettings();
+  event.Skip();
+}
+
+wxString BenchmarkDialogue::GetCommand() const
+{
+  wxString command = _T("\\bench");
+  if (modeInput->GetSelection() == MODE_DURATION)
+    command << _T(" duration=") << durationInput->GetValue();
+  else
+    command << _T(" count=") << executionsInput->GetValue();
+  if (warmupInput->GetValue() > 0)
+    command << _T(" warmup=") << warmupInput->GetValue();
+  if (connectionsInput->GetValue() > 1)
+    command << _T(" connections=") << connectionsInput->GetValue();
+  return command;
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
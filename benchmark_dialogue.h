@@ -0,0 +1,55 @@
+/**
+ * @file
+ * Dialogue box to choose how to benchmark a statement
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __benchmark_dialogue_h
+#define __benchmark_dialogue_h
+
+#include "wx/dialog.h"
+
+class wxChoice;
+class wxSpinCtrl;
+
+/**
+ * Dialogue box to choose how to benchmark a statement.
+ *
+ * The choices are remembered for next time.
+ */
+class BenchmarkDialogue : public wxDialog {
+public:
+  BenchmarkDialogue(wxWindow *parent);
+
+  /**
+   * @return \bench command to run the benchmark chosen
+   */
+  wxString GetCommand() const;
+
+private:
+  wxChoice *modeInput;
+  wxSpinCtrl *executionsInput;
+  wxSpinCtrl *durationInput;
+  wxSpinCtrl *warmupInput;
+  wxSpinCtrl *connectionsInput;
+
+  static const int MODE_EXECUTIONS = 0;
+  static const int MODE_DURATION = 1;
+
+  void InitXRC(wxWindow *parent);
+  void LoadSettings();
+  void SaveSettings();
+  void UpdateMode();
+
+  void OnModeChanged(wxCommandEvent&);
+  void OnOk(wxCommandEvent&);
+
+  DECLARE_EVENT_TABLE();
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
@@ -64,8 +64,7 @@ void ConnectDialogue::OnCancel(wxCommandEvent &event) {
   cancelButton->Disable();
   cancelling = true;
   if (connection != NULL) {
-    // TODO this merely waits (synchronously!) for the connection attempt to end, instead of actively cancelling it
-    connection->db->CloseSync();
+    connection->db->CancelConnection();
     // the callback will then exit
     return;
   }
@@ -102,8 +101,11 @@ void ConnectDialogue::OnConnectionFinished(wxCommandEvent &event) {
 
   UnmarkBusy();
   if (cancelling) {
-    if (connection->db)
+    if (connection->db) {
+      // cancelling may have left the connection made, or still being made
+      connection->db->Dispose();
       delete connection->db;
+    }
     delete connection;
     if (callback) {
       callback->Cancelled();
@@ -1,46 +1,75 @@
 #include <deque>
+#include <errno.h>
+#ifdef __WXMSW__
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
 #include "wx/log.h"
+#include "wx/config.h"
 #include "server_connection.h"
 #include "database_connection.h"
 #include "database_work.h"
 #include "database_notification_monitor.h"
 #include "pqwx.h"
+#include "micro_stopwatch.h"
 
-class InitialiseWork : public DatabaseWork {
+class InitialiseWork : public AsyncDatabaseWork {
 public:
-  void DoWork() {
+  bool Send() {
     int clientEncoding = PQclientEncoding(conn);
     const char *clientEncodingName = pg_encoding_to_char(clientEncoding);
-    if (strcmp(clientEncodingName, "UTF8") != 0) {
-      PQsetClientEncoding(conn, "UTF8");
-    }
-    DoCommand("SET DateStyle = 'ISO'");
+    // libpq picks up the new client encoding from the server's parameter status report
+    if (strcmp(clientEncodingName, "UTF8") != 0)
+      sql = "SET client_encoding = 'UTF8'; SET DateStyle = 'ISO'";
+    else
+      sql = "SET DateStyle = 'ISO'";
+    SendQuery(sql);
+    return true;
+  }
+  void ProcessResult(PGresult *rs) {
+    CheckCommandResult(rs, sql);
   }
   void NotifyFinished() {
   }
+private:
+  const char *sql;
 };
 
-class RelabelWork : public DatabaseWork {
+class RelabelWork : public AsyncDatabaseWork {
 public:
   RelabelWork(const wxString &newLabel) : newLabel(newLabel) {}
-  void DoWork() {
+  bool Send() {
     int serverVersion = PQserverVersion(conn);
     if (serverVersion < 90000)
-      return;
-    DoCommand(_T("SET application_name = ") + QuoteLiteral(newLabel));
+      return false;
+    sql = (_T("SET application_name = ") + QuoteLiteral(newLabel)).utf8_str();
+    SendQuery(sql.data());
+    return true;
+  }
+  void ProcessResult(PGresult *rs) {
+    CheckCommandResult(rs, sql.data());
   }
   void NotifyFinished() {
   }
 private:
   const wxString newLabel;
+  wxCharBuffer sql;
 };
 
-class DisconnectWork : public DatabaseWork {
+class DisconnectWork : public AsyncDatabaseWork {
 public:
   DisconnectWork() {}
-  void DoWork() {
+  bool Send() {
+#ifdef PQWX_NOTIFICATION_MONITOR
+    db->workerThread.DetachFromMonitor();
+#endif
     PQfinish(conn);
     db->LogDisconnect();
+    return false;
+  }
+  void ProcessResult(PGresult *rs) {
+    PQclear(rs);
   }
   void NotifyFinished() {
     db->FinishDisconnection();
@@ -49,10 +78,29 @@ public:
 
 void DatabaseConnection::Connect(ConnectionCallback *callback) {
   connectionCallback = callback;
+  wxConfig::Get()->Read(_T("Database/ConnectTimeout"), &connectTimeout, 30L);
 
   wxCriticalSectionLocker stateLocker(workerThread.stateCriticalSection);
   wxASSERT(workerThread.state == NOT_CONNECTED);
   workerThread.state = INITIALISING;
+  connectCancelled = false;
+
+#ifdef PQWX_DATABASE_REACTOR
+  reactorClient.reactor = ::wxGetApp().GetDatabaseReactor();
+  if (reactorClient.reactor != NULL) {
+    {
+      wxMutexLocker closeLocker(closeMutex);
+      closed = false;
+    }
+    wxMutexLocker queueLocker(workQueueMutex);
+    workQueue.push_back(new InitialiseWork());
+    reactorClient.jobRunning = true;
+    reactorClient.reactor->RunBlocking(&reactorClient);
+    wxLogDebug(_T("%s: new database connection using reactor"), identification.c_str());
+    return;
+  }
+#endif
+
   workerThread.Create();
   workerThread.Run();
 
@@ -62,6 +110,14 @@ void DatabaseConnection::Connect(ConnectionCallback *callback) {
   wxLogDebug(_T("thr#%lx: new database connection worker for '%s'"), workerThread.GetId(), dbname.c_str());
 }
 
+void DatabaseConnection::CancelConnection() {
+  wxCriticalSectionLocker stateLocker(workerThread.stateCriticalSection);
+  if (workerThread.state != INITIALISING && workerThread.state != CONNECTING)
+    return;
+  wxLogDebug(_T("%s: cancelling connection attempt"), identification.c_str());
+  connectCancelled = true;
+}
+
 void DatabaseConnection::CloseSync() {
   if (!disconnectQueued) {
     if (!BeginDisconnection()) {
@@ -84,8 +140,7 @@ bool DatabaseConnection::WaitUntilClosed() {
   }
 
   wxLogDebug(_T("%s: WaitUntilClosed: waiting for worker completion"), identification.c_str());
-  workerThread.Wait();
-  workerThread.state = NOT_CONNECTED;
+  JoinWorker();
 
   wxLogDebug(_T("%s: WaitUntilClosed: worker completed after waiting"), identification.c_str());
 
@@ -110,26 +165,14 @@ wxThread::ExitCode DatabaseConnection::WorkerThread::Entry() {
       db->workQueue.pop_front();
       db->workQueueMutex.Unlock();
       SetState(DatabaseConnection::EXECUTING);
-      work->db = db;
-      work->conn = conn;
-      try {
-        work->DoWork();
-        CheckConnectionStatus();
-        work->NotifyFinished();
-      } catch (std::exception &e) {
-        wxLogDebug(_T("%p: Exception thrown by database work: %s"), work, wxString(e.what(), wxConvUTF8).c_str());
-        CheckConnectionStatus();
-        work->NotifyCrashed(e);
-      } catch (...) {
-        wxLogDebug(_T("%p: Unrecognisable exception thrown by database work"), work);
-        CheckConnectionStatus();
-        work->NotifyCrashed();
-      }
-      delete work;
+      RunWork(work);
       db->workQueueMutex.Lock();
 
       if (GetState() == DatabaseConnection::DISCONNECTED) {
         wxLogDebug(_T("thr#%lx [%s] exiting due to invalid connection"), wxThread::GetCurrentId(), db->identification.c_str());
+#ifdef PQWX_NOTIFICATION_MONITOR
+        DetachFromMonitor();
+#endif
         DeleteRemainingWork();
         return 0;
       }
@@ -150,22 +193,87 @@ wxThread::ExitCode DatabaseConnection::WorkerThread::Entry() {
       while ((notification = PQnotifies(conn)) != NULL) {
         (*notificationReceiver)(notification);
       }
-      ::wxGetApp().GetNotificationMonitor().AddConnection(DatabaseNotificationMonitor::Client(PQsocket(conn), &monitorProcessor));
     }
+    HandOverInput();
 #endif
 
     db->workCondition.Wait();
 
 #ifdef PQWX_NOTIFICATION_MONITOR
-    if (notificationReceiver != NULL) {
-      ::wxGetApp().GetNotificationMonitor().RemoveConnection(PQsocket(conn));
-    }
+    TakeBackInput();
 #endif
   } while (true);
 
   return 0;
 }
 
+void DatabaseConnection::WorkerThread::RunWork(DatabaseWork *work)
+{
+  work->db = db;
+  work->conn = conn;
+  try {
+    work->DoWork();
+    CheckConnectionStatus();
+    work->NotifyFinished();
+  } catch (std::exception &e) {
+    wxLogDebug(_T("%p: Exception thrown by database work: %s"), work, wxString(e.what(), wxConvUTF8).c_str());
+    CheckConnectionStatus();
+    work->NotifyCrashed(e);
+  } catch (...) {
+    wxLogDebug(_T("%p: Unrecognisable exception thrown by database work"), work);
+    CheckConnectionStatus();
+    work->NotifyCrashed();
+  }
+  delete work;
+}
+
+#ifdef PQWX_NOTIFICATION_MONITOR
+void DatabaseConnection::WorkerThread::AttachToMonitor()
+{
+  if (monitored) return;
+#ifdef PQWX_DATABASE_REACTOR
+  // the reactor delivers notifications itself
+  if (db->reactorClient.reactor != NULL) return;
+#endif
+  {
+    wxMutexLocker locker(inputMutex);
+    idle = false;
+    parked = false;
+  }
+  // without the monitor, notifications are only picked up when the connection is next used
+  monitoredFd = PQsocket(conn);
+  monitored = ::wxGetApp().GetNotificationMonitor().AddConnection(DatabaseNotificationMonitor::Client(monitoredFd, &monitorProcessor));
+}
+
+void DatabaseConnection::WorkerThread::DetachFromMonitor()
+{
+  if (!monitored) return;
+  ::wxGetApp().GetNotificationMonitor().RemoveConnection(monitoredFd);
+  monitored = false;
+}
+
+void DatabaseConnection::WorkerThread::HandOverInput()
+{
+  if (!monitored) return;
+  bool resume;
+  {
+    wxMutexLocker locker(inputMutex);
+    idle = true;
+    resume = parked;
+    parked = false;
+  }
+  if (resume)
+    ::wxGetApp().GetNotificationMonitor().ResumeConnection(monitoredFd);
+}
+
+void DatabaseConnection::WorkerThread::TakeBackInput()
+{
+  if (!monitored) return;
+  wxMutexLocker locker(inputMutex);
+  idle = false;
+}
+#endif
+
 void DatabaseConnection::WorkerThread::CheckConnectionStatus()
 {
   ConnStatusType connStatus = PQstatus(conn);
@@ -183,6 +291,7 @@ void DatabaseConnection::WorkerThread::DeleteRemainingWork()
     work->NotifyLostConnection();
     delete work;
   }
+  db->workQueue.clear();
 }
 
 static const char *options[] = {
@@ -236,7 +345,7 @@ bool DatabaseConnection::WorkerThread::Connect() {
 #endif
 
 #if PG_VERSION_NUM >= 90000
-  conn = PQconnectdbParams(options, values, 0);
+  conn = PQconnectStartParams(options, values, 0);
 #else
   wxString conninfo;
   for (int j = 0; options[j]; j++) {
@@ -246,9 +355,29 @@ bool DatabaseConnection::WorkerThread::Connect() {
 #ifdef __WXDEBUG__
   wxLogDebug(_T("conninfo: %s"), conninfo.c_str());
 #endif
-  conn = PQconnectdb(conninfo.utf8_str());
+  conn = PQconnectStart(conninfo.utf8_str());
 #endif
 
+  if (conn == NULL) {
+    PgError err(_("Unable to allocate connection"));
+    db->LogConnectFailed(err);
+    if (db->connectionCallback)
+      db->connectionCallback->OnConnectionFailed(err);
+    return false;
+  }
+
+  if (!PollConnection()) {
+    if (db->IsConnectionCancelled() || PQstatus(conn) != CONNECTION_BAD) {
+      PgError err(db->IsConnectionCancelled() ? _("Connection cancelled") : _("Timed out connecting to server"));
+      db->LogConnectFailed(err);
+      if (db->connectionCallback)
+        db->connectionCallback->OnConnectionFailed(err);
+      PQfinish(conn);
+      return false;
+    }
+    // otherwise, libpq will have reported why the connection failed
+  }
+
   ConnStatusType status = PQstatus(conn);
 
   if (status == CONNECTION_OK) {
@@ -275,6 +404,63 @@ bool DatabaseConnection::WorkerThread::Connect() {
   }
 }
 
+/*
+ * Drive the connection started by PQconnectStart() to completion,
+ * waiting on the socket in short slices so that cancellation is
+ * noticed promptly.
+ */
+bool DatabaseConnection::WorkerThread::PollConnection() {
+  static const long pollSlice = 100; // ms
+  // a monotonic clock, so that adjusting the system clock doesn't affect the timeout
+  MicroStopWatch stopwatch;
+  PostgresPollingStatusType pollStatus = PGRES_POLLING_WRITING;
+
+  if (PQstatus(conn) == CONNECTION_BAD)
+    return false;
+
+  while (pollStatus != PGRES_POLLING_OK) {
+    if (pollStatus == PGRES_POLLING_FAILED)
+      return false;
+
+    int socketFd = PQsocket(conn);
+    bool reading = pollStatus == PGRES_POLLING_READING;
+    do {
+      if (db->IsConnectionCancelled())
+        return false;
+      long timeout = pollSlice;
+      if (db->connectTimeout > 0) {
+        long remaining = db->connectTimeout * 1000 - (stopwatch.Time() / 1000).ToLong();
+        if (remaining <= 0)
+          return false;
+        if (remaining < timeout) timeout = remaining;
+      }
+#ifdef __WXMSW__
+      fd_set fds;
+      FD_ZERO(&fds);
+      FD_SET(socketFd, &fds);
+      struct timeval tv;
+      tv.tv_sec = 0;
+      tv.tv_usec = timeout * 1000;
+      int rc = select(socketFd + 1, reading ? &fds : NULL, reading ? NULL : &fds, NULL, &tv);
+#else
+      struct pollfd pfd;
+      pfd.fd = socketFd;
+      pfd.events = reading ? POLLIN : POLLOUT;
+      int rc = poll(&pfd, 1, timeout);
+#endif
+      if (rc > 0) break;
+      if (rc < 0 && errno != EINTR) {
+        wxLogSysError(_T("Failed waiting for connection"));
+        return false;
+      }
+    } while (true);
+
+    pollStatus = PQconnectPoll(conn);
+  }
+
+  return true;
+}
+
 void DatabaseConnection::LogSql(const char *sql) {
   wxLogDebug(_T("thr#%lx [%s] SQL: %s"), wxThread::GetCurrentId(), identification.c_str(), wxString(sql, wxConvUTF8).c_str());
 }
@@ -308,15 +494,24 @@ void DatabaseConnection::AddWork(DatabaseWork *work) {
   wxCHECK(workerThread.state != NOT_CONNECTED && workerThread.state != DISCONNECTED, );
   workQueue.push_back(work);
   workCondition.Signal();
+#ifdef PQWX_DATABASE_REACTOR
+  // wake while holding the state lock, so the client cannot retire in between
+  if (reactorClient.reactor != NULL) reactorClient.reactor->Wake(&reactorClient);
+#endif
 }
 
 bool DatabaseConnection::AddWorkOnlyIfConnected(DatabaseWork *work) {
   wxCriticalSectionLocker stateLocker(workerThread.stateCriticalSection);
   if (workerThread.state == DISCONNECTED || workerThread.state == NOT_CONNECTED)
     return false;
-  wxMutexLocker workQueueLocker(workQueueMutex);
-  workQueue.push_back(work);
-  workCondition.Signal();
+  {
+    wxMutexLocker workQueueLocker(workQueueMutex);
+    workQueue.push_back(work);
+    workCondition.Signal();
+  }
+#ifdef PQWX_DATABASE_REACTOR
+  if (reactorClient.reactor != NULL) reactorClient.reactor->Wake(&reactorClient);
+#endif
   return true;
 }
 
@@ -324,10 +519,15 @@ bool DatabaseConnection::BeginDisconnection() {
   wxCriticalSectionLocker stateLocker(workerThread.stateCriticalSection);
   if (workerThread.state == DISCONNECTED || workerThread.state == NOT_CONNECTED)
     return false;
-  wxMutexLocker workQueueLocker(workQueueMutex);
-  workQueue.push_back(new DisconnectWork());
-  workCondition.Signal();
-  disconnectQueued = true;
+  {
+    wxMutexLocker workQueueLocker(workQueueMutex);
+    workQueue.push_back(new DisconnectWork());
+    workCondition.Signal();
+    disconnectQueued = true;
+  }
+#ifdef PQWX_DATABASE_REACTOR
+  if (reactorClient.reactor != NULL) reactorClient.reactor->Wake(&reactorClient);
+#endif
   return true;
 }
 
@@ -354,8 +554,7 @@ void DatabaseConnection::Dispose() {
 
   if (state == DISCONNECTED) {
     wxLogDebug(_T("%s: Dispose: disconnected, joining worker thread"), identification.c_str());
-    workerThread.Wait();
-    workerThread.state = NOT_CONNECTED;
+    JoinWorker();
     return;
   }
 
@@ -363,31 +562,348 @@ void DatabaseConnection::Dispose() {
   CloseSync();
 }
 
+void DatabaseConnection::JoinWorker() {
+#ifdef PQWX_DATABASE_REACTOR
+  if (reactorClient.reactor != NULL) {
+    wxMutexLocker closeLocker(closeMutex);
+    while (!closed)
+      closedCondition.Wait();
+    workerThread.state = NOT_CONNECTED;
+    return;
+  }
+#endif
+  workerThread.Wait();
+  workerThread.state = NOT_CONNECTED;
+}
+
+#ifdef PQWX_DATABASE_REACTOR
+void DatabaseConnection::ReactorClient::Run()
+{
+  WorkerThread &worker = db->workerThread;
+
+  if (blockingWork == NULL) {
+    worker.SetState(DatabaseConnection::CONNECTING);
+    if (worker.Connect()) {
+      socketFd = PQsocket(worker.conn);
+      PQsetnonblocking(worker.conn, 1);
+    }
+    else {
+      wxLogDebug(_T("%s: connection failed, retiring from reactor"), db->identification.c_str());
+      worker.SetState(DatabaseConnection::DISCONNECTED);
+    }
+  }
+  else {
+    PQsetnonblocking(worker.conn, 0);
+    worker.RunWork(blockingWork);
+    blockingWork = NULL;
+    if (worker.GetState() != DatabaseConnection::DISCONNECTED)
+      PQsetnonblocking(worker.conn, 1);
+  }
+
+  {
+    wxMutexLocker locker(db->workQueueMutex);
+    jobRunning = false;
+  }
+  reactor->Wake(this);
+}
+
+void DatabaseConnection::ReactorClient::OnWake()
+{
+  {
+    wxMutexLocker locker(db->workQueueMutex);
+    if (jobRunning) return;
+  }
+
+  if (retired) return;
+
+  if (db->workerThread.GetState() == DatabaseConnection::DISCONNECTED) {
+    Retire();
+    return;
+  }
+
+  if (current != NULL) return; // will pump again once the current work completes
+
+  Pump();
+}
+
+void DatabaseConnection::ReactorClient::Pump()
+{
+  WorkerThread &worker = db->workerThread;
+
+  if (!watching) {
+    reactor->Watch(socketFd, this, false);
+    watching = true;
+  }
+
+  do {
+    DatabaseWork *work;
+    bool disconnected;
+    {
+      wxMutexLocker locker(db->workQueueMutex);
+      disconnected = worker.disconnect;
+      if (disconnected || db->workQueue.empty()) {
+        work = NULL;
+      }
+      else {
+        work = db->workQueue.front();
+        db->workQueue.pop_front();
+      }
+    }
+
+    if (work == NULL) {
+      if (disconnected) {
+        wxLogDebug(_T("%s: disconnection completed"), db->identification.c_str());
+        Retire();
+      }
+      else {
+        worker.SetState(DatabaseConnection::IDLE);
+      }
+      return;
+    }
+
+    worker.SetState(DatabaseConnection::EXECUTING);
+
+    AsyncDatabaseWork *async = dynamic_cast<AsyncDatabaseWork*>(work);
+    if (async == NULL) {
+      // no choice but to block: the socket is left alone until the helper is finished with it
+      reactor->Unwatch(socketFd);
+      watching = false;
+      blockingWork = work;
+      {
+        wxMutexLocker locker(db->workQueueMutex);
+        jobRunning = true;
+      }
+      reactor->RunBlocking(this);
+      return;
+    }
+
+    bool closing = dynamic_cast<DisconnectWork*>(work) != NULL;
+    if (closing) {
+      // stop watching before the socket is closed, in case its descriptor is reused
+      reactor->Unwatch(socketFd);
+      watching = false;
+    }
+
+    async->db = db;
+    async->conn = worker.conn;
+    crashed = false;
+    current = async;
+    try {
+      if (async->Send()) {
+        // the failure is reported as a result
+        if (!Flush(false)) CollectResults();
+        return;
+      }
+      if (!closing) worker.CheckConnectionStatus();
+      async->NotifyFinished();
+    } catch (std::exception &e) {
+      wxLogDebug(_T("%p: Exception thrown by database work: %s"), work, wxString(e.what(), wxConvUTF8).c_str());
+      worker.CheckConnectionStatus();
+      async->NotifyCrashed(e);
+    } catch (...) {
+      wxLogDebug(_T("%p: Unrecognisable exception thrown by database work"), work);
+      worker.CheckConnectionStatus();
+      async->NotifyCrashed();
+    }
+    current = NULL;
+    delete work;
+
+    if (worker.GetState() == DatabaseConnection::DISCONNECTED) {
+      Retire();
+      return;
+    }
+  } while (true);
+}
+
+bool DatabaseConnection::ReactorClient::Flush(bool writing)
+{
+  PGconn *conn = db->workerThread.conn;
+  bool queued = false;
+  do {
+    int rc = PQflush(conn);
+    if (rc < 0) return false;
+    if (rc == 1) break;
+    if (queued) {
+      if (writing) reactor->Watch(socketFd, this, false);
+      return true;
+    }
+    // the output buffer has drained, so anything the work couldn't queue before should fit now
+    if (!current->SendMore()) break;
+    queued = true;
+  } while (true);
+
+  if (!writing) reactor->Watch(socketFd, this, true);
+  return true;
+}
+
+void DatabaseConnection::ReactorClient::OnSocketReady(bool readable, bool writable)
+{
+  PGconn *conn = db->workerThread.conn;
+
+  // the socket may have been handed to a helper earlier in this batch of events
+  if (!watching || retired) return;
+
+  if (writable && current != NULL && !Flush(true))
+    readable = true;
+
+  if (!readable) return;
+
+  PQconsumeInput(conn);
+
+  if (current == NULL) {
+    DeliverNotifications();
+    db->workerThread.CheckConnectionStatus();
+    if (db->workerThread.GetState() == DatabaseConnection::DISCONNECTED)
+      Retire();
+    return;
+  }
+
+  CollectResults();
+}
+
+void DatabaseConnection::ReactorClient::CollectResults()
+{
+  PGconn *conn = db->workerThread.conn;
+
+  while (!PQisBusy(conn)) {
+    PGresult *rs = PQgetResult(conn);
+    if (rs == NULL) {
+      Complete();
+      return;
+    }
+    bool final = AsyncDatabaseWork::IsFinalResult(rs);
+    if (crashed) {
+      PQclear(rs);
+    }
+    else {
+      // a crashed work is notified at once, but the rest of its results still have to be drained
+      try {
+        current->ProcessResult(rs);
+      } catch (std::exception &e) {
+        wxLogDebug(_T("%p: Exception thrown by database work: %s"), current, wxString(e.what(), wxConvUTF8).c_str());
+        crashed = true;
+        current->NotifyCrashed(e);
+      } catch (...) {
+        wxLogDebug(_T("%p: Unrecognisable exception thrown by database work"), current);
+        crashed = true;
+        current->NotifyCrashed();
+      }
+    }
+    if (final) {
+      Complete();
+      return;
+    }
+  }
+}
+
+void DatabaseConnection::ReactorClient::Complete()
+{
+  AsyncDatabaseWork *work = current;
+  current = NULL;
+
+  if (!crashed) {
+    try {
+      work->ResultsComplete();
+      db->workerThread.CheckConnectionStatus();
+      work->NotifyFinished();
+    } catch (std::exception &e) {
+      wxLogDebug(_T("%p: Exception thrown by database work: %s"), work, wxString(e.what(), wxConvUTF8).c_str());
+      db->workerThread.CheckConnectionStatus();
+      work->NotifyCrashed(e);
+    } catch (...) {
+      wxLogDebug(_T("%p: Unrecognisable exception thrown by database work"), work);
+      db->workerThread.CheckConnectionStatus();
+      work->NotifyCrashed();
+    }
+  }
+  else {
+    db->workerThread.CheckConnectionStatus();
+  }
+  delete work;
+
+  if (db->workerThread.GetState() == DatabaseConnection::DISCONNECTED) {
+    Retire();
+    return;
+  }
+
+  // notifications read along with the results would otherwise wait for the next socket event
+  DeliverNotifications();
+
+  reactor->Watch(socketFd, this, false);
+  Pump();
+}
+
+void DatabaseConnection::ReactorClient::DeliverNotifications()
+{
+  WorkerThread &worker = db->workerThread;
+  PGnotify *notification;
+  while ((notification = PQnotifies(worker.conn)) != NULL) {
+    if (worker.notificationReceiver != NULL)
+      (*worker.notificationReceiver)(notification);
+    else
+      PQfreemem(notification);
+  }
+}
+
+void DatabaseConnection::ReactorClient::Retire()
+{
+  if (watching) {
+    reactor->Unwatch(socketFd);
+    watching = false;
+  }
+
+  {
+    wxMutexLocker locker(db->workQueueMutex);
+    db->workerThread.DeleteRemainingWork();
+  }
+  db->workerThread.SetState(DatabaseConnection::DISCONNECTED);
+  reactor->Forget(this);
+  retired = true;
+
+  // the connection may be deleted as soon as this is signalled
+  wxMutexLocker closeLocker(db->closeMutex);
+  db->closed = true;
+  db->closedCondition.Broadcast();
+}
+#endif
+
 #ifdef PQWX_NOTIFICATION_MONITOR
 
-class RegisterWithMonitor : public DatabaseWork {
+class RegisterWithMonitor : public AsyncDatabaseWork {
 public:
   RegisterWithMonitor(DatabaseConnection *db, DatabaseConnection::NotificationReceiver *receiver) : db(db), receiver(receiver) {}
 private:
   DatabaseConnection *db;
   DatabaseConnection::NotificationReceiver *receiver;
-  void DoWork()
+  bool Send()
   {
     db->workerThread.notificationReceiver = receiver;
+    db->workerThread.AttachToMonitor();
+    return false;
+  }
+  void ProcessResult(PGresult *rs)
+  {
+    PQclear(rs);
   }
   void NotifyFinished()
   {
   }
 };
 
-class UnregisterWithMonitor : public DatabaseWork {
+class UnregisterWithMonitor : public AsyncDatabaseWork {
 public:
   UnregisterWithMonitor(DatabaseConnection *db) : db(db) {}
 private:
   DatabaseConnection *db;
-  void DoWork()
+  bool Send()
   {
+    db->workerThread.DetachFromMonitor();
     db->workerThread.notificationReceiver = NULL;
+    return false;
+  }
+  void ProcessResult(PGresult *rs)
+  {
+    PQclear(rs);
   }
   void NotifyFinished()
   {
@@ -16,8 +16,10 @@
 #include "server_connection.h"
 #include "pg_error.h"
 #include "database_notification_monitor.h"
+#include "database_reactor.h"
 
 class DatabaseWork;
+class AsyncDatabaseWork;
 class DisconnectWork;
 
 /**
@@ -46,6 +48,11 @@ public:
  * connection is closed and then exit. Once this work object has been
  * <b>added</b> (not necessarily executed), the work queue will not
  * accept any more work objects.
+ *
+ * If the application has a database reactor, connections do not have
+ * a thread of their own: instead, the reactor thread drives all their
+ * asynchronous work, and blocking work is run on its helper
+ * threads. The work queue behaves in the same way in either case.
  */
 class DatabaseConnection {
 public:
@@ -63,7 +70,10 @@ public:
 #if PG_VERSION_NUM >= 90000
     label(label),
 #endif
-    workerThread(this), connectionCallback(NULL), disconnectQueued(false)
+    workerThread(this), connectionCallback(NULL), disconnectQueued(false), connectTimeout(0), connectCancelled(false)
+#ifdef PQWX_DATABASE_REACTOR
+    , reactorClient(this), closedCondition(closeMutex), closed(false)
+#endif
   {
     identification = server.Identification() + _T(" ") + dbname;
   }
@@ -87,9 +97,19 @@ public:
    * hope that the connection is made ok. The option to not supply a
    * callback should be removed at some point.
    *
+   * The connection attempt is abandoned if it has not completed
+   * within the deadline configured as Database/ConnectTimeout
+   * (seconds, default 30; zero for no deadline).
+   *
    * @param callback Connection result
    */
   void Connect(ConnectionCallback *callback = NULL);
+  /**
+   * Abandon a connection attempt in progress.
+   *
+   * The callback passed to Connect() will receive a connection failure.
+   */
+  void CancelConnection();
   /**
    * Close the connection synchronously.
    *
@@ -239,7 +259,7 @@ private:
     WorkerThread(DatabaseConnection *db) : wxThread(wxTHREAD_JOINABLE), db(db), disconnect(false), state(NOT_CONNECTED),
                                            notificationReceiver(NULL)
 #ifdef PQWX_NOTIFICATION_MONITOR
-                                         , monitorProcessor(this)
+                                         , monitorProcessor(this), monitored(false), monitoredFd(-1), idle(false), parked(false)
 #endif
   { }
   protected:
@@ -255,20 +275,46 @@ private:
     class MonitorInputProcessor : public DatabaseNotificationMonitor::InputProcessor {
     public:
       MonitorInputProcessor(WorkerThread *worker) : worker(worker) {}
-      void operator()()
+      bool operator()()
       {
-        PQconsumeInput(worker->conn);
+        wxMutexLocker locker(worker->inputMutex);
+        if (!worker->idle || !PQconsumeInput(worker->conn)) {
+          worker->parked = true;
+          return false;
+        }
         PGnotify *notification;
         while ((notification = PQnotifies(worker->conn)) != NULL) {
           (*worker->notificationReceiver)(notification);
         }
+        return true;
       }
     private:
       WorkerThread *worker;
     } monitorProcessor;
+    /*
+     * The connection stays registered with the monitor while it has
+     * a receiver. The monitor only consumes input while the worker is
+     * idle: otherwise the monitor suspends the connection, and the
+     * worker resumes it when it next goes idle.
+     *
+     * The socket is remembered when the connection is registered, as
+     * libpq has already closed it by the time a lost connection is
+     * deregistered.
+     */
+    bool monitored;
+    int monitoredFd;
+    wxMutex inputMutex;
+    bool idle; // guarded by inputMutex
+    bool parked; // guarded by inputMutex
+    void AttachToMonitor();
+    void DetachFromMonitor();
+    void HandOverInput();
+    void TakeBackInput();
 #endif
 
     bool Connect();
+    bool PollConnection();
+    void RunWork(DatabaseWork *work);
     void HandleNotification();
     void CheckConnectionStatus();
     void DeleteRemainingWork();
@@ -284,12 +330,62 @@ private:
     }
 
     friend class DatabaseConnection;
+    friend class ReactorClient;
     friend class MonitorInputProcessor;
     friend class RegisterWithMonitor;
     friend class UnregisterWithMonitor;
+    friend class DisconnectWork;
   };
 
+#ifdef PQWX_DATABASE_REACTOR
+  /**
+   * Drives the connection from the reactor thread.
+   *
+   * The worker thread object is still used to hold the connection
+   * state, but its thread is never started.
+   */
+  class ReactorClient : public DatabaseReactor::Client, public DatabaseReactor::BlockingJob {
+  public:
+    ReactorClient(DatabaseConnection *db) : db(db), reactor(NULL), socketFd(-1), watching(false), retired(false),
+                                            current(NULL), crashed(false), blockingWork(NULL), jobRunning(false) {}
+    void OnSocketReady(bool readable, bool writable);
+    void OnWake();
+    void Run();
+  private:
+    DatabaseConnection *db;
+    DatabaseReactor *reactor;
+    int socketFd;
+    bool watching;
+    bool retired;
+    AsyncDatabaseWork *current;
+    bool crashed;
+    DatabaseWork *blockingWork;
+    bool jobRunning; // guarded by workQueueMutex
+
+    void Pump();
+    /**
+     * Send as much of the current work's output as the socket will
+     * take, watching for writability until the rest can be sent.
+     *
+     * @param writing Already watching for writability
+     * @return false if the connection failed
+     */
+    bool Flush(bool writing);
+    void CollectResults();
+    void Complete();
+    void DeliverNotifications();
+    void Retire();
+
+    friend class DatabaseConnection;
+  };
+#endif
+
   void FinishDisconnection();
+  void JoinWorker();
+  bool IsConnectionCancelled() const {
+    wxCriticalSectionLocker locker(workerThread.stateCriticalSection);
+    return connectCancelled;
+  }
   wxString identification;
   ServerConnection server;
   const wxString dbname;
@@ -303,8 +399,19 @@ private:
   ConnectionCallback *connectionCallback;
   std::set<wxString> preparedStatements;
   bool disconnectQueued;
+  long connectTimeout;
+  bool connectCancelled; // guarded by workerThread.stateCriticalSection
+#ifdef PQWX_DATABASE_REACTOR
+  ReactorClient reactorClient;
+  wxMutex closeMutex;
+  wxCondition closedCondition;
+  bool closed;
+#endif
 
   friend class WorkerThread;
+#ifdef PQWX_DATABASE_REACTOR
+  friend class ReactorClient;
+#endif
   friend class DisconnectWork;
   friend class DatabaseWork;
   friend class RegisterWithMonitor;
@@ -3,17 +3,24 @@
 #include "wx/log.h"
 #include "database_notification_monitor.h"
 
+#include <errno.h>
+
 #ifdef HAVE_EVENTFD
 #include <sys/eventfd.h>
 #endif
 
-void DatabaseNotificationMonitor::AddConnection(const Client& client)
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+bool DatabaseNotificationMonitor::AddConnection(const Client& client)
 {
-  EnsureRunning();
+  if (!EnsureRunning()) return false;
   TakeConnectionWork work(&worker, client);
   worker.PushWork(&work);
   Wake();
   work.Wait();
+  return true;
 }
 
 void DatabaseNotificationMonitor::RemoveConnection(int socketFd)
@@ -25,26 +32,53 @@ void DatabaseNotificationMonitor::RemoveConnection(int socketFd)
   work.Wait();
 }
 
-void DatabaseNotificationMonitor::EnsureRunning()
+void DatabaseNotificationMonitor::ResumeConnection(int socketFd)
+{
+  wxASSERT(worker.Running());
+  worker.PushWork(new ResumeConnectionWork(&worker, socketFd));
+  Wake();
+}
+
+bool DatabaseNotificationMonitor::EnsureRunning()
 {
   wxCriticalSectionLocker locker(worker.guardState);
-  if (worker.running) return;
+  if (worker.running) return true;
 
 #ifdef HAVE_EVENTFD
   worker.controlFD = eventfd(0, EFD_CLOEXEC);
+  if (worker.controlFD < 0) {
+    wxLogSysError(_T("eventfd() failed"));
+    return false;
+  }
 #else
   int endpoints[2];
   if (pipe2(endpoints, O_CLOEXEC) != 0) {
     wxLogSysError(_T("Failed to create pipe"));
-    return;
+    return false;
   }
 
   worker.workerControlEndpoint = endpoints[0]; // read
   clientControlEndpoint = endpoints[1]; // write
 #endif
 
+#ifdef HAVE_EPOLL
+  worker.epollFD = epoll_create1(EPOLL_CLOEXEC);
+  if (worker.epollFD < 0) {
+    wxLogSysError(_T("epoll_create1() failed"));
+#ifdef HAVE_EVENTFD
+    close(worker.controlFD);
+#else
+    close(clientControlEndpoint);
+    close(worker.workerControlEndpoint);
+#endif
+    return false;
+  }
+  worker.SetInterest(EPOLL_CTL_ADD, worker.ControlFD(), NULL, EPOLLIN);
+#endif
+
   worker.Create();
   worker.Run();
+  return true;
 }
 
 void DatabaseNotificationMonitor::Quit()
@@ -66,6 +100,9 @@ void DatabaseNotificationMonitor::EnsureStopped()
   close(clientControlEndpoint);
   close(worker.workerControlEndpoint);
 #endif
+#ifdef HAVE_EPOLL
+  close(worker.epollFD);
+#endif
 }
 
 void DatabaseNotificationMonitor::Wake()
@@ -79,6 +116,108 @@ void DatabaseNotificationMonitor::Wake()
 #endif
 }
 
+#ifdef HAVE_EPOLL
+wxThread::ExitCode DatabaseNotificationMonitor::WorkerThread::Entry()
+{
+  MarkRunning();
+
+  static const int maxEvents = 64;
+  struct epoll_event events[maxEvents];
+
+  while (!quit) {
+    int rc = epoll_wait(epollFD, events, maxEvents, -1);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      wxLogSysError(_T("epoll_wait() failed"));
+      break;
+    }
+    bool woken = false;
+    for (int i = 0; i < rc; i++) {
+      Client *client = (Client*) events[i].data.ptr;
+      if (client == NULL) {
+        woken = true;
+        continue;
+      }
+      if (!client->Invoke()) {
+        // stop listening until resumed: hangups and errors are reported even with no events asked for
+        SetInterest(EPOLL_CTL_DEL, client->GetFD(), NULL, 0);
+        suspended.insert(client->GetFD());
+      }
+    }
+    // only process work once this batch of events is done with, as it may remove clients
+    if (woken) {
+      DrainControl();
+      Work *work;
+      while ((work = ShiftWork()) != NULL) {
+        work->DoWork();
+      }
+    }
+  }
+
+  UnmarkRunning();
+
+  return 0;
+}
+
+void DatabaseNotificationMonitor::WorkerThread::SetInterest(int op, int socketFd, Client *client, unsigned events)
+{
+  struct epoll_event event;
+  event.events = events;
+  event.data.ptr = client;
+  if (epoll_ctl(epollFD, op, socketFd, &event) != 0)
+    wxLogSysError(_T("epoll_ctl() failed"));
+}
+
+void DatabaseNotificationMonitor::WorkerThread::DrainControl()
+{
+#ifdef HAVE_EVENTFD
+  eventfd_t buf;
+  if (eventfd_read(controlFD, &buf) != 0)
+    wxLogSysError(_T("eventfd_read() failed"));
+#else
+  char buffer[64];
+  read(workerControlEndpoint, buffer, sizeof(buffer));
+#endif
+}
+
+void DatabaseNotificationMonitor::TakeConnectionWork::DoWork()
+{
+  // a socket number may be reused: replace whatever was registered for it before
+  std::map<int, Client>::iterator iter = worker->clients.find(client.GetFD());
+  if (iter == worker->clients.end()) {
+    iter = worker->clients.insert(std::make_pair(client.GetFD(), client)).first;
+    worker->SetInterest(EPOLL_CTL_ADD, client.GetFD(), &(iter->second), EPOLLIN);
+  }
+  else {
+    // closing the old socket will normally have dropped it from the epoll set already
+    struct epoll_event unused;
+    epoll_ctl(worker->epollFD, EPOLL_CTL_DEL, client.GetFD(), &unused);
+    worker->suspended.erase(client.GetFD());
+    iter->second = client;
+    worker->SetInterest(EPOLL_CTL_ADD, client.GetFD(), &(iter->second), EPOLLIN);
+  }
+  Done();
+}
+
+void DatabaseNotificationMonitor::ReleaseConnectionWork::DoWork()
+{
+  std::map<int, Client>::iterator iter = worker->clients.find(socketFd);
+  if (iter != worker->clients.end()) {
+    if (worker->suspended.erase(socketFd) == 0)
+      worker->SetInterest(EPOLL_CTL_DEL, socketFd, NULL, 0);
+    worker->clients.erase(iter);
+  }
+  Done();
+}
+
+void DatabaseNotificationMonitor::ResumeConnectionWork::DoWork()
+{
+  std::map<int, Client>::iterator iter = worker->clients.find(socketFd);
+  if (iter != worker->clients.end() && worker->suspended.erase(socketFd) > 0)
+    worker->SetInterest(EPOLL_CTL_ADD, socketFd, &(iter->second), EPOLLIN);
+  delete this;
+}
+#else
 wxThread::ExitCode DatabaseNotificationMonitor::WorkerThread::Entry()
 {
   MarkRunning();
@@ -93,9 +232,10 @@ wxThread::ExitCode DatabaseNotificationMonitor::WorkerThread::Entry()
 #else
     FD_SET(workerControlEndpoint, &readfds);
 #endif
-    for (std::list<Client>::const_iterator iter = clients.begin(); iter != clients.end(); iter++) {
-      int clientFd = (*iter).GetFD();
-      FD_SET(clientFd, &readfds);
+    for (std::map<int, Client>::const_iterator iter = clients.begin(); iter != clients.end(); iter++) {
+      int clientFd = iter->first;
+      if (!suspended.count(clientFd))
+        FD_SET(clientFd, &readfds);
     }
 
     int rc = select(MaxFd() + 1, &readfds, NULL, NULL, NULL);
@@ -123,10 +263,10 @@ wxThread::ExitCode DatabaseNotificationMonitor::WorkerThread::Entry()
       }
     }
 #endif
-    for (std::list<Client>::const_iterator iter = clients.begin(); iter != clients.end(); iter++) {
-      int clientFd = (*iter).GetFD();
-      if (FD_ISSET(clientFd, &readfds)) {
-        (*iter).Invoke();
+    for (std::map<int, Client>::const_iterator iter = clients.begin(); iter != clients.end(); iter++) {
+      int clientFd = iter->first;
+      if (FD_ISSET(clientFd, &readfds) && !iter->second.Invoke()) {
+        suspended.insert(clientFd);
       }
     }
   }
@@ -138,21 +278,27 @@ wxThread::ExitCode DatabaseNotificationMonitor::WorkerThread::Entry()
 
 void DatabaseNotificationMonitor::TakeConnectionWork::DoWork()
 {
-  worker->clients.push_back(client);
+  // a socket number may be reused: replace whatever was registered for it before
+  worker->clients.erase(client.GetFD());
+  worker->clients.insert(std::make_pair(client.GetFD(), client));
+  worker->suspended.erase(client.GetFD());
   Done();
 }
 
 void DatabaseNotificationMonitor::ReleaseConnectionWork::DoWork()
 {
-  for (std::list<Client>::iterator iter = worker->clients.begin(); iter != worker->clients.end(); iter++) {
-    if ((*iter).GetFD() == socketFd) {
-      worker->clients.erase(iter);
-      break;
-    }
-  }
+  worker->clients.erase(socketFd);
+  worker->suspended.erase(socketFd);
   Done();
 }
 
+void DatabaseNotificationMonitor::ResumeConnectionWork::DoWork()
+{
+  worker->suspended.erase(socketFd);
+  delete this;
+}
+#endif
+
 void DatabaseNotificationMonitor::QuitWork::DoWork()
 {
   worker->quit = true;
@@ -12,25 +12,41 @@
 #ifdef PQWX_NOTIFICATION_MONITOR
 
 #include <deque>
-#include <list>
+#include <map>
+#include <set>
 #include "libpq-fe.h"
 #include "wx/thread.h"
 
 /**
  * Listen for asynchronous notifications on database connections.
+ *
+ * Connections are registered once, and remain registered while they
+ * are in use by their own worker thread. The input processor decides
+ * whether the monitor may consume input at any given time: if it
+ * declines, the connection is suspended until its owner resumes it.
+ *
+ * Where epoll is available, interest in each socket is registered
+ * with the kernel once, so each wakeup only costs as much as the
+ * number of ready connections. Otherwise the monitor falls back to
+ * select(), which is limited to FD_SETSIZE descriptors.
  */
 class DatabaseNotificationMonitor {
 public:
   class InputProcessor {
   public:
-    virtual void operator()() = 0;
+    /**
+     * Consume input from the connection.
+     *
+     * @return false if the connection is busy, and should not be watched until it is resumed
+     */
+    virtual bool operator()() = 0;
   };
 
   class Client {
   public:
     Client(int socketFd, InputProcessor *processor) : socketFd(socketFd), processor(processor) {}
     int GetFD() const { return socketFd; }
-    void Invoke() const { (*processor)(); }
+    bool Invoke() const { return (*processor)(); }
   private:
     int socketFd;
     InputProcessor *processor;
@@ -39,8 +55,19 @@ public:
   DatabaseNotificationMonitor() {}
   ~DatabaseNotificationMonitor() { EnsureStopped(); }
 
-  void AddConnection(const Client& client);
+  /**
+   * Start watching a connection.
+   *
+   * @return false if the monitor could not be started
+   */
+  bool AddConnection(const Client& client);
   void RemoveConnection(int socketFd);
+  /**
+   * Start watching a suspended connection again.
+   *
+   * This does not wait for the monitor thread to act on the request.
+   */
+  void ResumeConnection(int socketFd);
   void Quit();
 
 private:
@@ -66,6 +93,18 @@ private:
       wxCriticalSectionLocker locker(guardState);
       running = false;
     }
+#ifdef HAVE_EPOLL
+    int ControlFD() const
+    {
+#ifdef HAVE_EVENTFD
+      return controlFD;
+#else
+      return workerControlEndpoint;
+#endif
+    }
+    void SetInterest(int op, int socketFd, Client *client, unsigned events);
+    void DrainControl();
+#else
     int MaxFd() const
     {
 #ifdef HAVE_EVENTFD
@@ -73,16 +112,24 @@ private:
 #else
       int max = workerControlEndpoint;
 #endif
-      for (std::list<Client>::const_iterator iter = clients.begin(); iter != clients.end(); iter++) {
-        int clientFd = (*iter).GetFD();
-        if (clientFd > max) max = clientFd;
+      for (std::map<int, Client>::const_iterator iter = clients.begin(); iter != clients.end(); iter++) {
+        int clientFd = iter->first;
+        if (clientFd > max && !suspended.count(clientFd)) max = clientFd;
       }
       return max;
     }
+#endif
     bool running;
     bool quit;
     mutable wxCriticalSection guardState;
-    std::list<Client> clients;
+    std::map<int, Client> clients;
+#ifdef HAVE_EPOLL
+    int epollFD;
+#endif
+    /**
+     * Connections not being watched until they are resumed.
+     */
+    std::set<int> suspended;
 #ifdef HAVE_EVENTFD
     int controlFD;
 #else
@@ -106,12 +153,14 @@ private:
     friend class QuitWork;
     friend class TakeConnectionWork;
     friend class ReleaseConnectionWork;
+    friend class ResumeConnectionWork;
     friend class DatabaseNotificationMonitor;
   };
 
   class Work {
   public:
     Work(WorkerThread *worker) : worker(worker) {}
+    virtual ~Work() {}
     virtual void DoWork() = 0;
   protected:
     WorkerThread *worker;
@@ -155,6 +204,17 @@ private:
     int socketFd;
   };
 
+  /**
+   * Asynchronous: the work object deletes itself once done.
+   */
+  class ResumeConnectionWork : public Work {
+  public:
+    ResumeConnectionWork(WorkerThread *worker, int socketFd) : Work(worker), socketFd(socketFd) {}
+    void DoWork();
+  private:
+    int socketFd;
+  };
+
   class QuitWork : public Work {
   public:
     QuitWork(WorkerThread *worker) : Work(worker) {}
@@ -166,7 +226,7 @@ private:
   int clientControlEndpoint;
 #endif
 
-  void EnsureRunning();
+  bool EnsureRunning();
   void EnsureStopped();
   void Wake();
 
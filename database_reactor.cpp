@@ -0,0 +1,214 @@
+#include "pqwx_config.h"
+
+#ifdef PQWX_DATABASE_REACTOR
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "wx/log.h"
+#include "database_reactor.h"
+
+void DatabaseReactor::Watch(int socketFd, Client *client, bool writable)
+{
+  struct epoll_event event;
+  event.events = EPOLLIN | (writable ? EPOLLOUT : 0);
+  event.data.ptr = client;
+  if (epoll_ctl(worker->epollFD, EPOLL_CTL_MOD, socketFd, &event) == 0)
+    return;
+  if (errno != ENOENT) {
+    wxLogSysError(_T("epoll_ctl(MOD) failed"));
+    return;
+  }
+  if (epoll_ctl(worker->epollFD, EPOLL_CTL_ADD, socketFd, &event) != 0)
+    wxLogSysError(_T("epoll_ctl(ADD) failed"));
+}
+
+void DatabaseReactor::Unwatch(int socketFd)
+{
+  struct epoll_event event; // ignored, but must be non-NULL for older kernels
+  if (epoll_ctl(worker->epollFD, EPOLL_CTL_DEL, socketFd, &event) != 0 && errno != ENOENT && errno != EBADF)
+    wxLogSysError(_T("epoll_ctl(DEL) failed"));
+}
+
+void DatabaseReactor::Wake(Client *client)
+{
+  if (!EnsureRunning()) return;
+  {
+    wxCriticalSectionLocker locker(guardWakeQueue);
+    wakeQueue.push_back(client);
+  }
+  if (eventfd_write(worker->controlFD, 1) != 0)
+    wxLogSysError(_T("eventfd_write() failed"));
+}
+
+void DatabaseReactor::Forget(Client *client)
+{
+  wxCriticalSectionLocker locker(guardWakeQueue);
+  std::deque<Client*>::iterator iter = wakeQueue.begin();
+  while (iter != wakeQueue.end()) {
+    if (*iter == client)
+      iter = wakeQueue.erase(iter);
+    else
+      ++iter;
+  }
+}
+
+void DatabaseReactor::RunBlocking(BlockingJob *job)
+{
+  wxMutexLocker locker(helperMutex);
+  jobQueue.push_back(job);
+  if (idleHelpers == 0 && helpers.size() < maxHelpers) {
+    HelperThread *helper = new HelperThread(this);
+    helper->Create();
+    helper->Run();
+    helpers.push_back(helper);
+    wxLogDebug(_T("reactor: started helper thread #%lu"), (unsigned long) helpers.size());
+  }
+  helperCondition.Signal();
+}
+
+bool DatabaseReactor::EnsureRunning()
+{
+  wxCriticalSectionLocker locker(guardWorker);
+  if (worker != NULL) return true;
+
+  int epollFD = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFD < 0) {
+    wxLogSysError(_T("epoll_create1() failed"));
+    return false;
+  }
+  int controlFD = eventfd(0, EFD_CLOEXEC);
+  if (controlFD < 0) {
+    wxLogSysError(_T("eventfd() failed"));
+    close(epollFD);
+    return false;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = NULL; // the control channel
+  if (epoll_ctl(epollFD, EPOLL_CTL_ADD, controlFD, &event) != 0) {
+    wxLogSysError(_T("epoll_ctl(ADD) failed for control channel"));
+    close(controlFD);
+    close(epollFD);
+    return false;
+  }
+
+  worker = new WorkerThread(this);
+  worker->epollFD = epollFD;
+  worker->controlFD = controlFD;
+  worker->Create();
+  worker->Run();
+  return true;
+}
+
+void DatabaseReactor::EnsureStopped()
+{
+  StopHelpers();
+
+  wxCriticalSectionLocker locker(guardWorker);
+  if (worker == NULL) return;
+  worker->quit = true;
+  if (eventfd_write(worker->controlFD, 1) != 0)
+    wxLogSysError(_T("eventfd_write() failed"));
+  worker->Wait();
+  close(worker->controlFD);
+  close(worker->epollFD);
+  delete worker;
+  worker = NULL;
+}
+
+void DatabaseReactor::StopHelpers()
+{
+  {
+    wxMutexLocker locker(helperMutex);
+    quitHelpers = true;
+    helperCondition.Broadcast();
+  }
+  for (std::vector<HelperThread*>::iterator iter = helpers.begin(); iter != helpers.end(); iter++) {
+    (*iter)->Wait();
+    delete *iter;
+  }
+  helpers.clear();
+}
+
+wxThread::ExitCode DatabaseReactor::WorkerThread::Entry()
+{
+  {
+    wxCriticalSectionLocker locker(guardState);
+    running = true;
+  }
+
+  static const int maxEvents = 64;
+  struct epoll_event events[maxEvents];
+
+  while (!quit) {
+    int rc = epoll_wait(epollFD, events, maxEvents, -1);
+    if (rc < 0) {
+      if (errno == EINTR) continue;
+      wxLogSysError(_T("epoll_wait() failed"));
+      break;
+    }
+    bool woken = false;
+    for (int i = 0; i < rc; i++) {
+      Client *client = (Client*) events[i].data.ptr;
+      if (client == NULL) {
+        eventfd_t buf;
+        if (eventfd_read(controlFD, &buf) != 0)
+          wxLogSysError(_T("eventfd_read() failed"));
+        woken = true;
+        continue;
+      }
+      // errors and hangups are reported as readable, so that libpq gets to see them
+      bool readable = (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+      bool writable = (events[i].events & EPOLLOUT) != 0;
+      client->OnSocketReady(readable, writable);
+    }
+    if (woken)
+      ProcessWakes();
+  }
+
+  {
+    wxCriticalSectionLocker locker(guardState);
+    running = false;
+  }
+
+  return 0;
+}
+
+void DatabaseReactor::WorkerThread::ProcessWakes()
+{
+  // shift these one at a time, since a client may Forget() itself
+  // (and so any wakes still queued for it) while handling one
+  Client *client;
+  while ((client = owner->ShiftWake()) != NULL) {
+    client->OnWake();
+  }
+}
+
+wxThread::ExitCode DatabaseReactor::HelperThread::Entry()
+{
+  wxMutexLocker locker(owner->helperMutex);
+  do {
+    while (!owner->jobQueue.empty()) {
+      BlockingJob *job = owner->jobQueue.front();
+      owner->jobQueue.pop_front();
+      owner->helperMutex.Unlock();
+      job->Run();
+      owner->helperMutex.Lock();
+    }
+    if (owner->quitHelpers)
+      return 0;
+    ++owner->idleHelpers;
+    owner->helperCondition.Wait();
+    --owner->idleHelpers;
+  } while (true);
+}
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
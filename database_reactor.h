@@ -0,0 +1,190 @@
+/**
+ * @file
+ * Single-threaded reactor driving asynchronous database connections.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __database_reactor_h
+#define __database_reactor_h
+
+#include "pqwx_config.h"
+
+#ifdef PQWX_DATABASE_REACTOR
+
+#include <deque>
+#include <vector>
+#include "wx/thread.h"
+
+/**
+ * Drive many database connections from one thread.
+ *
+ * Instead of each connection owning a worker thread that blocks in
+ * libpq, connections using the reactor put their sockets into
+ * non-blocking mode and register them here. A single thread waits
+ * on all of them with epoll, and calls back into the owning client
+ * when a socket becomes readable or writable, or when the client has
+ * been woken from another thread (typically because work was added
+ * to its queue).
+ *
+ * Work that can only be executed by blocking in libpq is handed to a
+ * small pool of helper threads, which is grown on demand up to a
+ * fixed limit. So the number of threads scales with the number of
+ * queries in progress, not with the number of open connections.
+ */
+class DatabaseReactor {
+public:
+  /**
+   * A connection driven by the reactor.
+   *
+   * All callbacks are made on the reactor thread.
+   */
+  class Client {
+  public:
+    virtual ~Client() {}
+    /**
+     * The client's socket is ready for reading and/or writing.
+     */
+    virtual void OnSocketReady(bool readable, bool writable) = 0;
+    /**
+     * The client was woken by a call to Wake().
+     */
+    virtual void OnWake() = 0;
+  };
+
+  /**
+   * A job to be run on a helper thread, for when blocking is unavoidable.
+   */
+  class BlockingJob {
+  public:
+    virtual ~BlockingJob() {}
+    /**
+     * Execute the job. This is called on a helper thread.
+     */
+    virtual void Run() = 0;
+  };
+
+  /**
+   * Create reactor.
+   *
+   * The reactor thread is not started until Start() is called or a
+   * client is first woken.
+   *
+   * @param maxHelpers Maximum number of helper threads to run blocking jobs on
+   */
+  DatabaseReactor(unsigned maxHelpers) : worker(NULL), maxHelpers(maxHelpers), idleHelpers(0), helperCondition(helperMutex), quitHelpers(false) {}
+  ~DatabaseReactor() { EnsureStopped(); }
+
+  /**
+   * Start the reactor thread, if it isn't already running.
+   *
+   * @return false if the reactor could not be started
+   */
+  bool Start() { return EnsureRunning(); }
+
+  /**
+   * Start watching a socket, or change the events being watched for.
+   *
+   * Must be called on the reactor thread.
+   */
+  void Watch(int socketFd, Client *client, bool writable);
+  /**
+   * Stop watching a socket.
+   *
+   * Must be called on the reactor thread.
+   */
+  void Unwatch(int socketFd);
+  /**
+   * Arrange for the client's OnWake() to be called on the reactor thread.
+   *
+   * May be called from any thread.
+   */
+  void Wake(Client *client);
+  /**
+   * Discard any pending wake-ups for a client.
+   *
+   * Must be called on the reactor thread, by a client that is about
+   * to be released.
+   */
+  void Forget(Client *client);
+  /**
+   * Run a blocking job on a helper thread.
+   *
+   * The job is responsible for waking its client when it is done.
+   */
+  void RunBlocking(BlockingJob *job);
+  /**
+   * Stop the reactor and helper threads.
+   */
+  void Quit() { EnsureStopped(); }
+
+private:
+  class WorkerThread : public wxThread {
+  public:
+    WorkerThread(DatabaseReactor *owner) : wxThread(wxTHREAD_JOINABLE), owner(owner), running(false), quit(false) {}
+    virtual ExitCode Entry();
+    bool Running() const
+    {
+      wxCriticalSectionLocker locker(guardState);
+      return running;
+    }
+  private:
+    DatabaseReactor *owner;
+    bool running;
+    bool quit;
+    mutable wxCriticalSection guardState;
+    int epollFD;
+    int controlFD;
+    void ProcessWakes();
+    friend class DatabaseReactor;
+  };
+
+  class HelperThread : public wxThread {
+  public:
+    HelperThread(DatabaseReactor *owner) : wxThread(wxTHREAD_JOINABLE), owner(owner) {}
+    virtual ExitCode Entry();
+  private:
+    DatabaseReactor *owner;
+  };
+
+  WorkerThread *worker;
+  wxCriticalSection guardWorker;
+  std::deque<Client*> wakeQueue;
+  wxCriticalSection guardWakeQueue;
+
+  const unsigned maxHelpers;
+  std::vector<HelperThread*> helpers;
+  unsigned idleHelpers;
+  std::deque<BlockingJob*> jobQueue;
+  wxMutex helperMutex;
+  wxCondition helperCondition;
+  bool quitHelpers;
+
+  Client *ShiftWake()
+  {
+    wxCriticalSectionLocker locker(guardWakeQueue);
+    if (wakeQueue.empty()) return NULL;
+    Client *client = wakeQueue.front();
+    wakeQueue.pop_front();
+    return client;
+  }
+
+  bool EnsureRunning();
+  void EnsureStopped();
+  void StopHelpers();
+
+  // copying a reactor would be bad.
+  DatabaseReactor(const DatabaseReactor&);
+  DatabaseReactor& operator=(const DatabaseReactor&);
+
+  friend class WorkerThread;
+  friend class HelperThread;
+};
+
+#endif
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
@@ -95,6 +95,77 @@ void DatabaseWork::DoCommand(const char *sql) const {
 
   PQclear(rs);
 }
+void AsyncDatabaseWork::DoWork()
+{
+  if (!Send()) return;
+
+  try {
+    PGresult *rs;
+    while ((rs = PQgetResult(conn)) != NULL) {
+      bool final = IsFinalResult(rs);
+      ProcessResult(rs);
+      if (final) break;
+    }
+  } catch (...) {
+    DiscardResults();
+    throw;
+  }
+
+  ResultsComplete();
+}
+
+void AsyncDatabaseWork::DiscardResults()
+{
+  PGresult *rs;
+  while ((rs = PQgetResult(conn)) != NULL) {
+    bool final = IsFinalResult(rs);
+    PQclear(rs);
+    if (final) break;
+  }
+}
+
+void AsyncDatabaseWork::SendQuery(const char *sql)
+{
+  db->LogSql(sql);
+
+  if (!PQsendQuery(conn, sql))
+    ThrowSendFailure(sql);
+}
+
+void AsyncDatabaseWork::SendQueryParams(const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues)
+{
+  db->LogSql(sql);
+
+  if (!PQsendQueryParams(conn, sql, paramCount, paramTypes, paramValues, NULL, NULL, 0))
+    ThrowSendFailure(sql);
+}
+
+void AsyncDatabaseWork::ThrowSendFailure(const char *sql) const
+{
+  ConnStatusType connStatus = PQstatus(conn);
+  if (connStatus == CONNECTION_BAD)
+    throw PgLostConnection();
+  throw PgInvalidQuery(sql, wxString(PQerrorMessage(conn), wxConvUTF8));
+}
+
+void AsyncDatabaseWork::CheckCommandResult(PGresult *rs, const char *sql) const
+{
+  ExecStatusType status = PQresultStatus(rs);
+  if (status == PGRES_FATAL_ERROR) {
+    PgError error(rs);
+    PQclear(rs);
+    db->LogSqlQueryFailed(error);
+    throw PgQueryFailure(sql, error);
+  }
+  else if (status != PGRES_COMMAND_OK) {
+    db->LogSqlQueryInvalidStatus(PQresultErrorMessage(rs), status);
+    PQclear(rs);
+    throw PgInvalidQuery(sql, _T("unexpected status"));
+  }
+
+  PQclear(rs);
+}
+
 QueryResults DatabaseWork::DoQuery(const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues) const
 {
   db->LogSql(sql);
@@ -121,11 +192,8 @@ QueryResults DatabaseWork::DoQuery(const char *sql, int paramCount, const Oid *p
     throw PgInvalidQuery(sql, _T("expected data back"));
   }
 
-  QueryResults results(rs);
-
-  PQclear(rs);
-
-  return results;
+  // ad-hoc queries are read once and discarded, so don't copy the values out
+  return QueryResults(rs, QueryResults::RetainResult);
 }
 
 QueryResults DatabaseWork::DoQuery(const char *sql, const std::vector<Oid>& paramTypes, const std::vector<wxString>& paramValues) const
@@ -140,7 +208,7 @@ QueryResults DatabaseWork::DoQuery(const char *sql, const std::vector<Oid>& para
   return DoQuery(sql, paramCount, &(paramTypes[0]), &(values[0]));
 }
 
-QueryResults DatabaseWork::DoNamedQuery(const wxString &name, const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues) const
+QueryResults DatabaseWork::DoNamedQuery(const wxString &name, const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues, int resultFormat) const
 {
   if (!db->IsStatementPrepared(name)) {
     db->LogSql((wxString(_T("/* prepare */ ")) + wxString(sql, wxConvUTF8)).utf8_str());
@@ -169,7 +237,7 @@ QueryResults DatabaseWork::DoNamedQuery(const wxString &name, const char *sql, i
   wxStopWatch stopwatch;
 #endif
 
-  PGresult *rs = PQexecPrepared(conn, name.utf8_str(), paramCount, paramValues, NULL, NULL, 0);
+  PGresult *rs = PQexecPrepared(conn, name.utf8_str(), paramCount, paramValues, NULL, NULL, resultFormat);
   wxCHECK2(rs, throw PgResourceFailure());
 
 #ifdef __WXDEBUG__
@@ -186,14 +254,23 @@ QueryResults DatabaseWork::DoNamedQuery(const wxString &name, const char *sql, i
     throw PgInvalidQuery(name, _T("expected data back"));
   }
 
-  QueryResults results(rs);
+  if (resultFormat != 0) {
+    int column = ResultColumns::FindUndecodableColumn(rs);
+    if (column >= 0) {
+      wxString message = wxString::Format(_T("unable to decode binary value of type %u in column %d"), PQftype(rs, column), column);
+      PQclear(rs);
+      throw PgInvalidQuery(name, message);
+    }
+  }
+
+  QueryResults results(rs, QueryResults::Columnar);
 
   PQclear(rs);
 
   return results;
 }
 
-QueryResults DatabaseWork::DoNamedQuery(const wxString &name, const char *sql, const std::vector<Oid>& paramTypes, const std::vector<wxString>& paramValues) const
+QueryResults DatabaseWork::DoNamedQuery(const wxString &name, const char *sql, const std::vector<Oid>& paramTypes, const std::vector<wxString>& paramValues, int resultFormat) const
 {
   unsigned paramCount = paramTypes.size();
   std::vector<wxCharBuffer> buffers;
@@ -202,7 +279,7 @@ QueryResults DatabaseWork::DoNamedQuery(const wxString &name, const char *sql, c
     buffers.push_back(paramValues[i].utf8_str());
     values.push_back(buffers.back().data());
   }
-  return DoNamedQuery(name, sql, paramCount, &(paramTypes[0]), &(values[0]));
+  return DoNamedQuery(name, sql, paramCount, &(paramTypes[0]), &(values[0]), resultFormat);
 }
 // Local Variables:
 // mode: c++
@@ -37,8 +37,15 @@ public:
   QueryResults DoQuery(const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues) const;
   QueryResults DoQuery(const char *sql, std::vector<Oid> const& paramTypes, std::vector<wxString> const& paramValues) const;
 
-  QueryResults DoNamedQuery(const wxString &name, const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues) const;
-  QueryResults DoNamedQuery(const wxString &name, const char *sql, std::vector<Oid> const& paramTypes, std::vector<wxString> const& paramValues) const;
+  /**
+   * Execute a named query, preparing it first if necessary.
+   *
+   * @param resultFormat 0 to request text results, or 1 to request
+   * binary results, which must be decodable by ResultColumns:
+   * otherwise PgInvalidQuery is thrown.
+   */
+  QueryResults DoNamedQuery(const wxString &name, const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues, int resultFormat = 0) const;
+  QueryResults DoNamedQuery(const wxString &name, const char *sql, std::vector<Oid> const& paramTypes, std::vector<wxString> const& paramValues, int resultFormat = 0) const;
 
   /**
    * Fluent-style query executor class.
@@ -100,6 +107,82 @@ protected:
   PGconn *conn;
 
   friend class DatabaseConnection::WorkerThread;
+#ifdef PQWX_DATABASE_REACTOR
+  friend class DatabaseConnection::ReactorClient;
+#endif
+};
+
+/**
+ * Database work that can be driven without blocking.
+ *
+ * Rather than calling libpq synchronously, the work dispatches its
+ * query with one of the PQsend* functions and is then fed each result
+ * as it becomes available. This allows the database reactor to drive
+ * it alongside many other connections from one thread. On a
+ * connection with its own worker thread, DoWork() simply runs the
+ * same steps synchronously.
+ */
+class AsyncDatabaseWork : public DatabaseWork {
+public:
+  /**
+   * Dispatch the query for this work.
+   *
+   * @return true if a query was sent and its results should be
+   * awaited, or false if the work completed without needing to
+   * contact the server.
+   */
+  virtual bool Send() = 0;
+  /**
+   * Queue anything that Send() could not, because the output buffer
+   * of a non-blocking connection was full. This is called again each
+   * time the output buffer has drained, until it returns true.
+   *
+   * @return true once everything has been queued
+   */
+  virtual bool SendMore() { return true; }
+  /**
+   * Process a result as it arrives. The work takes ownership of the result.
+   */
+  virtual void ProcessResult(PGresult *rs) = 0;
+  /**
+   * Called once all the results for the query have been processed.
+   */
+  virtual void ResultsComplete() {}
+
+  void DoWork();
+
+  /**
+   * @return true if no more results will follow this one: that is, the connection has entered a COPY state.
+   */
+  static bool IsFinalResult(const PGresult *rs)
+  {
+    ExecStatusType status = PQresultStatus(rs);
+    return status == PGRES_COPY_IN || status == PGRES_COPY_OUT
+#if PG_VERSION_NUM >= 90100
+      || status == PGRES_COPY_BOTH
+#endif
+      ;
+  }
+
+protected:
+  /**
+   * Send a simple query, which may contain several commands.
+   */
+  void SendQuery(const char *sql);
+  /**
+   * Send a query with parameters.
+   */
+  void SendQueryParams(const char *sql, int paramCount, const Oid *paramTypes, const char **paramValues);
+  /**
+   * Check a result from a command, and throw an exception if it failed.
+   *
+   * The result is cleared.
+   */
+  void CheckCommandResult(PGresult *rs, const char *sql) const;
+
+private:
+  void ThrowSendFailure(const char *sql) const;
+  void DiscardResults();
 };
 
 /**
@@ -118,15 +201,15 @@ public:
    */
   QueryResults DoQuery(const wxString &name, int paramCount, Oid paramTypes[], const char *paramValues[]) const
   {
-    return DatabaseWork::DoNamedQuery(name, GetSql(name), paramCount, paramTypes, paramValues);
+    return DatabaseWork::DoNamedQuery(name, GetSql(name), paramCount, paramTypes, paramValues, GetResultFormat(name));
   }
   /**
    * Execute named query with vector parameters.
    */
   QueryResults DoQuery(const wxString &name, const std::vector<Oid>& paramTypes, const std::vector<wxString>& paramValues) const
   {
-    if (paramTypes.empty()) return DatabaseWork::DoNamedQuery(name, GetSql(name), 0, NULL, NULL);
-    return DatabaseWork::DoNamedQuery(name, GetSql(name), paramTypes, paramValues);
+    if (paramTypes.empty()) return DatabaseWork::DoNamedQuery(name, GetSql(name), 0, NULL, NULL, GetResultFormat(name));
+    return DatabaseWork::DoNamedQuery(name, GetSql(name), paramTypes, paramValues, GetResultFormat(name));
   }
   /**
    * Get SQL from dictionary.
@@ -135,6 +218,13 @@ public:
   {
     return sqlDictionary.GetSql(name, PQserverVersion(conn));
   }
+  /**
+   * Get result format for SQL from dictionary.
+   */
+  int GetResultFormat(const wxString &name) const
+  {
+    return sqlDictionary.GetResultFormat(name, PQserverVersion(conn));
+  }
 
   /**
    * Fluent-style named query executor class.
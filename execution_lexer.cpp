@@ -1,5 +1,59 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "execution_lexer.h"
 
+/**
+ * Characters that PullSql has to examine outside dollar-quoted text.
+ */
+class SqlSpecialCharacters {
+public:
+  SqlSpecialCharacters()
+  {
+    memset(flags, 0, sizeof(flags));
+    static const char special[] = "$'\";-/\\";
+    for (const char *p = special; *p != '\0'; p++)
+      flags[(unsigned char) *p] = true;
+  }
+  bool flags[256];
+};
+
+static const SqlSpecialCharacters sqlSpecial;
+
+unsigned ExecutionLexer::Find(char c, unsigned from) const
+{
+  const char *found = (const char*) memchr(buffer + from, c, length - from);
+  return found == NULL ? length : found - buffer;
+}
+
+unsigned ExecutionLexer::FindSqlSpecial(unsigned from) const
+{
+  unsigned p = from;
+#ifdef __SSE2__
+  const __m128i dollar = _mm_set1_epi8('$');
+  const __m128i singleQuote = _mm_set1_epi8('\'');
+  const __m128i doubleQuote = _mm_set1_epi8('\"');
+  const __m128i semicolon = _mm_set1_epi8(';');
+  const __m128i dash = _mm_set1_epi8('-');
+  const __m128i slash = _mm_set1_epi8('/');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  for (; p + 16 <= length; p += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*) (buffer + p));
+    __m128i quotes = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, dollar), _mm_cmpeq_epi8(bytes, singleQuote)),
+                                  _mm_cmpeq_epi8(bytes, doubleQuote));
+    __m128i others = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, semicolon), _mm_cmpeq_epi8(bytes, dash)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(bytes, slash), _mm_cmpeq_epi8(bytes, backslash)));
+    int mask = _mm_movemask_epi8(_mm_or_si128(quotes, others));
+    if (mask != 0) return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p < length; p++) {
+    if (sqlSpecial.flags[(unsigned char) buffer[p]]) return p;
+  }
+  return length;
+}
+
 ExecutionLexer::Token ExecutionLexer::Pull0()
 {
   PassWhitespace();
@@ -48,6 +102,8 @@ ExecutionLexer::Token ExecutionLexer::PullSql()
   int start = pos;
 
   do {
+    // skip straight to the next character that might be significant
+    pos = quoteStack.empty() ? FindSqlSpecial(pos) : Find('$', pos);
     int c = Take();
 
     if (c < 0) {
@@ -90,48 +146,54 @@ ExecutionLexer::Token ExecutionLexer::PullSql()
 
 void ExecutionLexer::PassSingleQuotedString(bool escapeSyntax)
 {
-  int c;
   do {
-    c = Take();
-    if (c == '\'') {
-      if (Peek() != '\'')
-        return;
-    }
-  } while (c >= 0);
+    pos = Find('\'', pos);
+    if (Take() < 0)
+      return;
+    if (Peek() != '\'')
+      return;
+    Take(); // doubled quote is part of the string
+  } while (true);
 }
 
 void ExecutionLexer::PassDoubleQuotedString()
 {
-  int c;
   do {
-    c = Take();
-    if (c == '\"') {
-      if (Peek() != '\"')
-        return;
-    }
-  } while (c >= 0);
+    pos = Find('\"', pos);
+    if (Take() < 0)
+      return;
+    if (Peek() != '\"')
+      return;
+    Take(); // doubled quote is part of the identifier
+  } while (true);
 }
 
 void ExecutionLexer::PassSingleLineComment()
 {
-  int c;
-  do {
-    c = Take();
-    if (c == '\n')
-      return;
-  } while (c >= 0);
+  pos = Find('\n', pos);
+  Take();
 }
 
 void ExecutionLexer::PassBlockComment()
 {
-  int c;
+  Take(); // the '*' of the opening "/*"
+  // comments nest, as they do in the server
+  unsigned depth = 1;
+  unsigned closedAt = pos;
   do {
-    c = Take();
-    if (c == '*') {
-      if (Peek() == '/')
+    pos = Find('*', pos);
+    if (Take() < 0)
+      return;
+    if (Peek() == '/') {
+      Take();
+      if (--depth == 0)
         return;
+      closedAt = pos;
     }
-  } while (c >= 0);
+    else if (pos - 1 > closedAt && CharAt(pos - 2) == '/') {
+      ++depth;
+    }
+  } while (true);
 }
 
 void ExecutionLexer::PassDollarQuote()
@@ -140,13 +202,10 @@ void ExecutionLexer::PassDollarQuote()
 
   int start = pos;
 
-  int c;
-  do {
-    c = Take();
-    if (c < 0) return; // EOF inside dollar marker, oh well.
-  } while (c != '$');
+  pos = Find('$', pos);
+  if (Take() < 0) return; // EOF inside dollar marker, oh well.
 
-  std::string marker(buffer, pos - start);
+  std::string marker(buffer + start, pos - start);
 
   if (!quoteStack.empty() && quoteStack.back() == marker) {
     quoteStack.pop_back();
@@ -172,26 +231,18 @@ void ExecutionLexer::PassWhitespace()
 ExecutionLexer::Token ExecutionLexer::ReadCopyData0()
 {
   int start = pos;
-  bool backslashed = false;
 
   do {
-    int c = Take();
-
-    if (c < 0) {
+    // only a backslash can start the terminator, and escaped characters are skipped
+    pos = Find('\\', pos);
+    if (Take() < 0 || Take() < 0) {
       // well, this is really an error
       return Token(Token::COPY_DATA, start, pos - start);
     }
 
-    if (backslashed) {
-      if (c == '.') {
-        // remove the "\." from the returned token
-        return Token(Token::COPY_DATA, start, pos - 2 - start);
-      }
-      backslashed = false;
-    }
-    else {
-      if (c == '\\')
-        backslashed = true;
+    if (CharAt(pos - 1) == '.') {
+      // remove the "\." from the returned token
+      return Token(Token::COPY_DATA, start, pos - 2 - start);
     }
   } while (true);
 }
@@ -10,6 +10,7 @@
 #include <vector>
 #include "wx/string.h"
 #include "wx/log.h"
+#include "utf8_conversion.h"
 
 /**
  * Lex through SQL text, breaking it into SQL commands and backslash commands.
@@ -89,10 +90,15 @@ public:
     return ReadCopyData0();
   }
 
+  /**
+   * @return offset of the next character to be lexed
+   */
+  unsigned Position() const { return pos; }
+
   /**
    * Convert an offset/length combination to a wxString.
    */
-  wxString GetWXString(unsigned offset, unsigned length) const { return wxString(buffer + offset, wxConvUTF8, length); }
+  wxString GetWXString(unsigned offset, unsigned length) const { return Utf8ToWxString(buffer + offset, length); }
   /**
    * Convert a token into a wxString.
    */
@@ -109,6 +115,15 @@ private:
   int Take() { return pos >= length ? -1 : CharAt(pos++); }
   void BackUp() { --pos; }
   bool Done() const { return pos >= length; }
+  /**
+   * @return position of the next occurrence of a character, or the end of the buffer
+   */
+  unsigned Find(char c, unsigned from) const;
+  /**
+   * @return position of the next character that could end or change
+   * the lexing of SQL text, or the end of the buffer
+   */
+  unsigned FindSqlSpecial(unsigned from) const;
   void PassDoubleQuotedString();
   void PassSingleQuotedString(bool escapeSyntax);
   void PassSingleLineComment();
@@ -0,0 +1,162 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#ifdef __WXMSW__
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "mapped_file.h"
+
+MappedFile::MappedFile() :
+#ifdef __WXMSW__
+  handle(INVALID_HANDLE_VALUE), mapping(NULL),
+#else
+  fd(-1),
+#endif
+  length(0), view(NULL), viewLength(0)
+{
+}
+
+#ifdef __WXMSW__
+bool MappedFile::Open(const wxString &filename, wxString &error)
+{
+  Close();
+  handle = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    error = wxString::Format(_("Unable to open %s: %s"), filename.c_str(), wxSysErrorMsg());
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(handle, &size)) {
+    error = wxString::Format(_("Unable to read %s: %s"), filename.c_str(), wxSysErrorMsg());
+    Close();
+    return false;
+  }
+  length = size.QuadPart;
+  if (length > 0) {
+    mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+      error = wxString::Format(_("Unable to map %s: %s"), filename.c_str(), wxSysErrorMsg());
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t MappedFile::Granularity()
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwAllocationGranularity;
+}
+
+const char *MappedFile::Map(wxFileOffset offset, size_t size)
+{
+  Unmap();
+  if (mapping == NULL || offset >= length) return NULL;
+  if ((wxFileOffset) size > length - offset) size = length - offset;
+
+  wxFileOffset start = offset - offset % Granularity();
+  viewLength = size + (offset - start);
+  view = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD) (start >> 32), (DWORD) (start & 0xffffffff), viewLength);
+  if (view == NULL) return NULL;
+  return (const char*) view + (offset - start);
+}
+
+void MappedFile::Unmap()
+{
+  if (view != NULL) {
+    UnmapViewOfFile(view);
+    view = NULL;
+  }
+}
+
+void MappedFile::Close()
+{
+  Unmap();
+  if (mapping != NULL) {
+    CloseHandle(mapping);
+    mapping = NULL;
+  }
+  if (handle != INVALID_HANDLE_VALUE) {
+    CloseHandle(handle);
+    handle = INVALID_HANDLE_VALUE;
+  }
+  length = 0;
+}
+#else
+bool MappedFile::Open(const wxString &filename, wxString &error)
+{
+  Close();
+  fd = open(filename.fn_str(), O_RDONLY);
+  if (fd < 0) {
+    error = wxString::Format(_("Unable to open %s: %s"), filename.c_str(), wxSysErrorMsg());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    error = wxString::Format(_("Unable to read %s: %s"), filename.c_str(), wxSysErrorMsg());
+    Close();
+    return false;
+  }
+  length = st.st_size;
+  return true;
+}
+
+size_t MappedFile::Granularity()
+{
+  return sysconf(_SC_PAGESIZE);
+}
+
+const char *MappedFile::Map(wxFileOffset offset, size_t size)
+{
+  Unmap();
+  if (fd < 0 || offset >= length) return NULL;
+  if ((wxFileOffset) size > length - offset) size = length - offset;
+
+  wxFileOffset start = offset - offset % Granularity();
+  viewLength = size + (offset - start);
+  view = mmap(NULL, viewLength, PROT_READ, MAP_SHARED, fd, start);
+  if (view == MAP_FAILED) {
+    view = NULL;
+    return NULL;
+  }
+  // windows are read from start to finish
+  madvise(view, viewLength, MADV_SEQUENTIAL);
+  return (const char*) view + (offset - start);
+}
+
+void MappedFile::Unmap()
+{
+  if (view != NULL) {
+    munmap(view, viewLength);
+    view = NULL;
+  }
+}
+
+void MappedFile::Close()
+{
+  Unmap();
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  length = 0;
+}
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
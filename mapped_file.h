@@ -0,0 +1,75 @@
+/**
+ * @file
+ * Read-only memory mapping of a file, a window at a time.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __mapped_file_h
+#define __mapped_file_h
+
+#include "wx/string.h"
+#include "wx/filefn.h"
+
+/**
+ * A file mapped into memory for reading.
+ *
+ * Only one window of the file is mapped at once, so files larger than
+ * the address space (or than it is sensible to map) can be read by
+ * moving the window along.
+ */
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile() { Close(); }
+
+  /**
+   * Open a file.
+   *
+   * @param error Set to a description of the problem if the file can't be opened
+   */
+  bool Open(const wxString &filename, wxString &error);
+
+  /**
+   * @return length of the file
+   */
+  wxFileOffset Length() const { return length; }
+
+  /**
+   * Map part of the file, replacing any window already mapped.
+   *
+   * The window is cut short at the end of the file.
+   *
+   * @return pointer to the data at the offset, or NULL if it can't be mapped
+   */
+  const char *Map(wxFileOffset offset, size_t size);
+
+  /**
+   * Unmap any window and close the file.
+   */
+  void Close();
+
+private:
+#ifdef __WXMSW__
+  void *handle;
+  void *mapping;
+#else
+  int fd;
+#endif
+  wxFileOffset length;
+  void *view;
+  size_t viewLength;
+
+  void Unmap();
+  static size_t Granularity();
+
+  // not copyable
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
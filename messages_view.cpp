@@ -0,0 +1,124 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#include "messages_view.h"
+
+BEGIN_EVENT_TABLE(MessagesView, wxListCtrl)
+  EVT_IDLE(MessagesView::OnIdle)
+  EVT_SIZE(MessagesView::OnSize)
+END_EVENT_TABLE()
+
+MessagesView::MessagesView(wxWindow *parent, wxWindowID id, unsigned capacity)
+  : wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxLC_NO_HEADER | wxLC_SINGLE_SEL),
+    ring(capacity > 0 ? capacity : 1), start(0), count(0), dropped(0), updatePending(false)
+{
+  wxFont boldFont = GetFont();
+  boldFont.SetWeight(wxFONTWEIGHT_BOLD);
+  commandAttr.SetTextColour(wxColour(0x00, 0x00, 0x00));
+  errorAttr.SetTextColour(wxColour(0xff, 0x00, 0x00));
+  errorAttr.SetFont(boldFont);
+  noticeAttr.SetTextColour(wxColour(0x00, 0x00, 0xff));
+  echoAttr.SetTextColour(wxColour(0x00, 0x00, 0x88));
+  notificationAttr.SetTextColour(wxColour(0x00, 0x00, 0xff));
+  notificationAttr.SetFont(boldFont);
+  droppedAttr.SetTextColour(wxColour(0x80, 0x80, 0x80));
+
+  InsertColumn(0, _("Severity"));
+  InsertColumn(1, _("Message"));
+  SetColumnWidth(0, 100);
+}
+
+void MessagesView::Append(Kind kind, const wxString &label, const wxString &text, int scriptPosition)
+{
+  unsigned capacity = ring.size();
+  Message *slot;
+  if (count == capacity) {
+    slot = &ring[start];
+    start = (start + 1) % capacity;
+    ++dropped;
+  }
+  else {
+    slot = &ring[(start + count) % capacity];
+    ++count;
+  }
+  slot->kind = kind;
+  slot->label = label;
+  slot->text = text;
+  slot->scriptPosition = scriptPosition;
+
+  updatePending = true;
+}
+
+void MessagesView::OnIdle(wxIdleEvent &event)
+{
+  event.Skip();
+  if (!updatePending) return;
+  updatePending = false;
+
+  long itemCount = count + (dropped > 0 ? 1 : 0);
+  SetItemCount(itemCount);
+  // once messages are being discarded, every line has moved
+  if (dropped > 0) Refresh();
+  if (itemCount > 0) EnsureVisible(itemCount - 1);
+}
+
+void MessagesView::OnSize(wxSizeEvent &event)
+{
+  event.Skip();
+  int width = GetClientSize().GetWidth() - GetColumnWidth(0);
+  if (width > 0) SetColumnWidth(1, width);
+}
+
+const MessagesView::Message *MessagesView::MessageAt(long item) const
+{
+  if (dropped > 0) {
+    if (item == 0) return NULL;
+    --item;
+  }
+  wxASSERT(item >= 0 && (unsigned long) item < count);
+  return &ring[(start + item) % ring.size()];
+}
+
+int MessagesView::GetScriptPosition(long item) const
+{
+  const Message *message = MessageAt(item);
+  return message == NULL ? -1 : message->scriptPosition;
+}
+
+wxString MessagesView::OnGetItemText(long item, long column) const
+{
+  const Message *message = MessageAt(item);
+  if (message == NULL)
+    return column == 0 ? wxString() : wxString::Format(_("%lu earlier messages discarded"), dropped);
+  return column == 0 ? message->label : message->text;
+}
+
+wxListItemAttr *MessagesView::OnGetItemAttr(long item) const
+{
+  const Message *message = MessageAt(item);
+  if (message == NULL) return &droppedAttr;
+  switch (message->kind) {
+  case ServerError:
+  case InternalError:
+    return &errorAttr;
+  case ServerNotice:
+    return &noticeAttr;
+  case Echo:
+    return &echoAttr;
+  case Notification:
+    return &notificationAttr;
+  case CommandCompleted:
+  default:
+    return &commandAttr;
+  }
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
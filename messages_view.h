@@ -0,0 +1,93 @@
+/**
+ * @file
+ * Display of messages produced while executing a script.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __messages_view_h
+#define __messages_view_h
+
+#include <vector>
+#include "wx/listctrl.h"
+
+/**
+ * Virtual list of script messages, retaining only the most recent ones.
+ *
+ * Messages are held in a ring buffer, and the list control only asks
+ * for the lines it is showing, so appending a message costs the same
+ * however many have gone before. Updating the control itself is
+ * deferred until idle time, so a flood of messages is shown in one
+ * repaint.
+ *
+ * Once the buffer is full, the oldest messages are discarded, and a
+ * line at the top of the list counts them.
+ */
+class MessagesView : public wxListCtrl {
+public:
+  /**
+   * Type of message, which determines how it is shown.
+   */
+  enum Kind {
+    CommandCompleted,
+    ServerError,
+    ServerNotice,
+    InternalError,
+    Echo,
+    Notification
+  };
+
+  /**
+   * Create view.
+   *
+   * @param capacity Maximum number of messages retained
+   */
+  MessagesView(wxWindow *parent, wxWindowID id, unsigned capacity);
+
+  /**
+   * Add a message.
+   *
+   * @param label Shown in the first column, e.g. the severity
+   * @param scriptPosition Position in the script the message relates to, or -1 for none
+   */
+  void Append(Kind kind, const wxString &label, const wxString &text, int scriptPosition = -1);
+
+  /**
+   * @return script position associated with a list item, or -1 for none
+   */
+  int GetScriptPosition(long item) const;
+
+protected:
+  wxString OnGetItemText(long item, long column) const;
+  wxListItemAttr *OnGetItemAttr(long item) const;
+
+private:
+  class Message {
+  public:
+    Kind kind;
+    wxString label;
+    wxString text;
+    int scriptPosition;
+  };
+
+  std::vector<Message> ring;
+  unsigned start;
+  unsigned count;
+  unsigned long dropped;
+  bool updatePending;
+
+  mutable wxListItemAttr commandAttr, errorAttr, noticeAttr, echoAttr, notificationAttr, droppedAttr;
+
+  const Message *MessageAt(long item) const;
+
+  void OnIdle(wxIdleEvent &event);
+  void OnSize(wxSizeEvent &event);
+
+  DECLARE_EVENT_TABLE()
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
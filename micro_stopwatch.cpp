@@ -0,0 +1,34 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#ifdef __WXMSW__
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "micro_stopwatch.h"
+
+wxLongLong MicroStopWatch::Now()
+{
+#ifdef __WXMSW__
+  static LARGE_INTEGER frequency;
+  if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return wxLongLong(counter.QuadPart / frequency.QuadPart * 1000000 + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return wxLongLong(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,35 @@
+/**
+ * @file
+ * Monotonic stopwatch with microsecond resolution.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __micro_stopwatch_h
+#define __micro_stopwatch_h
+
+#include "wx/longlong.h"
+
+/**
+ * Stopwatch measuring in microseconds, where wxStopWatch only measures milliseconds.
+ *
+ * This uses a monotonic clock, so timings aren't upset by the system clock being adjusted.
+ */
+class MicroStopWatch {
+public:
+  MicroStopWatch() { Start(); }
+  void Start() { start = Now(); }
+  /**
+   * @return microseconds since the stopwatch was started
+   */
+  wxLongLong Time() const { return Now() - start; }
+private:
+  wxLongLong start;
+  static wxLongLong Now();
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
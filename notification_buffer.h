@@ -0,0 +1,129 @@
+/**
+ * @file
+ * Buffer asynchronous notifications on their way to the UI.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __notification_buffer_h
+#define __notification_buffer_h
+
+#include <map>
+#include <vector>
+#include "wx/string.h"
+#include "wx/thread.h"
+
+/**
+ * Bounded buffer of asynchronous notifications.
+ *
+ * Notifications are pushed on whichever thread consumes connection
+ * input, and collected in batches on the UI thread. Only the first
+ * notification after a batch is collected asks for the consumer to be
+ * signalled, so a flood of notifications results in one event per
+ * batch rather than one per notification.
+ *
+ * Once the buffer is full, the oldest notifications are discarded,
+ * but are still counted against their channel.
+ */
+class NotificationBuffer {
+public:
+  /**
+   * One asynchronous notification.
+   */
+  class Notification {
+  public:
+    wxString channel;
+    wxString payload;
+  };
+
+  /**
+   * A batch of notifications collected from the buffer.
+   */
+  class Batch {
+  public:
+    Batch() : dropped(0) {}
+    /**
+     * Retained notifications, oldest first.
+     */
+    std::vector<Notification> notifications;
+    /**
+     * Number of notifications received on each channel, including those dropped.
+     */
+    std::map<wxString, unsigned long> channelCounts;
+    /**
+     * Number of notifications discarded because the buffer was full.
+     */
+    unsigned long dropped;
+  };
+
+  /**
+   * Create buffer.
+   *
+   * @param capacity Maximum number of notifications retained between batches
+   */
+  NotificationBuffer(unsigned capacity) : ring(capacity), start(0), count(0), dropped(0), deliveryPending(false) {}
+
+  /**
+   * Add a notification to the buffer.
+   *
+   * @return true if the consumer should be signalled to collect a batch
+   */
+  bool Push(const wxString &channel, const wxString &payload)
+  {
+    wxCriticalSectionLocker locker(guard);
+    unsigned capacity = ring.size();
+    Notification *slot;
+    if (count == capacity) {
+      slot = &ring[start];
+      start = (start + 1) % capacity;
+      ++dropped;
+    }
+    else {
+      slot = &ring[(start + count) % capacity];
+      ++count;
+    }
+    slot->channel = channel;
+    slot->payload = payload;
+    ++channelCounts[channel];
+    if (deliveryPending) return false;
+    deliveryPending = true;
+    return true;
+  }
+
+  /**
+   * Collect all the notifications buffered so far.
+   */
+  void Drain(Batch &batch)
+  {
+    wxCriticalSectionLocker locker(guard);
+    unsigned capacity = ring.size();
+    batch.notifications.resize(count);
+    for (unsigned i = 0; i < count; i++) {
+      Notification &slot = ring[(start + i) % capacity];
+      batch.notifications[i].channel.swap(slot.channel);
+      batch.notifications[i].payload.swap(slot.payload);
+    }
+    batch.channelCounts.swap(channelCounts);
+    channelCounts.clear();
+    batch.dropped = dropped;
+    start = 0;
+    count = 0;
+    dropped = 0;
+    deliveryPending = false;
+  }
+
+private:
+  std::vector<Notification> ring;
+  unsigned start;
+  unsigned count;
+  unsigned long dropped;
+  std::map<wxString, unsigned long> channelCounts;
+  bool deliveryPending;
+  wxCriticalSection guard;
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
@@ -8,6 +8,10 @@
 -- version that the connected server satisfies is taken. If there is
 -- an instance with no version as well, that is used as a fallback.
 
+-- A trailing ":: binary" on the introductory comment requests the
+-- results in binary format. This is only suitable for statements
+-- returning oids, integers, booleans and strings (text, name, char).
+
 -- SQL :: SetupObjectBrowserConnection
 SET search_path = pg_catalog
 
@@ -75,20 +79,20 @@ SELECT grosysid, groname, false, false,
        null AS description
 FROM pg_group
 
--- SQL :: Schemas
+-- SQL :: Schemas :: binary
 SELECT pg_namespace.oid, nspname,
        has_schema_privilege(pg_namespace.oid, 'USAGE') AS accessible
 FROM pg_namespace
 
--- SQL :: Extensions :: 9.1
+-- SQL :: Extensions :: 9.1 :: binary
 SELECT pg_extension.oid, extname
 FROM pg_extension
 
--- SQL :: Extensions
+-- SQL :: Extensions :: binary
 SELECT NULL::oid, NULL::text
 WHERE false
 
--- SQL :: Relations :: 9.1
+-- SQL :: Relations :: 9.1 :: binary
 SELECT relnamespace,
        pg_depend.refobjid AS extoid,
        pg_class.oid, relname, relkind,
@@ -112,7 +116,7 @@ FROM (SELECT oid, relname, relkind, relnamespace, relpersistence
                          AND pg_depend.objid = pg_class.oid
                          AND pg_depend.refclassid = 'pg_extension'::regclass
 
--- SQL :: Relations
+-- SQL :: Relations :: binary
 SELECT relnamespace,
        NULL,
        pg_class.oid, relname, relkind,
@@ -134,7 +138,7 @@ FROM (SELECT oid, relname, relkind, relnamespace
             ) AND has_schema_privilege(relnamespace, 'USAGE')
      ) pg_class
 
--- SQL :: Functions :: 9.1
+-- SQL :: Functions :: 9.1 :: binary
 SELECT pronamespace,
        pg_depend.refobjid AS extoid,
        pg_proc.oid, proname, pg_get_function_arguments(pg_proc.oid),
@@ -149,7 +153,7 @@ FROM pg_proc
                          AND pg_depend.refclassid = 'pg_extension'::regclass
 WHERE has_schema_privilege(pronamespace, 'USAGE')
 
--- SQL :: Functions :: 8.4
+-- SQL :: Functions :: 8.4 :: binary
 SELECT pronamespace,
        NULL,
        pg_proc.oid, proname, pg_get_function_arguments(pg_proc.oid),
@@ -161,7 +165,7 @@ SELECT pronamespace,
 FROM pg_proc
 WHERE has_schema_privilege(pronamespace, 'USAGE')
 
--- SQL :: Functions
+-- SQL :: Functions :: binary
 SELECT nspoid,
        NULL,
        oid, proname, substr(longname, position('(' in longname) + 1, length(longname) - position('(' in longname) - 1),
@@ -377,7 +381,7 @@ SELECT oprnamespace,
        oprleft, oprright, oprresult, oprkind
 FROM pg_operator
 
--- SQL :: IndexSchema :: 9.1
+-- SQL :: IndexSchema :: 9.1 :: binary
 SELECT x.objid,
        objtype || CASE WHEN nspname LIKE 'pg_%' OR nspname = 'information_schema' THEN 'S'
                        ELSE '' END,
@@ -496,7 +500,7 @@ FROM pg_namespace
 WHERE NOT (nspname LIKE 'pg_%' AND nspname <> 'pg_catalog')
 ORDER BY 1, 2, 3
 
--- SQL :: IndexSchema :: 8.4
+-- SQL :: IndexSchema :: 8.4 :: binary
 SELECT x.objid,
        objtype || CASE WHEN nspname LIKE 'pg_%' OR nspname = 'information_schema' THEN 'S'
                        ELSE '' END,
@@ -584,7 +588,7 @@ FROM pg_namespace
 WHERE NOT (nspname LIKE 'pg_%' AND nspname <> 'pg_catalog')
 ORDER BY 1, 2, 3
 
--- SQL :: IndexSchema :: 8.3
+-- SQL :: IndexSchema :: 8.3 :: binary
 SELECT x.objid,
        objtype || CASE WHEN nspname LIKE 'pg_%' OR nspname = 'information_schema' THEN 'S'
                        ELSE '' END,
@@ -636,7 +640,7 @@ FROM pg_namespace
 WHERE NOT (nspname LIKE 'pg_%' AND nspname <> 'pg_catalog')
 ORDER BY 1, 2, 3
 
--- SQL :: IndexSchema
+-- SQL :: IndexSchema :: binary
 SELECT x.objid,
        objtype || CASE WHEN nspname LIKE 'pg_%' OR nspname = 'information_schema' THEN 'S'
                        ELSE '' END,
@@ -36,6 +36,14 @@ public:
     severity = _T("ERROR");
     primary = wxString(PQerrorMessage(conn), wxConvUTF8);
   }
+  /**
+   * Create an error raised on the client side.
+   */
+  explicit PgError(const wxString &message)
+  {
+    severity = _T("ERROR");
+    primary = message;
+  }
 
   wxString GetPrimary() const { return primary; }
   wxString GetSeverity() const { return severity; }
@@ -48,6 +56,12 @@ public:
   int GetPosition() const { return position; }
   bool HasPosition() const { return position >= 0; }
 
+  /**
+   * Make the position relative to the statement, where the statement
+   * was sent after some other text.
+   */
+  void SkipPrefix(int length) { if (position > length) position -= length; }
+
 private:
   static wxString GetErrorField(const PGresult *rs, int fieldCode)
   {
@@ -7,6 +7,7 @@
 #endif
 
 #include "wx/cmdline.h"
+#include "wx/config.h"
 #include "wx/xrc/xmlres.h"
 #include "pqwx.h"
 #include "pqwx_frame.h"
@@ -30,6 +31,32 @@ DatabaseNotificationMonitor& PQWXApp::GetNotificationMonitor()
 }
 #endif
 
+#ifdef PQWX_DATABASE_REACTOR
+DatabaseReactor* PQWXApp::GetDatabaseReactor()
+{
+  static wxCriticalSection guard;
+  wxCriticalSectionLocker locker(guard);
+  if (!reactorConfigured) {
+    reactorConfigured = true;
+    wxConfigBase *cfg = wxConfig::Get();
+    bool enabled;
+    cfg->Read(_T("Database/AsynchronousEngine"), &enabled, false);
+    if (enabled) {
+      long helperThreads;
+      cfg->Read(_T("Database/BlockingWorkThreads"), &helperThreads, 4);
+      if (helperThreads < 1) helperThreads = 1;
+      reactor = new DatabaseReactor((unsigned) helperThreads);
+      // connections fall back to their own threads if the reactor can't run
+      if (!reactor->Start()) {
+        delete reactor;
+        reactor = NULL;
+      }
+    }
+  }
+  return reactor;
+}
+#endif
+
 IMPLEMENT_APP(PQWXApp)
 
 bool PQWXApp::OnInit()
@@ -88,6 +115,11 @@ int PQWXApp::OnExit()
   objectBrowserModel->Dispose();
   delete objectBrowserModel;
 
+#ifdef PQWX_DATABASE_REACTOR
+  // only once all the connections have been closed
+  if (reactor) delete reactor;
+#endif
+
   return rc;
 }
 
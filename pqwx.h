@@ -13,6 +13,7 @@
 #include "wx/app.h"
 #include "pg_tools_registry.h"
 #include "database_notification_monitor.h"
+#include "database_reactor.h"
 
 /*
  * controls and menu commands
@@ -29,6 +30,8 @@ enum {
   Pqwx_MessagesPage,
   Pqwx_MessagesDisplay,
   Pqwx_ObjectFinderResults,
+  Pqwx_StatusUpdateTimer,
+  Pqwx_NotificationTimer,
 };
 
 class ObjectBrowserModel;
@@ -40,11 +43,24 @@ class ObjectBrowserModel;
  */
 class PQWXApp : public wxApp {
 public:
+  PQWXApp() :
+#ifdef PQWX_NOTIFICATION_MONITOR
+    monitor(NULL),
+#endif
+#ifdef PQWX_DATABASE_REACTOR
+    reactor(NULL), reactorConfigured(false),
+#endif
+    objectBrowserModel(NULL) {}
 #ifdef PQWX_NOTIFICATION_MONITOR
-  PQWXApp() : monitor(NULL), objectBrowserModel(NULL) {}
   DatabaseNotificationMonitor& GetNotificationMonitor();
-#else
-  PQWXApp() : objectBrowserModel(NULL) {}
+#endif
+#ifdef PQWX_DATABASE_REACTOR
+  /**
+   * Get the reactor to drive database connections with.
+   *
+   * @return the reactor, or NULL if the asynchronous engine is not enabled
+   */
+  DatabaseReactor* GetDatabaseReactor();
 #endif
   ObjectBrowserModel& GetObjectBrowserModel() { return *objectBrowserModel; }
   PgToolsRegistry& GetToolsRegistry() { return toolsRegistry; }
@@ -57,6 +73,10 @@ private:
   std::vector<wxString> initialFiles;
 #ifdef PQWX_NOTIFICATION_MONITOR
   DatabaseNotificationMonitor *monitor;
+#endif
+#ifdef PQWX_DATABASE_REACTOR
+  DatabaseReactor *reactor;
+  bool reactorConfigured;
 #endif
   ObjectBrowserModel *objectBrowserModel;
   PgToolsRegistry toolsRegistry;
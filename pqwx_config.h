@@ -14,6 +14,12 @@
 
 #ifdef __linux__
 #define HAVE_EVENTFD 1
+#define HAVE_EPOLL 1
+#endif
+
+#if defined(HAVE_EPOLL) && defined(HAVE_EVENTFD)
+// drive database connections from a single thread instead of one thread each
+#define PQWX_DATABASE_REACTOR 1
 #endif
 
 #endif
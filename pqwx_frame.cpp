@@ -23,8 +23,12 @@
 #include "script_editor_pane.h"
 #include "static_resources.h"
 #include "preferences_dialogue.h"
+#include "benchmark_dialogue.h"
 
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptExecute)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptExecuteStatement)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptExecuteFile)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptBenchmarkStatement)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptDisconnect)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptReconnect)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptNew)
@@ -40,6 +44,12 @@ BEGIN_EVENT_TABLE(PqwxFrame, wxFrame)
   EVT_UPDATE_UI(XRCID("FindObject"), PqwxFrame::EnableIffHaveObjectBrowserDatabase)
   EVT_MENU(XRCID("ExecuteScript"), PqwxFrame::OnExecuteScript)
   EVT_UPDATE_UI(XRCID("ExecuteScript"), PqwxFrame::EnableIffScriptIdle)
+  EVT_MENU(XRCID("ExecuteStatement"), PqwxFrame::OnExecuteStatement)
+  EVT_UPDATE_UI(XRCID("ExecuteStatement"), PqwxFrame::EnableIffScriptIdle)
+  EVT_MENU(XRCID("ExecuteFile"), PqwxFrame::OnExecuteFile)
+  EVT_UPDATE_UI(XRCID("ExecuteFile"), PqwxFrame::EnableIffScriptIdle)
+  EVT_MENU(XRCID("BenchmarkStatement"), PqwxFrame::OnBenchmarkStatement)
+  EVT_UPDATE_UI(XRCID("BenchmarkStatement"), PqwxFrame::EnableIffScriptIdle)
   EVT_MENU(XRCID("DisconnectScript"), PqwxFrame::OnDisconnectScript)
   EVT_UPDATE_UI(XRCID("DisconnectScript"), PqwxFrame::EnableIffScriptConnected)
   EVT_MENU(XRCID("ReconnectScript"), PqwxFrame::OnReconnectScript)
@@ -315,6 +325,40 @@ void PqwxFrame::OnExecuteScript(wxCommandEvent& event)
   currentEditorTarget->ProcessEvent(cmd);
 }
 
+void PqwxFrame::OnExecuteStatement(wxCommandEvent& event)
+{
+  wxASSERT(currentEditorTarget != NULL);
+
+  wxCommandEvent cmd(PQWX_ScriptExecuteStatement);
+  currentEditorTarget->ProcessEvent(cmd);
+}
+
+void PqwxFrame::OnExecuteFile(wxCommandEvent& event)
+{
+  wxASSERT(currentEditorTarget != NULL);
+
+  wxFileDialog dbox(this, _("Execute File"), wxEmptyString, wxEmptyString,
+                    _("SQL files (*.sql)|*.sql|All files|*"));
+  dbox.CentreOnParent();
+  if (dbox.ShowModal() != wxID_OK) return;
+
+  wxCommandEvent cmd(PQWX_ScriptExecuteFile);
+  cmd.SetString(dbox.GetPath());
+  currentEditorTarget->ProcessEvent(cmd);
+}
+
+void PqwxFrame::OnBenchmarkStatement(wxCommandEvent& event)
+{
+  wxASSERT(currentEditorTarget != NULL);
+
+  BenchmarkDialogue dbox(this);
+  if (dbox.ShowModal() != wxID_OK) return;
+
+  wxCommandEvent cmd(PQWX_ScriptBenchmarkStatement);
+  cmd.SetString(dbox.GetCommand());
+  currentEditorTarget->ProcessEvent(cmd);
+}
+
 void PqwxFrame::OnDisconnectScript(wxCommandEvent &event) {
   wxASSERT(currentEditorTarget != NULL);
 
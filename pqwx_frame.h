@@ -63,6 +63,9 @@ private:
   void OnDisconnectObjectBrowser(wxCommandEvent& event);
   void OnFindObject(wxCommandEvent& event);
   void OnExecuteScript(wxCommandEvent& event);
+  void OnExecuteStatement(wxCommandEvent& event);
+  void OnExecuteFile(wxCommandEvent& event);
+  void OnBenchmarkStatement(wxCommandEvent& event);
   void OnDisconnectScript(wxCommandEvent& event);
   void OnReconnectScript(wxCommandEvent& event);
   void OnNewScript(wxCommandEvent& event);
@@ -7,9 +7,13 @@
 #define __query_results_h
 
 #include <vector>
+#include <stdlib.h>
 #include "libpq-fe.h"
 #include "wx/string.h"
+#include "wx/thread.h"
 #include "pg_error.h"
+#include "result_columns.h"
+#include "utf8_conversion.h"
 
 /**
  * Simple query result set representation.
@@ -17,9 +21,149 @@
  * This is a translation of a libpq result set to use wxStrings and
  * STL containers, for ease of use. It is mainly intended for the
  * object browser, which tends to return reasonably-sized result sets.
+ *
+ * The values themselves are held in one of three ways. They can be
+ * copied out of the libpq result into a single arena (see
+ * ResultColumns), so the libpq result can be cleared. Alternatively,
+ * the result set can retain the libpq result and refer to it
+ * directly, only converting values to wxStrings when they are
+ * read. This suits one-off queries whose values are read once and
+ * then discarded, where copying them first would be wasted work.
+ *
+ * Finally, the values can be decoded once into typed columns (see
+ * ResultColumns), so that reading OIDs, integers and booleans doesn't
+ * involve parsing strings. This suits the catalogue queries, which
+ * are mostly OIDs and flags read straight into the object model.
+ *
+ * In every case, rows are fixed-size views onto the shared values, so
+ * building or discarding a result set allocates nothing per row or
+ * per cell.
  */
 class QueryResults {
 public:
+  /**
+   * How values from the libpq result are stored.
+   */
+  enum Storage {
+    /**
+     * Copy all values into an arena; the libpq result is not retained.
+     */
+    CopyValues,
+    /**
+     * Take ownership of the libpq result, and convert values on demand.
+     */
+    RetainResult,
+    /**
+     * Decode values into typed columns; the libpq result is not retained.
+     */
+    Columnar
+  };
+
+  /**
+   * Reference-counted handle to a retained libpq result.
+   *
+   * The result is cleared when the last reference is dropped. The
+   * reference count is guarded, as result sets are created on
+   * database worker threads and read on the GUI thread.
+   *
+   * A borrowed handle doesn't hold a reference itself, and must not
+   * outlive the handle it was borrowed from. Copying or assigning a
+   * borrowed handle produces a proper reference.
+   */
+  class ResultRef {
+  public:
+    ResultRef() : holder(NULL), owned(false) {}
+    explicit ResultRef(PGresult *rs) : holder(new Holder(rs)), owned(true) {}
+    ResultRef(const ResultRef &other) : holder(other.holder), owned(holder != NULL) { if (holder) holder->Ref(); }
+    ~ResultRef() { if (owned) holder->Unref(); }
+    ResultRef& operator=(const ResultRef &other)
+    {
+      if (other.holder) other.holder->Ref();
+      if (owned) holder->Unref();
+      holder = other.holder;
+      owned = holder != NULL;
+      return *this;
+    }
+    /**
+     * Make this handle borrow another handle's reference.
+     */
+    void Borrow(const ResultRef &other)
+    {
+      if (owned) holder->Unref();
+      holder = other.holder;
+      owned = false;
+    }
+    /**
+     * @return the libpq result, or NULL if none is retained
+     */
+    const PGresult *Get() const { return holder ? holder->rs : NULL; }
+  private:
+    class Holder {
+    public:
+      Holder(PGresult *rs) : rs(rs), refs(1) {}
+      void Ref()
+      {
+        wxCriticalSectionLocker locker(guard);
+        ++refs;
+      }
+      void Unref()
+      {
+        bool last;
+        {
+          wxCriticalSectionLocker locker(guard);
+          last = --refs == 0;
+        }
+        if (last) {
+          PQclear(rs);
+          delete this;
+        }
+      }
+      PGresult * const rs;
+    private:
+      unsigned refs;
+      wxCriticalSection guard;
+    };
+    Holder *holder;
+    bool owned;
+  };
+
+  /**
+   * Reference-counted handle to a columnar value store.
+   *
+   * Borrowed handles behave as for ResultRef.
+   */
+  class ColumnsRef {
+  public:
+    ColumnsRef() : columns(NULL), owned(false) {}
+    explicit ColumnsRef(ResultColumns *columns) : columns(columns), owned(true) {}
+    ColumnsRef(const ColumnsRef &other) : columns(other.columns), owned(columns != NULL) { if (columns) columns->Ref(); }
+    ~ColumnsRef() { if (owned) columns->Unref(); }
+    ColumnsRef& operator=(const ColumnsRef &other)
+    {
+      if (other.columns) other.columns->Ref();
+      if (owned) columns->Unref();
+      columns = other.columns;
+      owned = columns != NULL;
+      return *this;
+    }
+    /**
+     * Make this handle borrow another handle's reference.
+     */
+    void Borrow(const ColumnsRef &other)
+    {
+      if (owned) columns->Unref();
+      columns = other.columns;
+      owned = false;
+    }
+    /**
+     * @return the value store, or NULL if none
+     */
+    const ResultColumns *Get() const { return columns; }
+  private:
+    ResultColumns *columns;
+    bool owned;
+  };
+
   /**
    * A field (column description) in the result set.
    */
@@ -29,7 +173,7 @@ public:
      * Create field for libpq result and column index.
      */
     Field(PGresult *rs, int index) {
-      name = wxString(PQfname(rs, index), wxConvUTF8);
+      name = Utf8ToWxString(PQfname(rs, index));
       table = PQftable(rs, index);
       if (table != InvalidOid) tableColumn = PQftablecol(rs, index);
       type = PQftype(rs, index);
@@ -56,64 +200,57 @@ public:
 
   /**
    * A result set row.
+   *
+   * The rows held by a result set borrow its values; a copy of a row
+   * keeps the values alive by itself, so it can outlive the result set.
    */
   class Row {
   public:
-    /**
-     * Create row from libpq result set and row number, with reference to owning result set.
-     * The parent result set is used to resolve fields by name.
-     */
-    Row(const PGresult *rs, const QueryResults *owner, int rowNum) : owner(owner) {
-      int colCount = PQnfields(rs);
-      data.reserve(colCount);
-      int nullsCapacity = (colCount + 63)/64;
-      nulls.reserve(nullsCapacity);
-      for (int i = 0; i < nullsCapacity; i++)
-        nulls.push_back(0);
-      for (int colNum = 0; colNum < colCount; colNum++) {
-        if (PQgetisnull(rs, rowNum, colNum) > 0) {
-          nulls[colNum / 64] |= 1 << (colNum % 64);
-          data.push_back(wxEmptyString);
-        }
-        else {
-          const char *value = PQgetvalue(rs, rowNum, colNum);
-          data.push_back(wxString(value, wxConvUTF8));
-        }
-      }
-    }
-
     /**
      * Tests if a field is null
      */
     bool IsNull(unsigned index) const
     {
-      return (nulls[index / 64] & (1 << (index % 64))) > 0;
+      if (IsColumnar()) return columns.Get()->IsNull(rowNum, index);
+      return PQgetisnull(result.Get(), rowNum, index) > 0;
     }
 
     /**
      * Get string value by field index.
      */
-    const wxString& operator[](unsigned index) const {
-      wxASSERT(index < data.size());
-      return data[index];
-    }
+    wxString operator[](unsigned index) const { return Value(index); }
     /**
      * Get string value by field name.
      */
-    const wxString& operator[](const wxString &fieldName) const { return data[owner->GetFieldNumber(fieldName)]; }
+    wxString operator[](const wxString &fieldName) const { return Value(FieldNumber(fieldName)); }
     /**
      * @return number of fields in row.
      */
-    unsigned size() const { return data.size(); }
+    unsigned size() const
+    {
+      if (IsColumnar()) return columns.Get()->ColumnCount();
+      return PQnfields(result.Get());
+    }
+
+    /**
+     * Get string value by field index.
+     * This is basically identical to operator[](unsigned)
+     */
+    wxString Value(unsigned index) const {
+      if (IsColumnar()) return columns.Get()->ReadText(rowNum, index);
+      return Utf8ToWxString(Raw(index), PQgetlength(result.Get(), rowNum, index));
+    }
 
     /**
      * Get OID value by field index.
      */
     Oid ReadOid(unsigned index) const {
-      wxASSERT(index < data.size());
+      if (IsColumnar()) return columns.Get()->ReadOid(rowNum, index);
       if (IsNull(index)) return InvalidOid;
-      long value;
-      wxCHECK(data[index].ToLong(&value), 0);
+      const char *raw = Raw(index);
+      char *end;
+      unsigned long value = strtoul(raw, &end, 10);
+      wxCHECK(end != raw && *end == '\0', 0);
       return value;
     }
 
@@ -121,33 +258,32 @@ public:
      * Get boolean value by field index.
      */
     bool ReadBool(unsigned index) const {
-      wxASSERT(index < data.size());
-      return data[index] == _T("t");
+      if (IsColumnar()) return columns.Get()->ReadBool(rowNum, index);
+      return Raw(index)[0] == 't';
     }
 
     /**
      * Get boolean value by field name.
      */
     bool ReadBool(const wxString& fieldName) const {
-      return data[owner->GetFieldNumber(fieldName)] == _T("t");
+      return ReadBool(FieldNumber(fieldName));
     }
 
     /**
      * Get string value by field index.
      * This is basically identical to operator[](unsigned)
      */
-    const wxString& ReadText(unsigned index) const {
-      wxASSERT(index < data.size());
-      return data[index];
-    }
+    wxString ReadText(unsigned index) const { return Value(index); }
 
     /**
      * Get int4 value by field index.
      */
     wxInt32 ReadInt4(unsigned index) const {
-      wxASSERT(index < data.size());
-      long value;
-      wxCHECK(data[index].ToLong(&value), (wxInt32)0);
+      if (IsColumnar()) return columns.Get()->ReadInt4(rowNum, index);
+      const char *raw = Raw(index);
+      char *end;
+      long value = strtol(raw, &end, 10);
+      wxCHECK(end != raw && *end == '\0', (wxInt32)0);
       return (wxInt32) value;
     }
 
@@ -155,23 +291,59 @@ public:
      * Get int8 value by field index.
      */
     wxInt64 ReadInt8(unsigned index) const {
-      wxASSERT(index < data.size());
-      long long value;
-      wxCHECK(data[index].ToLongLong(&value), (wxInt64)0);
+      if (IsColumnar()) return columns.Get()->ReadInt8(rowNum, index);
+      const char *raw = Raw(index);
+      char *end;
+      long long value = strtoll(raw, &end, 10);
+      wxCHECK(end != raw && *end == '\0', (wxInt64)0);
       return (wxInt64) value;
     }
 
   private:
-    std::vector<wxString> data;
-    std::vector<wxUint64> nulls;
-    const QueryResults *owner;
+    ResultRef result;
+    ColumnsRef columns;
+    int rowNum;
+
+    /*
+     * Rows held by the result set itself are created empty and then
+     * pointed at its values without taking a reference.
+     */
+    Row() : rowNum(0) {}
+
+    bool IsColumnar() const { return columns.Get() != NULL; }
+
+    int FieldNumber(const wxString &fieldName) const {
+      if (IsColumnar()) {
+        int index = columns.Get()->ColumnNumber(fieldName);
+        wxASSERT_MSG(index >= 0, fieldName);
+        return index;
+      }
+      // a row can outlive its result set, so look the name up in the libpq result
+      const PGresult *rs = result.Get();
+      int colCount = PQnfields(rs);
+      for (int index = 0; index < colCount; index++) {
+        if (Utf8ToWxString(PQfname(rs, index)) == fieldName) return index;
+      }
+      wxASSERT_MSG(false, fieldName);
+      return -1;
+    }
+
+    const char *Raw(unsigned index) const {
+      wxASSERT(index < (unsigned) PQnfields(result.Get()));
+      return PQgetvalue(result.Get(), rowNum, index);
+    }
+
+    friend class QueryResults;
   };
 
   /**
    * Create query results from libpq result.
+   *
+   * When copying values or decoding them into columns, the caller
+   * retains ownership of the libpq result. When retaining it,
+   * ownership passes to the query results.
    */
-  QueryResults(PGresult *rs) {
-    int rowCount = PQntuples(rs);
+  QueryResults(PGresult *rs, Storage storage = CopyValues) {
     int colCount = PQnfields(rs);
 
     fields.reserve(colCount);
@@ -179,10 +351,28 @@ public:
       fields.push_back(Field(rs, i));
     }
 
-    rows.reserve(rowCount);
-    for (int rowNum = 0; rowNum < rowCount; rowNum++) {
-      rows.push_back(Row(rs, this, rowNum));
-    }
+    if (storage == RetainResult)
+      result = ResultRef(rs);
+    else
+      columns = ColumnsRef(new ResultColumns(rs, storage == Columnar ? ResultColumns::Typed : ResultColumns::TextOnly));
+
+    PopulateRows(PQntuples(rs));
+  }
+
+  QueryResults(const QueryResults &other) : fields(other.fields), result(other.result), columns(other.columns)
+  {
+    PopulateRows(other.rows.size());
+  }
+
+  QueryResults& operator=(const QueryResults &other)
+  {
+    if (this == &other) return *this;
+    fields = other.fields;
+    result = other.result;
+    columns = other.columns;
+    rows.clear();
+    PopulateRows(other.rows.size());
+    return *this;
   }
 
   typedef std::vector<Row>::const_iterator rows_iterator;
@@ -225,6 +415,20 @@ public:
 private:
   std::vector<Row> rows;
   std::vector<Field> fields;
+  ResultRef result;
+  ColumnsRef columns;
+
+  void PopulateRows(unsigned rowCount)
+  {
+    rows.reserve(rowCount);
+    for (unsigned rowNum = 0; rowNum < rowCount; rowNum++) {
+      rows.push_back(Row());
+      Row &row = rows.back();
+      row.result.Borrow(result);
+      row.columns.Borrow(columns);
+      row.rowNum = rowNum;
+    }
+  }
 };
 
 /**
@@ -0,0 +1,460 @@
+/**
+ * @file
+ * Typed columnar storage for query results.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __result_columns_h
+#define __result_columns_h
+
+#include <vector>
+#include <map>
+#include <stdlib.h>
+#include <string.h>
+#include "libpq-fe.h"
+#include "wx/string.h"
+#include "wx/thread.h"
+#include "utf8_conversion.h"
+
+/**
+ * Query result values, decoded once per column into typed arrays.
+ *
+ * Each column is decoded according to its type when the store is
+ * created: OIDs, integers and booleans are parsed into vectors of
+ * native values, and everything else is copied into a single arena of
+ * UTF-8 text. Reading a value afterwards is simply indexing an
+ * array. The libpq result is not retained.
+ *
+ * Text columns are dictionary-encoded while they are ingested: each
+ * distinct value is stored in the arena once, and rows hold a small
+ * code into the column's dictionary. Status columns, schema names and
+ * the like repeat a handful of values across many rows, so this
+ * shrinks large result sets considerably. If a column turns out to
+ * have too many distinct values, it reverts to holding an arena offset
+ * for each row.
+ *
+ * Columns returned in binary format are decoded directly from network
+ * byte order. Only the types that are held natively, together with
+ * the string types (text, name, char etc) whose binary representation
+ * is simply the text, can be decoded from binary format.
+ *
+ * The store is reference-counted, so that rows can outlive the result
+ * set they were returned in.
+ */
+class ResultColumns {
+public:
+  /**
+   * How a column's values are held.
+   */
+  enum Kind { OidColumn, Int4Column, Int8Column, BoolColumn, TextColumn };
+
+  /**
+   * Whether to decode values by type.
+   */
+  enum Decoding {
+    /**
+     * Hold values natively where the column type allows.
+     */
+    Typed,
+    /**
+     * Hold all values as text.
+     */
+    TextOnly
+  };
+
+  /**
+   * Find a binary-format column whose values can't be decoded.
+   *
+   * Such a column would otherwise be held as its raw network bytes.
+   *
+   * @return index of the first such column, or -1 if every column can be decoded
+   */
+  static int FindUndecodableColumn(const PGresult *rs, Decoding decoding = Typed)
+  {
+    int colCount = PQnfields(rs);
+    for (int colNum = 0; colNum < colCount; colNum++) {
+      if (PQfformat(rs, colNum) == 0) continue;
+      Kind kind = decoding == Typed ? KindOfType(PQftype(rs, colNum)) : TextColumn;
+      if (kind == TextColumn && !IsBinaryText(PQftype(rs, colNum))) return colNum;
+    }
+    return -1;
+  }
+
+  /**
+   * Decode all the values in a libpq result. The caller retains ownership of the result.
+   *
+   * Binary-format columns must be decodable: see FindUndecodableColumn().
+   */
+  ResultColumns(const PGresult *rs, Decoding decoding = Typed) : rowCount(PQntuples(rs)), refs(1)
+  {
+    unsigned colCount = PQnfields(rs);
+    columns.resize(colCount);
+
+    size_t arenaSize = 1;
+    for (unsigned colNum = 0; colNum < colCount; colNum++) {
+      Column &column = columns[colNum];
+      column.name = Utf8ToWxString(PQfname(rs, colNum));
+      column.kind = decoding == Typed ? KindOfType(PQftype(rs, colNum)) : TextColumn;
+      column.binary = PQfformat(rs, colNum) != 0;
+      wxASSERT_MSG(!column.binary || column.kind != TextColumn || IsBinaryText(PQftype(rs, colNum)),
+                   wxString::Format(_T("Unable to decode binary value of type %u in column %u"), PQftype(rs, colNum), colNum));
+      if (column.kind == TextColumn) {
+        for (unsigned rowNum = 0; rowNum < rowCount; rowNum++)
+          arenaSize += PQgetlength(rs, rowNum, colNum) + 1;
+      }
+    }
+
+    // offset zero is the empty string, shared by all null text values
+    arena.reserve(arenaSize);
+    arena.push_back('\0');
+
+    for (unsigned colNum = 0; colNum < colCount; colNum++) {
+      Column &column = columns[colNum];
+      column.nulls.resize((rowCount + 63)/64, 0);
+      switch (column.kind) {
+      case OidColumn: column.oids.resize(rowCount, InvalidOid); break;
+      case Int4Column: column.int4s.resize(rowCount, 0); break;
+      case Int8Column: column.int8s.resize(rowCount, 0); break;
+      case BoolColumn: column.bools.resize(rowCount, false); break;
+      case TextColumn: column.codes.resize(rowCount, 0); column.encoded = true; break;
+      }
+      DictionaryIndex index((ArenaLess(arena)));
+
+      for (unsigned rowNum = 0; rowNum < rowCount; rowNum++) {
+        if (PQgetisnull(rs, rowNum, colNum) > 0) {
+          column.nulls[rowNum / 64] |= (wxUint64) 1 << (rowNum % 64);
+          continue;
+        }
+        const char *value = PQgetvalue(rs, rowNum, colNum);
+        if (column.binary && column.kind != TextColumn) {
+          DecodeBinary(column, rowNum, value, PQgetlength(rs, rowNum, colNum));
+          continue;
+        }
+        switch (column.kind) {
+        case OidColumn:
+          column.oids[rowNum] = strtoul(value, NULL, 10);
+          break;
+        case Int4Column:
+          column.int4s[rowNum] = (wxInt32) strtol(value, NULL, 10);
+          break;
+        case Int8Column:
+          column.int8s[rowNum] = (wxInt64) strtoll(value, NULL, 10);
+          break;
+        case BoolColumn:
+          column.bools[rowNum] = value[0] == 't';
+          break;
+        case TextColumn:
+          AddText(column, index, rowNum, value, PQgetlength(rs, rowNum, colNum));
+          break;
+        }
+      }
+    }
+
+    // give back the space reserved for values that turned out to be repeats
+    if (arena.size() < arena.capacity() / 2)
+      std::vector<char>(arena).swap(arena);
+  }
+
+  /**
+   * @return number of rows
+   */
+  unsigned RowCount() const { return rowCount; }
+  /**
+   * @return number of columns
+   */
+  unsigned ColumnCount() const { return columns.size(); }
+  /**
+   * @return name of a column
+   */
+  const wxString& ColumnName(unsigned colNum) const { return columns[colNum].name; }
+  /**
+   * @return how a column's values are held
+   */
+  Kind ColumnKind(unsigned colNum) const { return columns[colNum].kind; }
+
+  /**
+   * Convert column name to number.
+   * @return column number, or -1 if there is no such column
+   */
+  int ColumnNumber(const wxString &name) const
+  {
+    for (unsigned colNum = 0; colNum < columns.size(); colNum++) {
+      if (columns[colNum].name == name) return colNum;
+    }
+    return -1;
+  }
+
+  /**
+   * Tests if a value is null.
+   */
+  bool IsNull(unsigned rowNum, unsigned colNum) const
+  {
+    wxASSERT(colNum < columns.size() && rowNum < rowCount);
+    return (columns[colNum].nulls[rowNum / 64] & ((wxUint64) 1 << (rowNum % 64))) != 0;
+  }
+
+  /**
+   * Get OID value. Null values are returned as InvalidOid.
+   */
+  Oid ReadOid(unsigned rowNum, unsigned colNum) const
+  {
+    const Column &column = columns[colNum];
+    switch (column.kind) {
+    case OidColumn: return column.oids[rowNum];
+    case Int4Column: return (Oid) column.int4s[rowNum];
+    case Int8Column: return (Oid) column.int8s[rowNum];
+    default:
+      if (IsNull(rowNum, colNum)) return InvalidOid;
+      return strtoul(Text(rowNum, colNum), NULL, 10);
+    }
+  }
+
+  /**
+   * Get int4 value. Null values are returned as zero.
+   */
+  wxInt32 ReadInt4(unsigned rowNum, unsigned colNum) const
+  {
+    const Column &column = columns[colNum];
+    switch (column.kind) {
+    case Int4Column: return column.int4s[rowNum];
+    case OidColumn: return (wxInt32) column.oids[rowNum];
+    case Int8Column: return (wxInt32) column.int8s[rowNum];
+    default: return (wxInt32) strtol(Text(rowNum, colNum), NULL, 10);
+    }
+  }
+
+  /**
+   * Get int8 value. Null values are returned as zero.
+   */
+  wxInt64 ReadInt8(unsigned rowNum, unsigned colNum) const
+  {
+    const Column &column = columns[colNum];
+    switch (column.kind) {
+    case Int8Column: return column.int8s[rowNum];
+    case Int4Column: return column.int4s[rowNum];
+    case OidColumn: return column.oids[rowNum];
+    default: return (wxInt64) strtoll(Text(rowNum, colNum), NULL, 10);
+    }
+  }
+
+  /**
+   * Get boolean value. Null values are returned as false.
+   */
+  bool ReadBool(unsigned rowNum, unsigned colNum) const
+  {
+    const Column &column = columns[colNum];
+    if (column.kind == BoolColumn) return column.bools[rowNum];
+    return Text(rowNum, colNum)[0] == 't';
+  }
+
+  /**
+   * Get value as a string, formatting it from its native type if necessary.
+   */
+  wxString ReadText(unsigned rowNum, unsigned colNum) const
+  {
+    if (IsNull(rowNum, colNum)) return wxEmptyString;
+    const Column &column = columns[colNum];
+    switch (column.kind) {
+    case OidColumn: return wxString::Format(_T("%u"), column.oids[rowNum]);
+    case Int4Column: return wxString::Format(_T("%d"), column.int4s[rowNum]);
+    case Int8Column: return wxString::Format(_T("%") wxLongLongFmtSpec _T("d"), column.int8s[rowNum]);
+    case BoolColumn: return column.bools[rowNum] ? _T("t") : _T("f");
+    default: return Utf8ToWxString(Text(rowNum, colNum));
+    }
+  }
+
+  /**
+   * Get the raw UTF-8 text of a text column. Null values are returned as an empty string.
+   */
+  const char *Text(unsigned rowNum, unsigned colNum) const
+  {
+    const Column &column = columns[colNum];
+    if (column.kind != TextColumn || IsNull(rowNum, colNum)) return "";
+    if (column.encoded) return &arena[column.dictionary[column.codes[rowNum]]];
+    return &arena[column.offsets[rowNum]];
+  }
+
+  /**
+   * @return true if a text column is dictionary-encoded
+   */
+  bool IsEncoded(unsigned colNum) const { return columns[colNum].encoded; }
+
+  /**
+   * Add a reference to the store.
+   */
+  void Ref()
+  {
+    wxCriticalSectionLocker locker(guard);
+    ++refs;
+  }
+
+  /**
+   * Drop a reference to the store, deleting it when the last reference is dropped.
+   */
+  void Unref()
+  {
+    bool last;
+    {
+      wxCriticalSectionLocker locker(guard);
+      last = --refs == 0;
+    }
+    if (last) delete this;
+  }
+
+  /**
+   * Choose how to hold values of a given type.
+   */
+  static Kind KindOfType(Oid type)
+  {
+    switch (type) {
+    case 26: /* oid */ return OidColumn;
+    case 21: /* int2 */
+    case 23: /* int4 */ return Int4Column;
+    case 20: /* int8 */ return Int8Column;
+    case 16: /* bool */ return BoolColumn;
+    default: return TextColumn;
+    }
+  }
+
+  /**
+   * Most distinct values a text column can hold and still be dictionary-encoded.
+   */
+  static const unsigned MaxDictionarySize = 4096;
+
+  /**
+   * @return true if the binary representation of a type is the same as its text
+   */
+  static bool IsBinaryText(Oid type)
+  {
+    switch (type) {
+    case 18: /* char */
+    case 19: /* name */
+    case 25: /* text */
+    case 705: /* unknown */
+    case 1042: /* bpchar */
+    case 1043: /* varchar */
+      return true;
+    default:
+      return false;
+    }
+  }
+
+private:
+  class Column {
+  public:
+    Column() : encoded(false) {}
+    wxString name;
+    Kind kind;
+    bool binary;
+    bool encoded;
+    std::vector<wxUint64> nulls;
+    std::vector<Oid> oids;
+    std::vector<wxInt32> int4s;
+    std::vector<wxInt64> int8s;
+    std::vector<bool> bools;
+    std::vector<size_t> offsets;
+    std::vector<wxUint16> codes;
+    std::vector<size_t> dictionary;
+  };
+
+  /**
+   * Orders arena offsets by the strings stored at them.
+   */
+  class ArenaLess {
+  public:
+    ArenaLess(const std::vector<char> &arena) : arena(&arena) {}
+    bool operator()(size_t left, size_t right) const { return strcmp(&(*arena)[left], &(*arena)[right]) < 0; }
+  private:
+    const std::vector<char> *arena;
+  };
+  typedef std::map<size_t, wxUint16, ArenaLess> DictionaryIndex;
+
+  void AddText(Column &column, DictionaryIndex &index, unsigned rowNum, const char *value, int length)
+  {
+    size_t offset = arena.size();
+    arena.insert(arena.end(), value, value + length + 1);
+    if (!column.encoded) {
+      column.offsets[rowNum] = offset;
+      return;
+    }
+
+    DictionaryIndex::const_iterator existing = index.find(offset);
+    if (existing != index.end()) {
+      arena.resize(offset);
+      column.codes[rowNum] = existing->second;
+      return;
+    }
+
+    if (column.dictionary.size() < MaxDictionarySize) {
+      wxUint16 code = column.dictionary.size();
+      column.dictionary.push_back(offset);
+      index.insert(std::make_pair(offset, code));
+      column.codes[rowNum] = code;
+      return;
+    }
+
+    // too many distinct values: switch the column to holding an offset per row
+    column.offsets.resize(rowCount, 0);
+    for (unsigned prevRow = 0; prevRow < rowNum; prevRow++) {
+      if (!(column.nulls[prevRow / 64] & ((wxUint64) 1 << (prevRow % 64))))
+        column.offsets[prevRow] = column.dictionary[column.codes[prevRow]];
+    }
+    column.offsets[rowNum] = offset;
+    std::vector<wxUint16>().swap(column.codes);
+    std::vector<size_t>().swap(column.dictionary);
+    index.clear();
+    column.encoded = false;
+  }
+
+  std::vector<Column> columns;
+  std::vector<char> arena;
+  const unsigned rowCount;
+  unsigned refs;
+  wxCriticalSection guard;
+
+  static wxUint32 NetworkInt4(const char *value)
+  {
+    const unsigned char *bytes = (const unsigned char *) value;
+    return ((wxUint32) bytes[0] << 24) | ((wxUint32) bytes[1] << 16) | ((wxUint32) bytes[2] << 8) | (wxUint32) bytes[3];
+  }
+
+  static void DecodeBinary(Column &column, unsigned rowNum, const char *value, int length)
+  {
+    const unsigned char *bytes = (const unsigned char *) value;
+    switch (column.kind) {
+    case OidColumn:
+      wxCHECK_RET(length == 4, _T("bad binary oid length"));
+      column.oids[rowNum] = NetworkInt4(value);
+      break;
+    case Int4Column:
+      if (length == 2) {
+        column.int4s[rowNum] = (wxInt16) (((wxUint16) bytes[0] << 8) | bytes[1]);
+        break;
+      }
+      wxCHECK_RET(length == 4, _T("bad binary int4 length"));
+      column.int4s[rowNum] = (wxInt32) NetworkInt4(value);
+      break;
+    case Int8Column:
+      wxCHECK_RET(length == 8, _T("bad binary int8 length"));
+      column.int8s[rowNum] = (wxInt64) (((wxUint64) NetworkInt4(value) << 32) | NetworkInt4(value + 4));
+      break;
+    case BoolColumn:
+      wxCHECK_RET(length == 1, _T("bad binary bool length"));
+      column.bools[rowNum] = bytes[0] != 0;
+      break;
+    case TextColumn:
+      break;
+    }
+  }
+
+  ~ResultColumns() {}
+  ResultColumns(const ResultColumns&);
+  ResultColumns& operator=(const ResultColumns&);
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
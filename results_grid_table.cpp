@@ -0,0 +1,75 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#include <algorithm>
+#include "results_grid_table.h"
+#include "script_events.h"
+
+void ResultsGridTable::AppendBatch(std::auto_ptr<QueryResults> data)
+{
+  wxASSERT(data->Fields().size() == fields.size());
+  unsigned added = data->Rows().size();
+  if (added == 0) return;
+
+  batchStarts.push_back(rowCount);
+  batches.push_back(data.release());
+  rowCount += added;
+  fetchRequested = false;
+
+  if (GetView() != NULL) {
+    wxGridTableMessage message(this, wxGRIDTABLE_NOTIFY_ROWS_APPENDED, added);
+    GetView()->ProcessTableMessage(message);
+  }
+}
+
+const QueryResults::Row& ResultsGridTable::GetRow(int row) const
+{
+  wxASSERT(row >= 0 && (unsigned) row < rowCount);
+  // batches are in row order, so find the last one starting at or before this row
+  std::vector<unsigned>::const_iterator start = std::upper_bound(batchStarts.begin(), batchStarts.end(), (unsigned) row) - 1;
+  const QueryResults *batch = batches[start - batchStarts.begin()];
+  return batch->Rows()[row - *start];
+}
+
+void ResultsGridTable::RowWanted(int row)
+{
+  if (fetchHandler == NULL || fetchRequested || (unsigned) row + FetchAhead < rowCount) return;
+  fetchRequested = true;
+  wxCommandEvent event(PQWX_ScriptFetchRows);
+  fetchHandler->AddPendingEvent(event);
+}
+
+void ResultsGridTable::SizeColumns(wxGrid *grid, unsigned sampleSize, int maxWidth)
+{
+  const int margin = 10;
+  wxFont labelFont = grid->GetLabelFont();
+  wxFont cellFont = grid->GetDefaultCellFont();
+  unsigned stride = rowCount > sampleSize ? rowCount / sampleSize : 1;
+
+  for (unsigned col = 0; col < fields.size(); col++) {
+    int width, height;
+    grid->GetTextExtent(fields[col].GetName(), &width, &height, NULL, NULL, &labelFont);
+    for (unsigned row = 0; row < rowCount && width < maxWidth; row += stride) {
+      int valueWidth;
+      // reading the sample shouldn't ask for more rows
+      grid->GetTextExtent(GetRow(row).Value(col), &valueWidth, &height, NULL, NULL, &cellFont);
+      if (valueWidth > width) width = valueWidth;
+    }
+    grid->SetColSize(col, std::min(width + margin, maxWidth));
+  }
+
+  // leave room for the largest row number
+  int labelWidth, labelHeight;
+  grid->GetTextExtent(wxString::Format(_T("%u"), rowCount), &labelWidth, &labelHeight, NULL, NULL, &labelFont);
+  grid->SetRowLabelSize(std::max(labelWidth + margin, grid->GetDefaultRowLabelSize()));
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
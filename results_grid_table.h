@@ -0,0 +1,99 @@
+/**
+ * @file
+ * Grid table presenting query results to a wxGrid without copying them.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __results_grid_table_h
+#define __results_grid_table_h
+
+#include <vector>
+#include <memory>
+#include "wx/grid.h"
+#include "query_results.h"
+
+/**
+ * Grid table that reads cells directly from query results.
+ *
+ * wxGrid's default string table would hold a copy of every cell as a
+ * wxString; this table instead holds on to the result sets themselves,
+ * and converts only the cells the grid actually paints. A result set can be built up from several batches of rows,
+ * as they are streamed from the server.
+ *
+ * For a result set read from a cursor a page at a time, the table
+ * asks for the next page when the grid paints a cell near the end of
+ * the rows it has, so only as much of the result set as is looked at
+ * is fetched.
+ */
+class ResultsGridTable : public wxGridTableBase {
+public:
+  /**
+   * Create table, with columns described by the fields of the given result set.
+   * No rows are added.
+   */
+  ResultsGridTable(const QueryResults &data) : fields(data.Fields()), rowCount(0), fetchHandler(NULL), fetchRequested(false) {}
+  ~ResultsGridTable()
+  {
+    for (std::vector<QueryResults*>::iterator iter = batches.begin(); iter != batches.end(); iter++)
+      delete *iter;
+  }
+
+  /**
+   * Add rows from a result set, taking ownership of it.
+   *
+   * The result set must have the same fields as the one the table
+   * was created with. If the table is attached to a grid, the grid is
+   * told about the new rows.
+   */
+  void AppendBatch(std::auto_ptr<QueryResults> data);
+
+  /**
+   * Ask for more rows as the grid nears the end of the table.
+   *
+   * @param handler Sent a PQWX_ScriptFetchRows event when more rows
+   * are wanted: this is not repeated until another batch is appended.
+   */
+  void FetchMoreRows(wxEvtHandler *handler) { fetchHandler = handler; fetchRequested = false; }
+  /**
+   * Stop asking for more rows.
+   */
+  void NoMoreRows() { fetchHandler = NULL; }
+
+  int GetNumberRows() { return rowCount; }
+  int GetNumberCols() { return fields.size(); }
+  bool IsEmptyCell(int row, int col) { return GetRow(row).IsNull(col); }
+  wxString GetValue(int row, int col) { RowWanted(row); return GetRow(row).Value(col); }
+  void SetValue(int row, int col, const wxString &value) {}
+  wxString GetColLabelValue(int col) { return fields[col].GetName(); }
+
+  /**
+   * Size the grid's columns to fit their labels and a sample of the values.
+   *
+   * Up to sampleSize rows are measured, spread evenly across the
+   * table. Columns are never sized wider than maxWidth.
+   */
+  void SizeColumns(wxGrid *grid, unsigned sampleSize = 100, int maxWidth = 400);
+
+private:
+  std::vector<QueryResults::Field> fields;
+  std::vector<QueryResults*> batches;
+  std::vector<unsigned> batchStarts;
+  unsigned rowCount;
+  wxEvtHandler *fetchHandler;
+  bool fetchRequested;
+
+  /**
+   * Rows from the end of the table at which the next page is asked for.
+   */
+  static const unsigned FetchAhead = 200;
+
+  const QueryResults::Row& GetRow(int row) const;
+  void RowWanted(int row);
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
@@ -9,27 +9,33 @@
 #include "wx/grid.h"
 #include "wx/tokenzr.h"
 #include "wx/wupdlock.h"
-#include "wx/html/htmlwin.h"
+#include "wx/config.h"
 #include "pqwx.h"
 #include "results_notebook.h"
+#include "results_grid_table.h"
 #include "pg_error.h"
 
 BEGIN_EVENT_TABLE(ResultsNotebook, wxNotebook)
-  EVT_HTML_CELL_CLICKED(Pqwx_MessagesDisplay, ResultsNotebook::OnMessageClicked)
+  EVT_LIST_ITEM_ACTIVATED(Pqwx_MessagesDisplay, ResultsNotebook::OnMessageActivated)
+  EVT_NOTEBOOK_PAGE_CHANGED(wxID_ANY, ResultsNotebook::OnPageChanged)
 END_EVENT_TABLE()
 
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptShowPosition)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptFetchRows)
 
 void ResultsNotebook::Setup()
 {
   addedResultSet = false;
   addedError = false;
+  streamingPage = -1;
+  pagingPage = -1;
 
   messagesPanel = new wxPanel(this, Pqwx_MessagesPage);
   AddPage(messagesPanel, _("&Messages"), true);
 
-  messagesDisplay = new wxHtmlWindow(messagesPanel, Pqwx_MessagesDisplay);
-  messagesDisplay->SetFonts(wxNORMAL_FONT->GetFaceName(), wxNORMAL_FONT->GetFaceName());
+  long messageLimit;
+  wxConfig::Get()->Read(_T("Results/MessageLimit"), &messageLimit, (long) DefaultMessageLimit);
+  messagesDisplay = new MessagesView(messagesPanel, Pqwx_MessagesDisplay, messageLimit > 0 ? messageLimit : DefaultMessageLimit);
 
   wxSizer *displaySizer = new wxBoxSizer(wxVERTICAL);
   displaySizer->Add(messagesDisplay, 1, wxEXPAND);
@@ -38,176 +44,231 @@ void ResultsNotebook::Setup()
 
 void ResultsNotebook::ScriptCommandCompleted(const wxString& statusTag, unsigned scriptPosition)
 {
-  messagesDisplay->AppendToPage(_T("<font color='#000000'>") + statusTag + _T("</font><br>"));
+  messagesDisplay->Append(MessagesView::CommandCompleted, wxEmptyString, statusTag, scriptPosition);
 }
 
-void ResultsNotebook::ScriptResultSet(const wxString& statusTag, const QueryResults& data, unsigned scriptPosition)
+void ResultsNotebook::ScriptResultSet(const wxString& statusTag, std::auto_ptr<QueryResults> data, unsigned scriptPosition)
 {
   wxWindowUpdateLocker noUpdates(this);
 
-  wxPanel *resultsPanel = new wxPanel(this, wxID_ANY);
-  AddPage(resultsPanel, _("&Results"), !addedResultSet && !addedError);
-  wxSizer *resultsSizer = new wxBoxSizer(wxVERTICAL);
-  resultsPanel->SetSizer(resultsSizer);
-  AddResultSet(resultsPanel, data);
+  AddResultsPage(data);
 
-  addedResultSet = true;
+  ScriptCommandCompleted(statusTag, scriptPosition);
+}
+
+void ResultsNotebook::ScriptResultSetRows(std::auto_ptr<QueryResults> data, unsigned scriptPosition)
+{
+  wxWindowUpdateLocker noUpdates(this);
+
+  if (streamingPage < 0) {
+    streamingPage = AddResultsPage(data);
+    return;
+  }
+
+  AppendRows(streamingPage, data);
+}
+
+void ResultsNotebook::AppendRows(unsigned index, std::auto_ptr<QueryResults> data)
+{
+  ResultsPage &page = resultsPages[index];
+  // keep refining the column sizes until there are enough rows to make a fair sample
+  bool resize = page.table->GetNumberRows() < (int) ColumnSizeSample;
+  page.table->AppendBatch(data);
+  if (resize && page.grid != NULL)
+    page.table->SizeColumns(page.grid, ColumnSizeSample);
+}
+
+void ResultsNotebook::ScriptResultSetFinished(const wxString &statusTag, unsigned long discardedRows, unsigned scriptPosition)
+{
+  streamingPage = -1;
+
+  if (discardedRows > 0)
+    messagesDisplay->Append(MessagesView::Echo, wxEmptyString, wxString::Format(_("%lu rows not retrieved: row limit reached"), discardedRows), scriptPosition);
+
+  if (!statusTag.empty())
+    ScriptCommandCompleted(statusTag, scriptPosition);
+}
+
+void ResultsNotebook::ScriptPagedResultSet(const wxString &statusTag, std::auto_ptr<QueryResults> data, unsigned scriptPosition)
+{
+  wxWindowUpdateLocker noUpdates(this);
+
+  pagingPage = AddResultsPage(data);
+  // the event propagates up to the script editor, which owns the cursor
+  resultsPages[pagingPage].table->FetchMoreRows(this);
 
   ScriptCommandCompleted(statusTag, scriptPosition);
 }
 
-void ResultsNotebook::ScriptError(const PgError& error, unsigned scriptPosition)
+void ResultsNotebook::ScriptPagedRows(std::auto_ptr<QueryResults> data)
 {
+  if (pagingPage < 0) return;
+
   wxWindowUpdateLocker noUpdates(this);
+  AppendRows(pagingPage, data);
+}
+
+void ResultsNotebook::ScriptPagingFinished()
+{
+  if (pagingPage < 0) return;
 
+  resultsPages[pagingPage].table->NoMoreRows();
+  pagingPage = -1;
+}
+
+void ResultsNotebook::ScriptError(const PgError& error, unsigned scriptPosition)
+{
   unsigned linkTarget = scriptPosition;
-  if (error.HasPosition()) linkTarget += error.GetPosition();
-  messagesDisplay->AppendToPage(wxString::Format(_T("<a href='#%u'>"), linkTarget));
-  AppendServerMessage(error, _T("#ff0000"), true);
-  messagesDisplay->AppendToPage(_T("</a>"));
+  if (error.HasPosition() && scriptPosition != NoScriptPosition) linkTarget += error.GetPosition();
+  AppendServerMessage(MessagesView::ServerError, error, linkTarget);
   addedError = true;
   SetSelection(0);
 }
 
 void ResultsNotebook::ScriptInternalError(const wxString& error, unsigned scriptPosition)
 {
-  messagesDisplay->AppendToPage(_T("<font color='#ff0000'><b>") + error + _T("</b></font><br>"));
+  messagesDisplay->Append(MessagesView::InternalError, _("ERROR"), error, scriptPosition);
   addedError = true;
   SetSelection(0);
 }
 
 void ResultsNotebook::ScriptEcho(const wxString& message, unsigned scriptPosition)
 {
-  messagesDisplay->AppendToPage(_T("<font color='#000088'>") + message + _T("</font><br>"));
+  messagesDisplay->Append(MessagesView::Echo, wxEmptyString, message, scriptPosition);
 }
 
 void ResultsNotebook::ScriptQueryNotice(const PgError& notice, unsigned scriptPosition)
 {
-  wxWindowUpdateLocker noUpdates(this);
-  AppendServerMessage(notice, _T("#0000ff"));
+  AppendServerMessage(MessagesView::ServerNotice, notice, scriptPosition);
 }
 
 void ResultsNotebook::ScriptAsynchronousNotice(const PgError& notice)
 {
-  wxWindowUpdateLocker noUpdates(this);
-  AppendServerMessage(notice, _T("#0000ff"));
+  AppendServerMessage(MessagesView::ServerNotice, notice);
 }
 
-void ResultsNotebook::ScriptAsynchronousNotification(const wxString& notification)
+void ResultsNotebook::ScriptAsynchronousNotifications(const NotificationBuffer::Batch &batch)
 {
-  messagesDisplay->AppendToPage(_T("<font color='#0000ff'><b>") + notification + _T("</b></font><br>"));
+  if (batch.dropped > 0) {
+    wxString counts;
+    for (std::map<wxString, unsigned long>::const_iterator iter = batch.channelCounts.begin(); iter != batch.channelCounts.end(); iter++) {
+      if (iter != batch.channelCounts.begin()) counts << _T(", ");
+      counts << wxString::Format(_("%s: %lu received"), iter->first.c_str(), iter->second);
+    }
+    messagesDisplay->Append(MessagesView::Notification, _("NOTIFY"), wxString::Format(_("%lu notifications not shown"), batch.dropped) + _T(" (") + counts + _T(")"));
+  }
+  for (std::vector<NotificationBuffer::Notification>::const_iterator iter = batch.notifications.begin(); iter != batch.notifications.end(); iter++) {
+    wxString text = (*iter).channel;
+    if (!(*iter).payload.empty())
+      text << _T(" ") << (*iter).payload;
+    messagesDisplay->Append(MessagesView::Notification, _("NOTIFY"), text);
+  }
   SetSelection(0);
 }
 
-void ResultsNotebook::AppendServerMessage(const PgError& message, const wxString &colour, bool bold)
+void ResultsNotebook::AppendServerMessage(MessagesView::Kind kind, const PgError& message, int scriptPosition)
 {
-  messagesDisplay->AppendToPage(_T("<font color='") + colour + _T("'>"));
-  if (bold) messagesDisplay->AppendToPage(_T("<b>"));
-  messagesDisplay->AppendToPage(wxString::Format(_T("%s: %s<br>"), message.GetSeverity().c_str(), message.GetPrimary().c_str()));
+  messagesDisplay->Append(kind, message.GetSeverity(), message.GetPrimary(), scriptPosition);
   if (message.HasDetail()) {
-    messagesDisplay->AppendToPage(wxString::Format(_T("%s: %s<br>"), _("DETAIL"), message.GetDetail().c_str()));
+    messagesDisplay->Append(kind, _("DETAIL"), message.GetDetail(), scriptPosition);
   }
   if (message.HasHint()) {
-    messagesDisplay->AppendToPage(wxString::Format(_T("%s: %s<br>"), _("HINT"), message.GetHint().c_str()));
+    messagesDisplay->Append(kind, _("HINT"), message.GetHint(), scriptPosition);
   }
   if (message.HasContext()) {
-    messagesDisplay->AppendToPage(wxString::Format(_T("%s:<br>"), _("CONTEXT")));
-    messagesDisplay->AppendToPage(_T("<ul>"));
     for (std::vector<wxString>::const_iterator iter = message.GetContext().begin(); iter != message.GetContext().end(); iter++) {
-      messagesDisplay->AppendToPage(wxString::Format(_T("<li>%s</li>"), (*iter).c_str()));
+      messagesDisplay->Append(kind, _("CONTEXT"), *iter, scriptPosition);
     }
-    messagesDisplay->AppendToPage(_T("</ul>"));
   }
-  if (bold) messagesDisplay->AppendToPage(_T("</b>"));
-  messagesDisplay->AppendToPage(_T("</font>"));
 }
 
-void ResultsNotebook::OnMessageClicked(wxHtmlCellEvent &event)
+void ResultsNotebook::OnMessageActivated(wxListEvent &event)
 {
-  wxHtmlLinkInfo *info = event.GetCell()->GetLink();
-
-  if (info == NULL) return;
-
-  long position;
-  wxCHECK2_MSG(info->GetHref().Mid(1).ToLong(&position), , info->GetHref());
-
-  event.SetLinkClicked(true);
+  int position = messagesDisplay->GetScriptPosition(event.GetIndex());
+  if (position < 0) return;
 
   wxCommandEvent cmd(PQWX_ScriptShowPosition);
-  cmd.SetInt((int) position);
+  cmd.SetInt(position);
   ProcessEvent(cmd);
 }
 
-void ResultsNotebook::AddResultSet(wxPanel *parent, const QueryResults &data)
+unsigned ResultsNotebook::AddResultsPage(std::auto_ptr<QueryResults> data)
 {
-  wxGrid *grid = new wxGrid(parent, wxID_ANY);
+  wxPanel *resultsPanel = new wxPanel(this, wxID_ANY);
+  wxSizer *resultsSizer = new wxBoxSizer(wxVERTICAL);
+  resultsPanel->SetSizer(resultsSizer);
 
-  const unsigned maxRowsForAutoSize = 500;
-  unsigned firstChunkSize = data.Rows().size() > maxRowsForAutoSize ? maxRowsForAutoSize : data.Rows().size();
-  grid->CreateGrid(firstChunkSize, data.Fields().size());
-  grid->BeginBatch();
+  ResultsGridTable *table = new ResultsGridTable(*data);
+  table->AppendBatch(data);
 
-  unsigned columnIndex = 0;
-  for (QueryResults::fields_iterator iter = data.Fields().begin(); iter != data.Fields().end(); iter++, columnIndex++) {
-    grid->SetColLabelValue(columnIndex, (*iter).GetName());
-    switch ((*iter).GetType()) {
-#if 0
-    case 16: // boolean
-      grid->SetColFormatBool(columnIndex);
-      break;
-#endif
-    }
-  }
+  unsigned index = resultsPages.size();
+  resultsPages.push_back(ResultsPage(resultsPanel, table));
 
-  unsigned rowIndex = 0;
-  const int fieldCount = (int) data.Fields().size();
-  QueryResults::rows_iterator rowIter = data.Rows().begin();
-  for (; rowIter != data.Rows().end(); rowIter++, rowIndex++) {
-    if (rowIndex >= firstChunkSize) break;
-    for (int columnIndex = 0; columnIndex < fieldCount; columnIndex++) {
-      const wxString &value = (*rowIter)[columnIndex];
-      switch (data.Fields()[columnIndex].GetType()) {
-#if 0
-      case 16: // boolean
-        grid->GetTable()->SetValueAsBool(rowIndex, columnIndex, value == _T("t"));
-        break;
-#endif
+  bool select = !addedResultSet && !addedError;
+  addedResultSet = true;
+  AddPage(resultsPanel, _("&Results"), select);
+  if (select) MaterialisePage(index);
 
-      default:
-        grid->SetCellValue(rowIndex, columnIndex, value);
-        break;
-      }
-    }
-  }
+  return index;
+}
 
-  wxLogDebug(_T("Added %d rows, calling AutoSize()"), rowIndex);
+void ResultsNotebook::MaterialisePage(unsigned index)
+{
+  ResultsPage &page = resultsPages[index];
 
-  grid->AutoSize();
+  if (page.grid == NULL) {
+    page.grid = new wxGrid(page.panel, wxID_ANY);
+    page.grid->SetTable(page.table, false);
+    page.grid->EnableEditing(false);
 
-  if (rowIndex < data.Rows().size()) {
-    wxLogDebug(_T("Finished AutoSize(), adding %d more rows"), data.Rows().size() - rowIndex);
-    grid->AppendRows(data.Rows().size() - rowIndex);
+    page.grid->BeginBatch();
+    page.table->SizeColumns(page.grid, ColumnSizeSample);
+    page.grid->EndBatch();
 
-    for (; rowIter != data.Rows().end(); rowIter++, rowIndex++) {
-      for (int columnIndex = 0; columnIndex < fieldCount; columnIndex++) {
-        const wxString &value = (*rowIter)[columnIndex];
-        switch (data.Fields()[columnIndex].GetType()) {
-#if 0
-        case 16: // boolean
-          grid->GetTable()->SetValueAsBool(rowIndex, columnIndex, value == _T("t"));
-          break;
-#endif
+    page.panel->GetSizer()->Add(page.grid, 1, wxEXPAND);
+    page.panel->Layout();
+  }
+  else {
+    materialisedPages.remove(index);
+  }
+  materialisedPages.push_front(index);
 
-        default:
-          grid->SetCellValue(rowIndex, columnIndex, value);
-          break;
-        }
-      }
-    }
+  while (materialisedPages.size() > MaterialisedPagesBudget) {
+    ReleasePage(materialisedPages.back());
+    materialisedPages.pop_back();
   }
+}
+
+void ResultsNotebook::ReleasePage(unsigned index)
+{
+  ResultsPage &page = resultsPages[index];
+  wxASSERT(page.grid != NULL);
+
+  // the table outlives the grid, so must stop notifying it
+  page.table->SetView(NULL);
+  page.grid->Destroy();
+  page.grid = NULL;
+}
+
+void ResultsNotebook::DiscardPages()
+{
+  // destroy the grids before the tables they refer to
+  DeleteAllPages();
+  for (std::vector<ResultsPage>::iterator iter = resultsPages.begin(); iter != resultsPages.end(); iter++)
+    delete (*iter).table;
+  resultsPages.clear();
+  materialisedPages.clear();
+}
+
+void ResultsNotebook::OnPageChanged(wxNotebookEvent &event)
+{
+  event.Skip();
+  if (event.GetEventObject() != this) return;
 
-  grid->EndBatch();
-  parent->GetSizer()->Add(grid, 1, wxEXPAND);
+  int selection = event.GetSelection();
+  // page 0 is the messages page
+  if (selection > 0 && (unsigned) selection <= resultsPages.size())
+    MaterialisePage(selection - 1);
 }
 // Local Variables:
 // mode: c++
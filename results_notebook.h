@@ -6,16 +6,26 @@
 #ifndef __results_book_h
 #define __results_book_h
 
+#include <list>
+#include <vector>
 #include "wx/notebook.h"
 #include "pqwx.h"
 #include "script_events.h"
 #include "query_results.h"
+#include "notification_buffer.h"
+#include "messages_view.h"
 
-class wxHtmlWindow;
-class wxHtmlCellEvent;
+class wxGrid;
+class ResultsGridTable;
 
 /**
  * Notebook widget containing messages and result grids from a script execution.
+ *
+ * A result page starts off as an empty panel, with the result set held
+ * in a grid table, and the grid itself is only created when the page is
+ * first shown. Only the most recently viewed grids are kept, so a
+ * script producing hundreds of result sets doesn't produce hundreds of
+ * grid widgets.
  */
 class ResultsNotebook : public wxNotebook {
 public:
@@ -23,12 +33,18 @@ public:
    * Create notebook.
    */
   ResultsNotebook(wxWindow *parent, wxWindowID id = wxID_ANY, const wxPoint& pos = wxDefaultPosition, const wxSize& size = wxDefaultSize) : wxNotebook(parent, id, pos, size) { Setup(); }
+  ~ResultsNotebook() { DiscardPages(); }
 
   /**
    * Reset notebook.
    * This deletes all the pages if any are present.
    */
-  void Reset() { DeleteAllPages(); Setup(); }
+  void Reset() { DiscardPages(); Setup(); }
+
+  /**
+   * Script position for messages that don't relate to any position in the editor.
+   */
+  static const unsigned NoScriptPosition = (unsigned) -1;
 
   /**
    * Add command completion to messages.
@@ -37,7 +53,31 @@ public:
   /**
    * Add a result set.
    */
-  void ScriptResultSet(const wxString &statusTag, const QueryResults &data, unsigned scriptPosition);
+  void ScriptResultSet(const wxString &statusTag, std::auto_ptr<QueryResults> data, unsigned scriptPosition);
+  /**
+   * Add a batch of rows streamed from a result set.
+   * The first batch of a result set adds a new results page.
+   */
+  void ScriptResultSetRows(std::auto_ptr<QueryResults> data, unsigned scriptPosition);
+  /**
+   * Finish a streamed result set.
+   * @param statusTag Command status, or empty if there is none to report
+   * @param discardedRows Number of rows discarded because of the row limit
+   */
+  void ScriptResultSetFinished(const wxString &statusTag, unsigned long discardedRows, unsigned scriptPosition);
+  /**
+   * Add a result set read from a cursor a page at a time.
+   * Scrolling near the end of its grid sends a PQWX_ScriptFetchRows event.
+   */
+  void ScriptPagedResultSet(const wxString &statusTag, std::auto_ptr<QueryResults> data, unsigned scriptPosition);
+  /**
+   * Add a page of rows fetched for the paged result set.
+   */
+  void ScriptPagedRows(std::auto_ptr<QueryResults> data);
+  /**
+   * Stop fetching rows for the paged result set, as its cursor has been closed.
+   */
+  void ScriptPagingFinished();
   /**
    * Add a server error.
    */
@@ -59,23 +99,59 @@ public:
    */
   void ScriptAsynchronousNotice(const PgError &notice);
   /**
-   * Add an asynchronous notification.
+   * Add a batch of asynchronous notifications.
    */
-  void ScriptAsynchronousNotification(const wxString &notification);
+  void ScriptAsynchronousNotifications(const NotificationBuffer::Batch &batch);
 
 private:
   wxPanel *messagesPanel;
-  wxHtmlWindow *messagesDisplay;
+  MessagesView *messagesDisplay;
 
-  void AddResultSet(wxPanel *parent, const QueryResults &data);
+  /**
+   * A result page, whose grid may not exist yet.
+   */
+  class ResultsPage {
+  public:
+    ResultsPage(wxPanel *panel, ResultsGridTable *table) : panel(panel), table(table), grid(NULL) {}
+    wxPanel *panel;
+    ResultsGridTable *table;
+    wxGrid *grid;
+  };
+  std::vector<ResultsPage> resultsPages;
+  /**
+   * Indices of result pages with grids, most recently viewed first.
+   */
+  std::list<unsigned> materialisedPages;
+  /**
+   * Maximum number of result pages that keep their grids.
+   */
+  static const unsigned MaterialisedPagesBudget = 8;
+  /**
+   * Number of rows examined to choose column widths.
+   */
+  static const unsigned ColumnSizeSample = 100;
+  int streamingPage;
+  int pagingPage;
+
+  unsigned AddResultsPage(std::auto_ptr<QueryResults> data);
+  void AppendRows(unsigned index, std::auto_ptr<QueryResults> data);
+  void MaterialisePage(unsigned index);
+  void ReleasePage(unsigned index);
+  void DiscardPages();
   bool addedResultSet;
   bool addedError;
 
   void Setup();
 
-  void AppendServerMessage(const PgError &message, const wxString &color = _T("000000"), bool bold = false);
+  /**
+   * Number of messages retained if not configured.
+   */
+  static const unsigned DefaultMessageLimit = 10000;
+
+  void AppendServerMessage(MessagesView::Kind kind, const PgError &message, int scriptPosition = -1);
 
-  void OnMessageClicked(wxHtmlCellEvent&);
+  void OnMessageActivated(wxListEvent&);
+  void OnPageChanged(wxNotebookEvent&);
 
   DECLARE_EVENT_TABLE()
 };
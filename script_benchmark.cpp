@@ -0,0 +1,216 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include "script_benchmark.h"
+#include "script_editor_pane.h"
+#include "results_notebook.h"
+
+BEGIN_EVENT_TABLE(ScriptBenchmark, wxEvtHandler)
+  PQWX_SCRIPT_QUERY_COMPLETE(wxID_ANY, ScriptBenchmark::OnExecutionComplete)
+END_EVENT_TABLE()
+
+ScriptBenchmark::~ScriptBenchmark()
+{
+  for (std::vector<Connection>::iterator iter = connections.begin(); iter != connections.end(); iter++) {
+    if (iter->owned) {
+      iter->db->Dispose();
+      delete iter->db;
+    }
+  }
+}
+
+void ScriptBenchmark::Start(const ServerConnection &server, const wxString &dbname)
+{
+  scriptConnectionState = owner->GetConnectionState();
+  connections.resize(settings.connections);
+  connections[0].db = owner->db;
+  for (unsigned i = 1; i < connections.size(); i++) {
+    Connection &connection = connections[i];
+    connection.db = new DatabaseConnection(server, dbname);
+    connection.owned = true;
+    connection.db->Connect(new BenchmarkConnectionCallback(this, i));
+    connection.db->Relabel(wxString::Format(_("Benchmark %u"), i + 1));
+  }
+
+  for (unsigned i = 0; i < connections.size(); i++) {
+    connections[i].warmup = settings.warmup;
+    // queued until the connection is made
+    Dispatch(i);
+  }
+
+  if (settings.duration > 0)
+    wxLogDebug(_T("Benchmarking for %us over %u connections"), settings.duration, connections.size());
+  else
+    wxLogDebug(_T("Benchmarking %u executions over %u connections"), settings.executions, connections.size());
+}
+
+bool ScriptBenchmark::WantMore()
+{
+  if (failed) return false;
+  if (settings.duration > 0)
+    return !timing || stopwatch.Time() < (long) settings.duration * 1000;
+  return started < settings.executions;
+}
+
+void ScriptBenchmark::Dispatch(unsigned index)
+{
+  Connection &connection = connections[index];
+  connection.running = false;
+  if (connection.lost || failed) return;
+
+  if (connection.warmup > 0) {
+    --connection.warmup;
+    connection.timed = false;
+  }
+  else {
+    if (!WantMore()) return;
+    if (!timing) {
+      // the first connection to finish warming up starts the clock
+      stopwatch.Start();
+      timing = true;
+    }
+    ++started;
+    connection.timed = true;
+  }
+
+  connection.running = true;
+  connection.db->AddWork(new ScriptQueryWork(this, sql, false, 0, index));
+}
+
+void ScriptBenchmark::PostConnectionFailure(int connection, const wxString &message)
+{
+  ScriptExecutionWork::Result *result = new ScriptExecutionWork::Result();
+  result->copyError = wxString::Format(_("Unable to connect: %s"), message.c_str());
+  wxCommandEvent event(PQWX_ScriptQueryComplete);
+  event.SetClientData(result);
+  // no execution: the connection is identified instead
+  event.SetInt(-1);
+  event.SetExtraLong(connection);
+  AddPendingEvent(event);
+}
+
+void ScriptBenchmark::OnExecutionComplete(wxCommandEvent &event)
+{
+  ScriptExecutionWork::Result *result = (ScriptExecutionWork::Result*) event.GetClientData();
+  wxASSERT(result != NULL);
+
+  if (event.GetInt() < 0) {
+    unsigned index = event.GetExtraLong();
+    wxASSERT(index < connections.size());
+    owner->GetOrCreateResultsBook()->ScriptInternalError(wxString::Format(_("Connection %u: %s"), index + 1, result->copyError.c_str()), scriptPosition);
+    // carry on with the other connections
+    if (connections[index].running && connections[index].timed) --started;
+    connections[index].running = false;
+    connections[index].lost = true;
+  }
+  else {
+    unsigned index = event.GetInt();
+    wxASSERT(index < connections.size());
+    Connection &connection = connections[index];
+    if (!connection.owned)
+      scriptConnectionState = result->newConnectionState;
+
+    if (result->status == PGRES_FATAL_ERROR) {
+      // only the first error is reported: the rest are likely to be the same
+      if (!failed) error = result->error;
+      failed = true;
+    }
+    else if (connection.timed) {
+      timings.push_back(result->elapsedMicros.ToDouble());
+    }
+    Dispatch(index);
+  }
+  delete result;
+
+  if (!Running())
+    Finish();
+}
+
+bool ScriptBenchmark::Running() const
+{
+  for (std::vector<Connection>::const_iterator iter = connections.begin(); iter != connections.end(); iter++) {
+    if (iter->running) return true;
+  }
+  return false;
+}
+
+/**
+ * Nearest-rank percentile of sorted timings.
+ */
+static double Percentile(const std::vector<double> &sorted, unsigned percent)
+{
+  unsigned rank = (sorted.size() * percent + 99) / 100;
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void ScriptBenchmark::Report()
+{
+  ResultsNotebook *results = owner->GetOrCreateResultsBook();
+  long elapsed = stopwatch.Time();
+
+  std::vector<double> sorted(timings);
+  std::sort(sorted.begin(), sorted.end());
+
+  double sum = 0.0;
+  for (std::vector<double>::const_iterator iter = sorted.begin(); iter != sorted.end(); iter++)
+    sum += *iter;
+  double mean = sum / sorted.size();
+  double squares = 0.0;
+  for (std::vector<double>::const_iterator iter = sorted.begin(); iter != sorted.end(); iter++)
+    squares += (*iter - mean) * (*iter - mean);
+  double variance = squares / sorted.size();
+
+  // timings are in microseconds, but reported in milliseconds
+  results->ScriptEcho(wxString::Format(_("%u executions over %u connections in %.3fs: %.1f per second"),
+                                       sorted.size(), connections.size(), elapsed / 1000.0,
+                                       elapsed > 0 ? sorted.size() * 1000.0 / elapsed : 0.0),
+                      scriptPosition);
+  results->ScriptEcho(wxString::Format(_("Latency (ms): min %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f"),
+                                       sorted.front() / 1000.0,
+                                       Percentile(sorted, 50) / 1000.0,
+                                       Percentile(sorted, 95) / 1000.0,
+                                       Percentile(sorted, 99) / 1000.0,
+                                       sorted.back() / 1000.0),
+                      scriptPosition);
+  results->ScriptEcho(wxString::Format(_("Mean %.3fms, standard deviation %.3fms, variance %.3fms^2"),
+                                       mean / 1000.0, sqrt(variance) / 1000.0, variance / 1000000.0),
+                      scriptPosition);
+}
+
+void ScriptBenchmark::Finish()
+{
+  if (!timings.empty())
+    Report();
+
+  ScriptExecutionWork::Result *result = new ScriptExecutionWork::Result();
+  result->newConnectionState = scriptConnectionState;
+  result->elapsed = timing ? stopwatch.Time() : 0;
+  result->complete = true;
+
+  if (failed) {
+    result->status = PGRES_FATAL_ERROR;
+    result->error = error;
+  }
+  else {
+    // the timings have already been reported, so there is nothing more to show
+    result->status = PGRES_EMPTY_QUERY;
+    if (timings.empty())
+      result->copyError = _("No executions were timed");
+  }
+
+  wxCommandEvent event(PQWX_ScriptQueryComplete);
+  event.SetClientData(result);
+  owner->AddPendingEvent(event);
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
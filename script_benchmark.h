@@ -0,0 +1,154 @@
+/**
+ * @file
+ * Timing repeated executions of a statement from a script.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __script_benchmark_h
+#define __script_benchmark_h
+
+#include <vector>
+#include <string>
+#include "wx/event.h"
+#include "wx/stopwatch.h"
+#include "server_connection.h"
+#include "database_connection.h"
+#include "script_query_work.h"
+
+class ScriptEditorPane;
+
+/**
+ * Execute a statement repeatedly, and report how long it took.
+ *
+ * Each execution is timed the same way as executing the statement
+ * normally: from sending it to having read all its results, including
+ * copying any rows on the client side. The results themselves are
+ * thrown away.
+ *
+ * The first connection used is the script's own, so session settings
+ * apply to it; any further connections are opened to the same
+ * database, without them. Each connection executes the statement
+ * back-to-back, until the number of executions or the duration asked
+ * for has been reached.
+ *
+ * When the benchmark has finished, the latency distribution and
+ * throughput are reported, and a combined result is posted to the
+ * script editor.
+ */
+class ScriptBenchmark : public wxEvtHandler {
+public:
+  /**
+   * How to run the benchmark.
+   */
+  class Settings {
+  public:
+    Settings() : executions(100), duration(0), warmup(0), connections(1) {}
+    /**
+     * Number of timed executions, if there is no duration.
+     */
+    unsigned executions;
+    /**
+     * Number of seconds to keep executing the statement for, or zero to execute it a fixed number of times.
+     */
+    unsigned duration;
+    /**
+     * Number of executions on each connection before timing starts.
+     */
+    unsigned warmup;
+    /**
+     * Number of connections executing the statement at once.
+     */
+    unsigned connections;
+  };
+
+  /**
+   * Create benchmark.
+   *
+   * @param scriptPosition Position of the statement in the script, for messages
+   */
+  ScriptBenchmark(ScriptEditorPane *owner, const std::string &sql, const Settings &settings, unsigned scriptPosition) :
+    owner(owner), sql(sql), settings(settings), scriptPosition(scriptPosition), started(0), timing(false), failed(false) {}
+  ~ScriptBenchmark();
+
+  /**
+   * Open any extra connections and start executing the statement.
+   *
+   * @param server Server to connect to, with the script's credentials
+   * @param dbname Database to connect to
+   */
+  void Start(const ServerConnection &server, const wxString &dbname);
+
+private:
+  class Connection {
+  public:
+    Connection() : db(NULL), owned(false), lost(false), warmup(0), running(false), timed(false) {}
+    DatabaseConnection *db;
+    /**
+     * True if opened for the benchmark, rather than being the script's connection.
+     */
+    bool owned;
+    /**
+     * True if the connection could not be made.
+     */
+    bool lost;
+    /**
+     * Warm-up executions still to do.
+     */
+    unsigned warmup;
+    /**
+     * True if an execution is in progress, and whether it is being timed.
+     */
+    bool running, timed;
+  };
+
+  class BenchmarkConnectionCallback : public ConnectionCallback {
+  public:
+    BenchmarkConnectionCallback(ScriptBenchmark *owner, int connection) : owner(owner), connection(connection) {}
+    void OnConnection(bool usedPassword) {}
+    void OnConnectionFailed(const PgError& error) { owner->PostConnectionFailure(connection, error.GetPrimary()); }
+    void OnConnectionNeedsPassword() { owner->PostConnectionFailure(connection, _("a password is required")); }
+  private:
+    ScriptBenchmark * const owner;
+    const int connection;
+  };
+
+  ScriptEditorPane * const owner;
+  const std::string sql;
+  const Settings settings;
+  const unsigned scriptPosition;
+  std::vector<Connection> connections;
+  /**
+   * Microseconds taken by each timed execution, in the order they finished.
+   */
+  std::vector<double> timings;
+  /**
+   * Number of timed executions started.
+   */
+  unsigned started;
+  bool timing;
+  bool failed;
+  PgError error;
+  /**
+   * Time since the first timed execution started.
+   */
+  wxStopWatch stopwatch;
+  DatabaseConnectionState scriptConnectionState;
+
+  void Dispatch(unsigned connection);
+  bool WantMore();
+  bool Running() const;
+  void PostConnectionFailure(int connection, const wxString &message);
+  void Finish();
+  void Report();
+
+  void OnExecutionComplete(wxCommandEvent &event);
+
+  DECLARE_EVENT_TABLE()
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
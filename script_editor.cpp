@@ -17,11 +17,12 @@ BEGIN_EVENT_TABLE(ScriptEditor, wxStyledTextCtrl)
   EVT_KILL_FOCUS(ScriptEditor::OnLoseFocus)
   EVT_STC_SAVEPOINTLEFT(wxID_ANY, ScriptEditor::OnSavePointLeft)
   EVT_STC_SAVEPOINTREACHED(wxID_ANY, ScriptEditor::OnSavePointReached)
+  EVT_STC_MODIFIED(wxID_ANY, ScriptEditor::OnModified)
   EVT_CHAR(ScriptEditor::OnChar)
 END_EVENT_TABLE()
 
 ScriptEditor::ScriptEditor(wxWindow *parent, wxWindowID id, ScriptEditorPane *owner)
-  : wxStyledTextCtrl(parent, id), owner(owner)
+  : wxStyledTextCtrl(parent, id), owner(owner), indexSource(this)
 {
   SetLexer(wxSTC_LEX_SQL);
 #if wxUSE_UNICODE
@@ -86,6 +87,16 @@ void ScriptEditor::OnSavePointReached(wxStyledTextEvent &event)
   owner->MarkModified(false);
 }
 
+void ScriptEditor::OnModified(wxStyledTextEvent &event)
+{
+  event.Skip();
+  int type = event.GetModificationType();
+  if (!(type & (wxSTC_MOD_INSERTTEXT | wxSTC_MOD_DELETETEXT))) return;
+
+  int length = (type & wxSTC_MOD_INSERTTEXT) ? event.GetLength() : -event.GetLength();
+  statements.Edit(indexSource, LineFromPosition(event.GetPosition()), event.GetLinesAdded(), length);
+}
+
 void ScriptEditor::OnChar(wxKeyEvent& event)
 {
 #if wxUSE_UNICODE and __WXGTK__ 
@@ -123,20 +134,41 @@ void ScriptEditor::WriteFile(const wxString &filename)
   SetSavePoint();
 }
 
-wxCharBuffer ScriptEditor::GetRegion(int *lengthp)
+wxCharBuffer ScriptEditor::GetRegion(int *lengthp, int *startp)
 {
   int start, end;
   GetSelection(&start, &end);
 
   if (start == end) {
     *lengthp = GetLength();
+    *startp = 0;
     return GetTextRaw();
   }
   else {
     *lengthp = end - start;
+    *startp = start;
     return GetTextRangeRaw(start, end);
   }
 }
+
+wxCharBuffer ScriptEditor::GetStatementAtCursor(int *lengthp, int *startp)
+{
+  unsigned start, end;
+  if (!statements.FindStatement(GetCurrentPos(), start, end)) {
+    if (statements.StatementCount() == 0) {
+      *lengthp = 0;
+      *startp = 0;
+      return wxCharBuffer("");
+    }
+    // before the first statement
+    statements.GetStatement(0, start, end);
+  }
+
+  *lengthp = end - start;
+  *startp = start;
+  return GetTextRangeRaw(start, end);
+}
+
 // Local Variables:
 // mode: c++
 // indent-tabs-mode: nil
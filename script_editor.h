@@ -8,6 +8,7 @@
 
 #include "wx/stc/stc.h"
 #include "connect_dialogue.h"
+#include "statement_index.h"
 
 class ScriptEditorPane;
 
@@ -25,6 +26,7 @@ public:
   void OnLoseFocus(wxFocusEvent &event);
   void OnSavePointLeft(wxStyledTextEvent &event);
   void OnSavePointReached(wxStyledTextEvent &event);
+  void OnModified(wxStyledTextEvent &event);
   void OnChar(wxKeyEvent& evt);
 
   /**
@@ -39,13 +41,45 @@ public:
   /**
    * Get the currently-selected region, or the entire buffer.
    * @param lengthp Populated with the length of the region returned
+   * @param startp Populated with the position the region starts at
    */
-  wxCharBuffer GetRegion(int *lengthp);
+  wxCharBuffer GetRegion(int *lengthp, int *startp);
+
+  /**
+   * Get the statement containing the cursor, or the one before it if
+   * the cursor is between statements.
+   * @param lengthp Populated with the length of the statement returned
+   * @param startp Populated with the position the statement starts at
+   */
+  wxCharBuffer GetStatementAtCursor(int *lengthp, int *startp);
+
+  /**
+   * Index of the statements in the buffer, kept up to date as it is edited.
+   */
+  const StatementIndex& GetStatementIndex() const { return statements; }
 private:
   void UpdateStateInUI();
 
   ScriptEditorPane *owner;
 
+  class IndexSource : public StatementIndex::Source {
+  public:
+    IndexSource(ScriptEditor *editor) : editor(editor) {}
+    unsigned LineCount() const { return editor->GetLineCount(); }
+    std::string GetLine(unsigned line) const
+    {
+      int length = editor->LineLength(line);
+      if (length == 0) return std::string();
+      wxCharBuffer buf = editor->GetLineRaw(line);
+      return std::string(buf.data(), length);
+    }
+  private:
+    ScriptEditor * const editor;
+  };
+
+  IndexSource indexSource;
+  StatementIndex statements;
+
   static wxString WordList_keywords;
   static wxString WordList_database_objects;
   static wxString WordList_sqlplus;
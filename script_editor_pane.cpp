@@ -6,7 +6,9 @@
     #include "wx/wx.h"
 #endif
 
+#include <stdio.h>
 #include "wx/splitter.h"
+#include "wx/filename.h"
 #include "script_editor.h"
 #include "script_editor_pane.h"
 #include "script_events.h"
@@ -16,13 +18,22 @@
 
 BEGIN_EVENT_TABLE(ScriptEditorPane, wxPanel)
   PQWX_SCRIPT_EXECUTE(wxID_ANY, ScriptEditorPane::OnExecute)
+  PQWX_SCRIPT_EXECUTE_STATEMENT(wxID_ANY, ScriptEditorPane::OnExecuteStatement)
+  PQWX_SCRIPT_EXECUTE_FILE(wxID_ANY, ScriptEditorPane::OnExecuteFile)
+  PQWX_SCRIPT_BENCHMARK_STATEMENT(wxID_ANY, ScriptEditorPane::OnBenchmarkStatement)
   PQWX_SCRIPT_DISCONNECT(wxID_ANY, ScriptEditorPane::OnDisconnect)
   PQWX_SCRIPT_RECONNECT(wxID_ANY, ScriptEditorPane::OnReconnect)
   PQWX_SCRIPT_QUERY_COMPLETE(wxID_ANY, ScriptEditorPane::OnQueryComplete)
+  PQWX_SCRIPT_ROWS_RECEIVED(wxID_ANY, ScriptEditorPane::OnRowsReceived)
+  PQWX_SCRIPT_COPY_PROGRESS(wxID_ANY, ScriptEditorPane::OnCopyProgress)
+  PQWX_SCRIPT_PIPELINE_COMPLETE(wxID_ANY, ScriptEditorPane::OnPipelineComplete)
+  PQWX_SCRIPT_FETCH_ROWS(wxID_ANY, ScriptEditorPane::OnFetchRows)
+  PQWX_SCRIPT_CURSOR_FETCHED(wxID_ANY, ScriptEditorPane::OnCursorFetched)
   PQWX_SCRIPT_EXECUTION_FINISHING(wxID_ANY, ScriptEditorPane::OnExecutionFinished)
   PQWX_SCRIPT_SERVER_NOTICE(wxID_ANY, ScriptEditorPane::OnConnectionNotice)
   PQWX_SCRIPT_ASYNC_NOTIFICATION(wxID_ANY, ScriptEditorPane::OnConnectionNotification)
-  EVT_TIMER(wxID_ANY, ScriptEditorPane::OnTimerTick)
+  EVT_TIMER(Pqwx_StatusUpdateTimer, ScriptEditorPane::OnTimerTick)
+  EVT_TIMER(Pqwx_NotificationTimer, ScriptEditorPane::OnNotificationTimer)
   PQWX_SCRIPT_SHOW_POSITION(wxID_ANY, ScriptEditorPane::OnShowPosition)
 END_EVENT_TABLE()
 
@@ -30,15 +41,22 @@ DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptStateUpdated)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptExecutionBeginning)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptExecutionFinishing)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptQueryComplete)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptRowsReceived)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptCopyProgress)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptPipelineComplete)
+DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptCursorFetched)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptConnectionStatus)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptServerNotice)
 DEFINE_LOCAL_EVENT_TYPE(PQWX_ScriptAsyncNotification)
 
 int ScriptEditorPane::documentCounter = 0;
+int ScriptEditorPane::cursorCounter = 0;
 
 ScriptEditorPane::ScriptEditorPane(wxWindow *parent, wxWindowID id)
   : wxPanel(parent, id), resultsBook(NULL), db(NULL), modified(false),
-    execution(NULL), statusUpdateTimer(this), notificationReceiver(this)
+    execution(NULL), statusUpdateTimer(this, Pqwx_StatusUpdateTimer), cursorOwnsTransaction(false), cursorPageSize(0),
+    notificationBuffer(NotificationBufferCapacity), notificationTimer(this, Pqwx_NotificationTimer),
+    notificationReceiver(this)
 {
   splitter = new wxSplitterWindow(this, wxID_ANY);
   editor = new ScriptEditor(splitter, wxID_ANY, this);
@@ -131,6 +149,7 @@ void ScriptEditorPane::SetConnection(const ServerConnection &server_, DatabaseCo
     db->Dispose();
     delete db;
   }
+  ForgetCursor();
 
   db = db_;
   server = server_;
@@ -156,6 +175,7 @@ void ScriptEditorPane::OnDisconnect(wxCommandEvent &event)
   db->Dispose();
   delete db;
   db = NULL;
+  ForgetCursor();
   ShowDisconnectedStatus();
   UpdateStateInUI(); // refresh title etc
 }
@@ -209,17 +229,37 @@ void ScriptEditorPane::MonitorInputProcessor::operator()(PGnotify *notification)
 {
   wxString channel(wxString(notification->relname, wxConvUTF8));
   wxString payload(wxString(notification->extra, wxConvUTF8));
-  wxCommandEvent event(PQWX_ScriptAsyncNotification);
-  if (payload)
-    event.SetString(channel + _T(" ") + payload);
-  else
-    event.SetString(channel);
-  owner->AddPendingEvent(event);
+  PQfreemem(notification);
+  if (owner->notificationBuffer.Push(channel, payload)) {
+    wxCommandEvent event(PQWX_ScriptAsyncNotification);
+    owner->AddPendingEvent(event);
+  }
 }
 
 void ScriptEditorPane::OnConnectionNotification(wxCommandEvent &event)
 {
-  GetOrCreateResultsBook()->ScriptAsynchronousNotification(event.GetString());
+  wxLongLong sinceLast = sinceNotificationDelivery.Time() / 1000;
+  if (sinceLast < NotificationDeliveryInterval) {
+    // the buffer keeps accumulating until the timer fires
+    if (!notificationTimer.IsRunning())
+      notificationTimer.Start(NotificationDeliveryInterval - sinceLast.ToLong(), wxTIMER_ONE_SHOT);
+    return;
+  }
+  DeliverNotifications();
+}
+
+void ScriptEditorPane::OnNotificationTimer(wxTimerEvent &event)
+{
+  DeliverNotifications();
+}
+
+void ScriptEditorPane::DeliverNotifications()
+{
+  NotificationBuffer::Batch batch;
+  notificationBuffer.Drain(batch);
+  sinceNotificationDelivery.Start();
+  if (batch.notifications.empty()) return;
+  GetOrCreateResultsBook()->ScriptAsynchronousNotifications(batch);
 }
 
 wxString ScriptEditorPane::FormatTitle() const {
@@ -294,9 +334,54 @@ void ScriptEditorPane::OnTimerTick(wxTimerEvent &event)
   // Arguably, \c should replace the connection only if the new connection is successfully made.
   if (StatusBar_TimeElapsed < statusbar->GetFieldsCount())
     statusbar->SetStatusText(elapsed, StatusBar_TimeElapsed);
+  wxString progress = execution->DescribeProgress();
+  if (!progress.empty())
+    statusbar->SetStatusText(wxString::Format(_("Executing %s"), progress.c_str()), StatusBar_Status);
 }
 
 void ScriptEditorPane::OnExecute(wxCommandEvent &event)
+{
+  int length, start;
+  wxCharBuffer source = editor->GetRegion(&length, &start);
+  BeginExecution(new BufferScriptSource(source, length, start));
+}
+
+void ScriptEditorPane::OnExecuteStatement(wxCommandEvent &event)
+{
+  int length, start;
+  wxCharBuffer source = editor->GetStatementAtCursor(&length, &start);
+  BeginExecution(new BufferScriptSource(source, length, start));
+}
+
+void ScriptEditorPane::OnExecuteFile(wxCommandEvent &event)
+{
+  std::auto_ptr<MappedScriptSource> source(new MappedScriptSource(event.GetString()));
+  wxString error;
+  if (!source->Open(error)) {
+    wxLogError(_T("%s"), error.c_str());
+    return;
+  }
+  BeginExecution(source.release());
+}
+
+void ScriptEditorPane::OnBenchmarkStatement(wxCommandEvent &event)
+{
+  int start, end;
+  editor->GetSelection(&start, &end);
+  int length, statementStart;
+  wxCharBuffer statement = start == end ? editor->GetStatementAtCursor(&length, &statementStart) : editor->GetRegion(&length, &statementStart);
+
+  // without its terminator, the statement is left in the query buffer for \bench rather than executed first
+  std::string sql(statement.data(), length);
+  std::string::size_type last = sql.find_last_not_of(" \t\r\n\f\v;");
+  sql.erase(last == std::string::npos ? 0 : last + 1);
+  sql += "\n";
+  sql += event.GetString().utf8_str();
+
+  BeginExecution(new BufferScriptSource(wxCharBuffer(sql.c_str()), sql.length(), statementStart));
+}
+
+void ScriptEditorPane::BeginExecution(ScriptSource *source)
 {
   wxASSERT(db != NULL);
   wxASSERT(execution == NULL);
@@ -307,11 +392,10 @@ void ScriptEditorPane::OnExecute(wxCommandEvent &event)
   ShowScriptInProgressStatus();
   statusUpdateTimer.Start(1000);
 
+  CloseCursor();
   if (resultsBook != NULL) resultsBook->Reset();
 
-  int length;
-  wxCharBuffer source = editor->GetRegion(&length);
-  execution = new ScriptExecution(this, source, length);
+  execution = new ScriptExecution(this, source);
   execution->Proceed();
 }
 
@@ -334,6 +418,124 @@ void ScriptEditorPane::OnQueryComplete(wxCommandEvent &event)
   execution->Proceed();
 }
 
+void ScriptEditorPane::OnPipelineComplete(wxCommandEvent &event)
+{
+  ScriptPipelineResults *results = (ScriptPipelineResults*) event.GetClientData();
+  wxASSERT(results != NULL);
+  wxASSERT(execution != NULL);
+
+  execution->ProcessPipelineResults(results);
+  execution->Proceed();
+}
+
+void ScriptEditorPane::OnRowsReceived(wxCommandEvent &event)
+{
+  ScriptRowBatch *rows = (ScriptRowBatch*) event.GetClientData();
+  wxASSERT(rows != NULL);
+  wxASSERT(execution != NULL);
+
+  execution->ProcessRowBatch(rows);
+  statusbar->SetStatusText(wxString::Format(_("%d rows"), execution->TotalRows()), StatusBar_RowsRetrieved);
+}
+
+void ScriptEditorPane::OnCopyProgress(wxCommandEvent &event)
+{
+  ScriptCopyProgress *progress = (ScriptCopyProgress*) event.GetClientData();
+  wxASSERT(progress != NULL);
+
+  wxString status = wxString::Format(_("%lu rows, %s"), progress->rows, wxFileName::GetHumanReadableSize(progress->bytes).c_str());
+  if (!progress->detail.empty())
+    status << _T("; ") << progress->detail;
+  statusbar->SetStatusText(status, StatusBar_RowsRetrieved);
+
+  delete progress;
+}
+
+std::string ScriptEditorPane::DeclareCursor(const std::string &sql, unsigned pageSize, unsigned &prefixLength)
+{
+  wxASSERT(cursorName.empty());
+  wxASSERT(state == Idle || state == IdleInTransaction);
+
+  char buf[64];
+  sprintf(buf, "pqwx_cursor_%d", ++cursorCounter);
+  cursorName = buf;
+  cursorPageSize = pageSize;
+  cursorOwnsTransaction = state == Idle;
+
+  std::string prefix = cursorOwnsTransaction ? "BEGIN; " : "";
+  prefix += "DECLARE " + cursorName + " NO SCROLL CURSOR FOR ";
+  prefixLength = prefix.length();
+
+  std::string query = sql;
+  std::string::size_type last = query.find_last_not_of(" \t\r\n\f\v");
+  if (last != std::string::npos && query[last] == ';') query.erase(last);
+
+  // the query may end with a comment, so start the FETCH on a new line
+  sprintf(buf, "\n; FETCH FORWARD %u FROM ", pageSize);
+  return prefix + query + buf + cursorName;
+}
+
+void ScriptEditorPane::CloseCursor()
+{
+  if (cursorName.empty()) return;
+
+  if (cursorOwnsTransaction) {
+    // only the cursor was used in the transaction, so committing it just closes the cursor
+    db->AddWorkOnlyIfConnected(new ScriptCursorWork(this, cursorName, "COMMIT"));
+    UpdateConnectionState(Idle);
+    ShowTransactionStatus();
+  }
+  else if (state == IdleInTransaction) {
+    db->AddWorkOnlyIfConnected(new ScriptCursorWork(this, cursorName, "CLOSE " + cursorName));
+  }
+  // otherwise, the transaction has failed, and will take the cursor with it when it is rolled back
+
+  ForgetCursor();
+}
+
+void ScriptEditorPane::ForgetCursor()
+{
+  cursorName.clear();
+  if (resultsBook != NULL) resultsBook->ScriptPagingFinished();
+}
+
+void ScriptEditorPane::OnFetchRows(wxCommandEvent &event)
+{
+  if (cursorName.empty() || db == NULL) return;
+
+  char sql[64];
+  sprintf(sql, "FETCH FORWARD %u FROM ", cursorPageSize);
+  bool added = db->AddWorkOnlyIfConnected(new ScriptCursorWork(this, cursorName, sql + cursorName));
+  wxCHECK2(added, );
+}
+
+void ScriptEditorPane::OnCursorFetched(wxCommandEvent &event)
+{
+  ScriptExecutionWork::Result *result = (ScriptExecutionWork::Result*) event.GetClientData();
+  wxASSERT(result != NULL);
+
+  // results of closing the cursor, or of fetching from one that has since been closed, aren't wanted
+  if (cursorName.empty() || event.GetString() != wxString(cursorName.c_str(), wxConvUTF8)) {
+    delete result;
+    return;
+  }
+
+  if (result->status == PGRES_TUPLES_OK) {
+    bool exhausted = result->data->Rows().size() < cursorPageSize;
+    GetOrCreateResultsBook()->ScriptPagedRows(result->data);
+    if (exhausted) CloseCursor();
+  }
+  else {
+    if (result->status == PGRES_FATAL_ERROR)
+      GetOrCreateResultsBook()->ScriptError(result->error, ResultsNotebook::NoScriptPosition);
+    UpdateConnectionState(result->newConnectionState);
+    ShowTransactionStatus();
+    CloseCursor();
+  }
+
+  delete result;
+}
+
 void ScriptEditorPane::OnShowPosition(wxCommandEvent &event)
 {
   editor->GotoPos(event.GetInt());
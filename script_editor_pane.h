@@ -13,6 +13,8 @@
 #include "documents_notebook.h"
 #include "script_execution.h"
 #include "database_event_type.h"
+#include "notification_buffer.h"
+#include "micro_stopwatch.h"
 
 class ScriptEditor;
 class ResultsNotebook;
@@ -59,10 +61,19 @@ public:
   void OnDisconnect(wxCommandEvent &event);
   void OnReconnect(wxCommandEvent &event);
   void OnExecute(wxCommandEvent &event);
+  void OnExecuteStatement(wxCommandEvent &event);
+  void OnExecuteFile(wxCommandEvent &event);
+  void OnBenchmarkStatement(wxCommandEvent &event);
   void OnQueryComplete(wxCommandEvent &event);
+  void OnRowsReceived(wxCommandEvent &event);
+  void OnCopyProgress(wxCommandEvent &event);
+  void OnFetchRows(wxCommandEvent &event);
+  void OnCursorFetched(wxCommandEvent &event);
+  void OnPipelineComplete(wxCommandEvent &event);
   void OnConnectionNotice(wxCommandEvent &event);
   void OnConnectionNotification(wxCommandEvent &event);
   void OnTimerTick(wxTimerEvent &event);
+  void OnNotificationTimer(wxTimerEvent &event);
   void OnShowPosition(wxCommandEvent &event);
   void OnExecutionFinished(wxCommandEvent &event);
 
@@ -172,12 +183,17 @@ private:
 
   static int documentCounter;
 
-  class SetupNoticeProcessorWork : public DatabaseWork {
+  class SetupNoticeProcessorWork : public AsyncDatabaseWork {
   public:
     SetupNoticeProcessorWork(ScriptEditorPane *owner) : owner(owner) {}
-    void DoWork()
+    bool Send()
     {
       PQsetNoticeReceiver(conn, ScriptEditorNoticeReceiver, owner);
+      return false;
+    }
+    void ProcessResult(PGresult *rs)
+    {
+      PQclear(rs);
     }
     void NotifyFinished()
     {
@@ -195,6 +211,50 @@ private:
 
   ScriptExecution *execution;
   wxTimer statusUpdateTimer;
+  void BeginExecution(ScriptSource *source);
+
+  /**
+   * Cursor the paged result set is read from, or empty if there is none.
+   *
+   * The cursor lasts as long as the transaction it was declared in. If
+   * there was no transaction, one is begun for it, and committed again
+   * before anything else is done on the connection.
+   */
+  std::string cursorName;
+  bool cursorOwnsTransaction;
+  unsigned cursorPageSize;
+  static int cursorCounter;
+
+  /**
+   * Rewrite a query to declare a cursor for it and fetch the first page of rows.
+   *
+   * The result contains several commands, so has to be sent as a simple query.
+   *
+   * @param prefixLength Set to the length of the text added before the
+   * query, which is what error positions have to be moved back by
+   */
+  std::string DeclareCursor(const std::string &sql, unsigned pageSize, unsigned &prefixLength);
+  /**
+   * Close the cursor for the paged result set, if there is one.
+   */
+  void CloseCursor();
+  /**
+   * Stop paging results, without closing the cursor: e.g. because the connection has gone.
+   */
+  void ForgetCursor();
+
+  /**
+   * Maximum number of notifications kept between deliveries to the results notebook.
+   */
+  static const unsigned NotificationBufferCapacity = 200;
+  /**
+   * Minimum interval between deliveries of notifications to the results notebook, in milliseconds.
+   */
+  static const long NotificationDeliveryInterval = 250;
+  NotificationBuffer notificationBuffer;
+  wxTimer notificationTimer;
+  MicroStopWatch sinceNotificationDelivery;
+  void DeliverNotifications();
 
   void ReportInternalError(const wxString &error, const wxString &command, unsigned scriptPosition);
 
@@ -247,6 +307,9 @@ private:
   } notificationReceiver;
 
   friend class ScriptExecution;
+  friend class ScriptParallelCopy;
+  friend class ScriptParallelBlock;
+  friend class ScriptBenchmark;
 
   DECLARE_EVENT_TABLE()
 };
@@ -23,6 +23,11 @@ BEGIN_DECLARE_EVENT_TYPES()
   DECLARE_EVENT_TYPE(PQWX_ScriptStateUpdated, -1)
 // send by frame to editor from menu bar
   DECLARE_EVENT_TYPE(PQWX_ScriptExecute, -1)
+  DECLARE_EVENT_TYPE(PQWX_ScriptExecuteStatement, -1)
+// string is the name of the file to execute
+  DECLARE_EVENT_TYPE(PQWX_ScriptExecuteFile, -1)
+// string is the \bench command to benchmark the current statement with
+  DECLARE_EVENT_TYPE(PQWX_ScriptBenchmarkStatement, -1)
   DECLARE_EVENT_TYPE(PQWX_ScriptDisconnect, -1)
   DECLARE_EVENT_TYPE(PQWX_ScriptReconnect, -1)
 // generated by editors at start/stop of execution
@@ -32,6 +37,16 @@ BEGIN_DECLARE_EVENT_TYPES()
   DECLARE_EVENT_TYPE(PQWX_ScriptConnectionStatus, -1)
 // sent asynchronously by execution work when it completes
   DECLARE_EVENT_TYPE(PQWX_ScriptQueryComplete, -1)
+// sent asynchronously by execution work with each batch of rows streamed from a result set
+  DECLARE_EVENT_TYPE(PQWX_ScriptRowsReceived, -1)
+// sent asynchronously by execution work while receiving COPY data
+  DECLARE_EVENT_TYPE(PQWX_ScriptCopyProgress, -1)
+// sent asynchronously by pipeline work when a batch of statements completes
+  DECLARE_EVENT_TYPE(PQWX_ScriptPipelineComplete, -1)
+// sent asynchronously by cursor work with a page of rows for a paged result set
+  DECLARE_EVENT_TYPE(PQWX_ScriptCursorFetched, -1)
+// sent by a results grid table when the grid reads near the end of a paged result set
+  DECLARE_EVENT_TYPE(PQWX_ScriptFetchRows, -1)
 // sent by notice processor when a notice is received
   DECLARE_EVENT_TYPE(PQWX_ScriptServerNotice, -1)
 // sent by notification receiver when a notification is received
@@ -46,9 +61,17 @@ END_DECLARE_EVENT_TYPES()
 #define PQWX_SCRIPT_TO_WINDOW(id, fn) EVT_DATABASE(id, PQWX_ScriptToWindow, fn)
 #define PQWX_SCRIPT_STATE_UPDATED(id, fn) EVT_DATABASE(id, PQWX_ScriptStateUpdated, fn)
 #define PQWX_SCRIPT_EXECUTE(id, fn) EVT_COMMAND(id, PQWX_ScriptExecute, fn)
+#define PQWX_SCRIPT_EXECUTE_STATEMENT(id, fn) EVT_COMMAND(id, PQWX_ScriptExecuteStatement, fn)
+#define PQWX_SCRIPT_EXECUTE_FILE(id, fn) EVT_COMMAND(id, PQWX_ScriptExecuteFile, fn)
+#define PQWX_SCRIPT_BENCHMARK_STATEMENT(id, fn) EVT_COMMAND(id, PQWX_ScriptBenchmarkStatement, fn)
 #define PQWX_SCRIPT_DISCONNECT(id, fn) EVT_COMMAND(id, PQWX_ScriptDisconnect, fn)
 #define PQWX_SCRIPT_RECONNECT(id, fn) EVT_COMMAND(id, PQWX_ScriptReconnect, fn)
 #define PQWX_SCRIPT_QUERY_COMPLETE(id, fn) EVT_COMMAND(id, PQWX_ScriptQueryComplete, fn)
+#define PQWX_SCRIPT_ROWS_RECEIVED(id, fn) EVT_COMMAND(id, PQWX_ScriptRowsReceived, fn)
+#define PQWX_SCRIPT_COPY_PROGRESS(id, fn) EVT_COMMAND(id, PQWX_ScriptCopyProgress, fn)
+#define PQWX_SCRIPT_PIPELINE_COMPLETE(id, fn) EVT_COMMAND(id, PQWX_ScriptPipelineComplete, fn)
+#define PQWX_SCRIPT_CURSOR_FETCHED(id, fn) EVT_COMMAND(id, PQWX_ScriptCursorFetched, fn)
+#define PQWX_SCRIPT_FETCH_ROWS(id, fn) EVT_COMMAND(id, PQWX_ScriptFetchRows, fn)
 #define PQWX_SCRIPT_EXECUTION_BEGINNING(id, fn) EVT_COMMAND(id, PQWX_ScriptExecutionBeginning, fn)
 #define PQWX_SCRIPT_EXECUTION_FINISHING(id, fn) EVT_COMMAND(id, PQWX_ScriptExecutionFinishing, fn)
 #define PQWX_SCRIPT_CONNECTION_STATUS(id, fn) EVT_COMMAND(id, PQWX_ScriptConnectionStatus, fn)
@@ -6,6 +6,9 @@
     #include "wx/wx.h"
 #endif
 
+#include "wx/config.h"
+#include "wx/filedlg.h"
+#include "wx/filename.h"
 #include "script_execution.h"
 #include "script_editor_pane.h"
 #include "script_query_work.h"
@@ -16,11 +19,22 @@ std::map<wxString, ScriptExecution::PsqlCommandHandler> ScriptExecution::InitPsq
   std::map<wxString, PsqlCommandHandler> handlers;
   handlers[_T("c")] = &ScriptExecution::PsqlChangeDatabase;
   handlers[_T("connect")] = &ScriptExecution::PsqlChangeDatabase;
+  handlers[_T("copy")] = &ScriptExecution::PsqlCopy;
+  handlers[_T("pcopy")] = &ScriptExecution::PsqlParallelCopy;
   handlers[_T("g")] = &ScriptExecution::PsqlExecuteQueryBuffer;
   handlers[_T("echo")] = &ScriptExecution::PsqlPrintMessage;
   handlers[_T("p")] = &ScriptExecution::PsqlPrintQueryBuffer;
   handlers[_T("r")] = &ScriptExecution::PsqlResetQueryBuffer;
   handlers[_T("quit")] = &ScriptExecution::PsqlQuitExecution;
+  handlers[_T("set")] = &ScriptExecution::PsqlSetVariable;
+  handlers[_T("unset")] = &ScriptExecution::PsqlUnsetVariable;
+  handlers[_T("i")] = &ScriptExecution::PsqlInclude;
+  handlers[_T("include")] = &ScriptExecution::PsqlInclude;
+  handlers[_T("ir")] = &ScriptExecution::PsqlIncludeRelative;
+  handlers[_T("include_relative")] = &ScriptExecution::PsqlIncludeRelative;
+  handlers[_T("parallel")] = &ScriptExecution::PsqlBeginParallel;
+  handlers[_T("endparallel")] = &ScriptExecution::PsqlEndParallel;
+  handlers[_T("bench")] = &ScriptExecution::PsqlBenchmark;
   return handlers;
 }
 
@@ -33,15 +47,94 @@ inline void ScriptExecution::ReportInternalError(const wxString &error, const wx
   owner->GetOrCreateResultsBook()->ScriptInternalError(error, scriptPosition);
 }
 
+void ScriptExecution::ReportInternalError(const wxString &error, const wxString &command, const ExecutionLexer::Token &t)
+{
+  SqlLocation location = LocationOf(t);
+  ReportInternalError(error, command, location.position);
+  ReportLocation(location);
+}
+
+/**
+ * Statements from a file can't be shown in the editor, so say where they are.
+ */
+void ScriptExecution::ReportLocation(const SqlLocation &location)
+{
+  if (location.file.empty()) return;
+  owner->GetOrCreateResultsBook()->ScriptEcho(DescribeLocation(location), location.position);
+}
+
+wxString ScriptExecution::DescribeLocation(const SqlLocation &location)
+{
+  if (location.file.empty()) return wxEmptyString;
+  return wxString::Format(_("at line %lu of %s"), location.line, location.file.c_str());
+}
+
+ScriptExecution::SqlLocation ScriptExecution::LocationOf(const ExecutionLexer::Token &t)
+{
+  SqlLocation location;
+  ScriptSource *source = sources.back();
+  location.file = source->GetFilename();
+  if (location.file.empty()) {
+    location.position = source->EditorPosition() + t.offset;
+  }
+  else {
+    location.position = ResultsNotebook::NoScriptPosition;
+    location.line = source->LineAt(t.offset);
+  }
+  return location;
+}
+
+ScriptExecution::~ScriptExecution()
+{
+  for (std::vector<ScriptSource*>::iterator iter = sources.begin(); iter != sources.end(); iter++)
+    delete *iter;
+}
+
+ExecutionLexer::Token ScriptExecution::PullToken()
+{
+  do {
+    ExecutionLexer::Token t = sources.back()->Pull();
+    if (t.type != ExecutionLexer::Token::END || sources.size() == 1)
+      return t;
+    // end of an included file: carry on with the script that included it
+    delete sources.back();
+    sources.pop_back();
+  } while (true);
+}
+
 ScriptExecution::NextState ScriptExecution::ProcessExecution()
 {
   if (owner->state == CopyToServer) {
     BeginPutCopyData();
     return NoMore;
   }
+  if (owner->state == CopyToClient) {
+    BeginGetCopyData();
+    return NoMore;
+  }
+  if (stopOnError && EncounteredErrors())
+    return Finish;
+  if (queryPending) {
+    queryPending = false;
+    BeginQuery();
+    return NoMore;
+  }
 
   ExecutionLexer::Token t = NextToken();
+  if (t.type != ExecutionLexer::Token::SQL && !pipelineStatements.empty()) {
+    // anything else has to wait for the statements queued so far to complete
+    HoldToken(t);
+    SendPipeline();
+    return NoMore;
+  }
+
   if (t.type == ExecutionLexer::Token::END) {
+    if (collectingParallel) {
+      ReportInternalError(_("\\parallel block not ended by \\endparallel"), wxEmptyString, parallelLocation.position);
+      ReportLocation(parallelLocation);
+      BumpErrors();
+      return ExecuteParallelBlock();
+    }
     if (!queryBuffer.empty() && !queryBufferExecuted) {
       BeginQuery();
       return NoMore;
@@ -51,18 +144,13 @@ ScriptExecution::NextState ScriptExecution::ProcessExecution()
   }
 
   if (t.type == ExecutionLexer::Token::SQL) {
-    AppendSql(t);
-
-    for (unsigned ofs = t.length - 1; ofs >= 0; ofs--) {
-      char c = CharAt(t.offset + ofs);
-      if (c == ';') {
-        // execute immediately
-        BeginQuery();
-        return NoMore;
-      }
-      else if (!isspace(c)) {
-        break;
-      }
+    std::string sql = sources.back()->GetString(t);
+    AppendSql(t, sql);
+
+    std::string::size_type last = sql.find_last_not_of(" \t\r\n\f\v");
+    if (last != std::string::npos && sql[last] == ';') {
+      // execute immediately
+      return ExecuteStatement();
     }
 
     // look for following psql command or end of input
@@ -82,8 +170,14 @@ ScriptExecution::NextState ScriptExecution::ProcessExecution()
 
     wxLogDebug(_T("psql | %s | %s"), command.c_str(), parameters.c_str());
     std::map<wxString, PsqlCommandHandler>::const_iterator handler = psqlCommandHandlers.find(command);
+    if (collectingParallel && command != _T("endparallel")) {
+      // the block's statements are run later, so commands between them can't take effect in order
+      ReportInternalError(wxString::Format(_("\\%s can't be used inside a \\parallel block"), command.c_str()), fullCommandString, t);
+      BumpErrors();
+      return NeedMore;
+    }
     if (handler == psqlCommandHandlers.end()) {
-      ReportInternalError(wxString::Format(_T("Unrecognised command: \\%s"), command.c_str()), fullCommandString, t.offset);
+      ReportInternalError(wxString::Format(_T("Unrecognised command: \\%s"), command.c_str()), fullCommandString, t);
       BumpErrors();
       return NeedMore;
     }
@@ -93,16 +187,183 @@ ScriptExecution::NextState ScriptExecution::ProcessExecution()
   }
 }
 
+void ScriptExecution::ReadSettings()
+{
+#if PG_VERSION_NUM >= 140000
+  wxConfig::Get()->Read(_T("Script/Pipeline"), &pipelining, false);
+#else
+  pipelining = false;
+#endif
+  long window;
+  wxConfig::Get()->Read(_T("Script/PipelineWindow"), &window, 100L);
+  pipelineWindow = window > 0 ? window : 1;
+
+  wxConfig::Get()->Read(_T("Script/PageResults"), &pageResults, false);
+  long size;
+  wxConfig::Get()->Read(_T("Script/PageSize"), &size, 1000L);
+  pageSize = size > 0 ? size : 1;
+}
+
+ScriptExecution::NextState ScriptExecution::ExecuteStatement()
+{
+  if (collectingParallel)
+    return AddParallelStatement();
+
+  // statements already sent in a pipeline would still run after an error
+  if (pipelining && !stopOnError && CanPipeline() && !CanPageResults()) {
+    queryBufferExecuted = true;
+    pipelineStatements.push_back(queryBuffer);
+    pipelineLocations.push_back(lastSql);
+    if (pipelineStatements.size() < pipelineWindow)
+      return NeedMore;
+    SendPipeline();
+    return NoMore;
+  }
+
+  if (!pipelineStatements.empty()) {
+    // run this statement once the ones before it have completed
+    queryPending = true;
+    SendPipeline();
+    return NoMore;
+  }
+
+  BeginQuery();
+  return NoMore;
+}
+
+/**
+ * @return first word of a statement, in lower case
+ */
+static std::string LeadingKeyword(const std::string &sql)
+{
+  std::string::const_iterator iter = sql.begin();
+  while (iter != sql.end()) {
+    if (isspace(*iter)) {
+      ++iter;
+    }
+    else if (*iter == '-' && iter + 1 != sql.end() && iter[1] == '-') {
+      while (iter != sql.end() && *iter != '\n') ++iter;
+    }
+    else {
+      break;
+    }
+  }
+  std::string keyword;
+  while (iter != sql.end() && isalpha(*iter))
+    keyword += tolower(*iter++);
+  return keyword;
+}
+
+/**
+ * Only plain statements can be pipelined: COPY needs its own protocol.
+ */
+bool ScriptExecution::CanPipeline()
+{
+  return LeadingKeyword(queryBuffer) != "copy";
+}
+
+/**
+ * Results can be read a page at a time from a cursor if the statement
+ * is a plain query and the connection isn't in a failed transaction.
+ *
+ * SELECT INTO can't be used for a cursor: this just looks for the
+ * word, so the occasional query mentioning it otherwise is read in
+ * full.
+ */
+bool ScriptExecution::CanPageResults()
+{
+  if (!pageResults) return false;
+  if (owner->state != Idle && owner->state != IdleInTransaction) return false;
+
+  std::string sql = queryBuffer;
+  std::string keyword = LeadingKeyword(sql);
+  if (keyword != "select" && keyword != "values" && keyword != "table") return false;
+
+  for (std::string::iterator iter = sql.begin(); iter != sql.end(); iter++)
+    *iter = tolower(*iter);
+  for (std::string::size_type pos = sql.find("into"); pos != std::string::npos; pos = sql.find("into", pos + 4)) {
+    bool wordStart = pos == 0 || (!isalnum((unsigned char) sql[pos - 1]) && sql[pos - 1] != '_');
+    bool wordEnd = pos + 4 == sql.length() || (!isalnum((unsigned char) sql[pos + 4]) && sql[pos + 4] != '_');
+    if (wordStart && wordEnd) return false;
+  }
+  return true;
+}
+
+void ScriptExecution::SendPipeline()
+{
+#if PG_VERSION_NUM >= 140000
+  owner->CloseCursor();
+  pipelineSentLocations.swap(pipelineLocations);
+  pipelineLocations.clear();
+  bool added = owner->db->AddWorkOnlyIfConnected(new ScriptPipelineWork(owner, pipelineStatements, owner->GetConnectionState()));
+  pipelineStatements.clear();
+  wxCHECK2(added, );
+#else
+  wxFAIL_MSG(_T("pipeline mode not available"));
+#endif
+}
+
 void ScriptExecution::BeginQuery()
 {
   queryBufferExecuted = true;
-  bool added = owner->db->AddWorkOnlyIfConnected(new ScriptQueryWork(owner, queryBuffer));
+  owner->CloseCursor();
+
+  if (CanPageResults()) {
+    // only the first page is fetched now: the rest are fetched by the editor as the results are scrolled
+    cursorDeclared = true;
+    std::string sql = owner->DeclareCursor(queryBuffer, pageSize, cursorPrefixLength);
+    bool added = owner->db->AddWorkOnlyIfConnected(new ScriptDeclareCursorWork(owner, sql));
+    wxCHECK2(added, );
+    return;
+  }
+
+  SendQuery(queryBuffer);
+}
+
+void ScriptExecution::SendQuery(const std::string &sql)
+{
+  owner->CloseCursor();
+
+  bool streamResults;
+  long rowLimit;
+  wxConfig::Get()->Read(_T("Script/StreamResults"), &streamResults, true);
+  wxConfig::Get()->Read(_T("Script/RowLimit"), &rowLimit, 0L);
+  bool added = owner->db->AddWorkOnlyIfConnected(new ScriptQueryWork(owner, sql, streamResults, rowLimit > 0 ? rowLimit : 0));
   wxCHECK2(added, );
 }
 
 void ScriptExecution::BeginPutCopyData()
 {
-  bool added = owner->db->AddWorkOnlyIfConnected(new ScriptPutCopyDataWork(owner, CopyDataToken(), buffer.data()));
+  if (copyTargetSet && !copyFile.empty()) {
+    copyTargetSet = false;
+    bool added = owner->db->AddWorkOnlyIfConnected(new ScriptPutCopyFileWork(owner, copyFile));
+    wxCHECK2(added, );
+    return;
+  }
+
+  copyTargetSet = false;
+  bool added = owner->db->AddWorkOnlyIfConnected(sources.back()->PutCopyData(owner));
+  wxCHECK2(added, );
+}
+
+void ScriptExecution::BeginGetCopyData()
+{
+  wxString filename;
+  if (copyTargetSet) {
+    // \copy has already said where the data goes
+    filename = copyFile;
+    copyTargetSet = false;
+  }
+  else {
+    wxFileDialog dialog(owner, _("Save COPY data to file (cancel to show it as a result set)"), wxEmptyString, wxEmptyString,
+                        _("All files|*"), wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (dialog.ShowModal() == wxID_OK)
+      filename = dialog.GetPath();
+  }
+
+  long rowLimit;
+  wxConfig::Get()->Read(_T("Script/RowLimit"), &rowLimit, 0L);
+  bool added = owner->db->AddWorkOnlyIfConnected(new ScriptGetCopyDataWork(owner, filename, copyColumnCount, copyBinary, rowLimit > 0 ? rowLimit : 0));
   wxCHECK2(added, );
 }
 
@@ -128,6 +389,11 @@ public:
     else
       return GetPlainString();
   }
+  wxString GetRemainder()
+  {
+    SkipWhitespace();
+    return str.Mid(ptr);
+  }
 private:
   void SkipWhitespace()
   {
@@ -203,6 +469,7 @@ ScriptExecution::NextState ScriptExecution::PsqlChangeDatabase(const wxString &p
   owner->db->Dispose();
   delete owner->db;
   owner->db = NULL;
+  owner->ForgetCursor();
   owner->ShowDisconnectedStatus();
   owner->UpdateStateInUI(); // refresh title etc
   PsqlArgumentsParser tkz(parameters);
@@ -238,6 +505,139 @@ ScriptExecution::NextState ScriptExecution::PsqlChangeDatabase(const wxString &p
   return NeedMore;
 }
 
+/**
+ * Find the FROM or TO keyword in a \copy or \pcopy command.
+ *
+ * Keywords inside quotes or parentheses (i.e. in a query or column
+ * list) are skipped.
+ *
+ * @return position of the keyword, or -1 if not found
+ */
+static int FindCopyDirection(const wxString &parameters, bool &from)
+{
+  unsigned depth = 0;
+  wxChar quote = 0;
+  for (unsigned pos = 0; pos < parameters.length(); pos++) {
+    wxChar c = parameters[pos];
+    if (quote) {
+      if (c == quote) quote = 0;
+    }
+    else if (c == _T('\'') || c == _T('"')) {
+      quote = c;
+    }
+    else if (c == _T('(')) {
+      ++depth;
+    }
+    else if (c == _T(')')) {
+      if (depth > 0) --depth;
+    }
+    else if (depth == 0 && (pos == 0 || iswspace(parameters[pos - 1]) || parameters[pos - 1] == _T(')'))) {
+      wxString rest = parameters.Mid(pos);
+      unsigned length;
+      if (rest.Lower().StartsWith(_T("from"))) {
+        length = 4;
+        from = true;
+      }
+      else if (rest.Lower().StartsWith(_T("to"))) {
+        length = 2;
+        from = false;
+      }
+      else
+        continue;
+      if (rest.length() == length || iswspace(rest[length]))
+        return pos;
+    }
+  }
+  return -1;
+}
+
+bool ScriptExecution::ParseCopyCommand(const wxString &command, const wxString &parameters, const ExecutionLexer::Token &t, CopyCommand &copy)
+{
+  int keywordPos = FindCopyDirection(parameters, copy.from);
+  if (keywordPos <= 0) {
+    ReportInternalError(wxString::Format(_("\\%s: expected table, FROM or TO, and filename"), command.c_str()), parameters, t);
+    BumpErrors();
+    return false;
+  }
+
+  PsqlArgumentsParser tkz(parameters.Mid(keywordPos + (copy.from ? 4 : 2)));
+  if (!tkz.HasMoreArguments()) {
+    ReportInternalError(wxString::Format(_("\\%s: no filename given"), command.c_str()), parameters, t);
+    BumpErrors();
+    return false;
+  }
+  copy.filename = tkz.GetNextArgument();
+  wxString lowerFilename = copy.filename.Lower();
+  if (lowerFilename == _T("program")) {
+    ReportInternalError(wxString::Format(_("\\%s: PROGRAM is not supported"), command.c_str()), parameters, t);
+    BumpErrors();
+    return false;
+  }
+  // data from stdin is inline in the script; data to stdout is shown as a result set
+  if (lowerFilename == _T("stdin") || lowerFilename == _T("stdout") || lowerFilename == _T("pstdin") || lowerFilename == _T("pstdout"))
+    copy.filename = wxEmptyString;
+
+  copy.options = tkz.GetRemainder();
+  wxString sql = _T("COPY ") + parameters.Left(keywordPos) + (copy.from ? _T("FROM STDIN ") : _T("TO STDOUT ")) + copy.options;
+  copy.sql = sql.utf8_str();
+  wxLogDebug(_T("\\%s | %s | %s"), command.c_str(), sql.c_str(), copy.filename.c_str());
+  return true;
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlCopy(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  CopyCommand copy;
+  if (!ParseCopyCommand(_T("copy"), parameters, t, copy))
+    return NeedMore;
+
+  copyTargetSet = true;
+  copyFile = copy.filename;
+  lastSql = LocationOf(t);
+  SendQuery(copy.sql);
+  return NoMore;
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlParallelCopy(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  PsqlArgumentsParser tkz(parameters);
+  long streams;
+  if (!tkz.HasMoreArguments() || !tkz.GetNextArgument().ToLong(&streams) || streams < 1) {
+    ReportInternalError(_("\\pcopy: expected number of connections, then table FROM filename"), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+
+  CopyCommand copy;
+  if (!ParseCopyCommand(_T("pcopy"), tkz.GetRemainder(), t, copy))
+    return NeedMore;
+  if (!copy.from || copy.filename.empty()) {
+    ReportInternalError(_("\\pcopy: can only load from a file"), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+  // the file is split at newlines, so every line must be a row
+  wxStringTokenizer options(copy.options.Lower(), _T(" \t\r\n(),="));
+  while (options.HasMoreTokens()) {
+    wxString option = options.GetNextToken();
+    if (option == _T("header") || option == _T("binary")) {
+      ReportInternalError(wxString::Format(_("\\pcopy: %s data can't be split between connections"), option.Upper().c_str()), parameters, t);
+      BumpErrors();
+      return NeedMore;
+    }
+  }
+
+  lastSql = LocationOf(t);
+  parallelCopy.reset(new ScriptParallelCopy(owner, owner->server, owner->db->DbName(), lastSql.position));
+  wxString error;
+  if (!parallelCopy->Start(copy.filename, copy.sql, streams, error)) {
+    parallelCopy.reset();
+    ReportInternalError(error, parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+  return NoMore;
+}
+
 ScriptExecution::NextState ScriptExecution::PsqlExecuteQueryBuffer(const wxString &parameters, const ExecutionLexer::Token &t)
 {
   BeginQuery();
@@ -246,7 +646,7 @@ ScriptExecution::NextState ScriptExecution::PsqlExecuteQueryBuffer(const wxStrin
 
 ScriptExecution::NextState ScriptExecution::PsqlPrintQueryBuffer(const wxString &parameters, const ExecutionLexer::Token &t)
 {
-  owner->GetOrCreateResultsBook()->ScriptEcho(queryBuffer, t.offset);
+  owner->GetOrCreateResultsBook()->ScriptEcho(queryBuffer, LocationOf(t).position);
   return NeedMore;
 }
 
@@ -264,42 +664,304 @@ ScriptExecution::NextState ScriptExecution::PsqlPrintMessage(const wxString &par
     if (!output.empty()) output += _T(' ');
     output += tkz.GetNextArgument();
   }
-  owner->GetOrCreateResultsBook()->ScriptEcho(output, t.offset);
+  owner->GetOrCreateResultsBook()->ScriptEcho(output, LocationOf(t).position);
   return NeedMore;
 }
 
 void ScriptExecution::ProcessQueryResult(ScriptQueryWork::Result *result)
 {
-  if (result->status == PGRES_TUPLES_OK) {
+  // the only result expected while loading in parallel is the combined one
+  parallelCopy.reset();
+  wxASSERT(!collectingParallel);
+  parallelBlock.reset();
+  benchmark.reset();
+
+  bool paged = false;
+  if (cursorDeclared && result->status == PGRES_FATAL_ERROR)
+    result->error.SkipPrefix(cursorPrefixLength);
+
+  if (result->status == PGRES_TUPLES_OK && result->streamed) {
+    // rows and completion were already delivered by ProcessRowBatch
+    wxLogDebug(_T("%s (streamed)"), result->statusTag.c_str());
+  }
+  else if (result->status == PGRES_TUPLES_OK && cursorDeclared && result->data->Rows().size() >= pageSize) {
+    wxLogDebug(_T("%s (first page of %u tuples)"), result->statusTag.c_str(), result->data->Rows().size());
+    AddRows(result->data->Rows().size());
+    owner->GetOrCreateResultsBook()->ScriptPagedResultSet(result->statusTag, result->data, lastSql.position);
+    paged = true;
+  }
+  else if (result->status == PGRES_TUPLES_OK) {
     wxLogDebug(_T("%s (%u tuples)"), result->statusTag.c_str(), result->data->Rows().size());
-    owner->GetOrCreateResultsBook()->ScriptResultSet(result->statusTag, *result->data, lastSqlPosition);
     AddRows(result->data->Rows().size());
+    owner->GetOrCreateResultsBook()->ScriptResultSet(result->statusTag, result->data, lastSql.position);
   }
   else if (result->status == PGRES_COMMAND_OK) {
     wxLogDebug(_T("%s (no tuples)"), result->statusTag.c_str());
-    owner->GetOrCreateResultsBook()->ScriptCommandCompleted(result->statusTag, lastSqlPosition);
+    owner->GetOrCreateResultsBook()->ScriptCommandCompleted(result->statusTag, lastSql.position);
   }
   else if (result->status == PGRES_FATAL_ERROR) {
     wxLogDebug(_T("Got error: %s"), result->error.GetPrimary().c_str());
-    owner->GetOrCreateResultsBook()->ScriptError(result->error, lastSqlPosition);
+    owner->GetOrCreateResultsBook()->ScriptError(result->error, lastSql.position);
+    ReportLocation(lastSql);
+    BumpErrors();
+  }
+  else if (result->status == PGRES_COPY_OUT) {
+    wxLogDebug(_T("Starting COPY to client (%d columns)"), result->copyColumnCount);
+    copyColumnCount = result->copyColumnCount;
+    copyBinary = result->copyBinary;
+  }
+
+  if (result->status != PGRES_COPY_OUT && result->status != PGRES_COPY_IN)
+    copyTargetSet = false;
+
+  if (!result->copyError.empty()) {
+    ReportInternalError(result->copyError, wxEmptyString, lastSql.position);
+    ReportLocation(lastSql);
     BumpErrors();
   }
+  if (!result->copySummary.empty()) {
+    owner->GetOrCreateResultsBook()->ScriptEcho(result->copySummary, lastSql.position);
+  }
 
   owner->UpdateConnectionState(result->newConnectionState);
   owner->ShowTransactionStatus();
 
+  if (cursorDeclared) {
+    cursorDeclared = false;
+    // all the rows came in the first page, or the query failed
+    if (!paged) owner->CloseCursor();
+  }
+
   delete result;
 }
 
+void ScriptExecution::ProcessPipelineResults(ScriptPipelineResults *results)
+{
+  wxASSERT(results->results.size() <= pipelineSentLocations.size());
+  for (unsigned i = 0; i < results->results.size(); i++) {
+    lastSql = pipelineSentLocations[i];
+    ProcessQueryResult(results->results[i]);
+    results->results[i] = NULL;
+  }
+
+  pipelineSentLocations.clear();
+  delete results;
+}
+
+void ScriptExecution::ProcessRowBatch(ScriptRowBatch *rows)
+{
+  ResultsNotebook *results = owner->GetOrCreateResultsBook();
+  if (rows->data.get() != NULL) {
+    AddRows(rows->data->Rows().size());
+    results->ScriptResultSetRows(rows->data, lastSql.position);
+  }
+  if (rows->finished)
+    results->ScriptResultSetFinished(rows->statusTag, rows->discardedRows, lastSql.position);
+
+  delete rows;
+}
+
 void ScriptExecution::ProcessConnectionNotice(const PgError& error)
 {
-  owner->GetOrCreateResultsBook()->ScriptQueryNotice(error, lastSqlPosition);
+  owner->GetOrCreateResultsBook()->ScriptQueryNotice(error, lastSql.position);
 }
 
 ScriptExecution::NextState ScriptExecution::PsqlQuitExecution(const wxString &parameters, const ExecutionLexer::Token &t)
 {
   return Finish;
 }
+
+/**
+ * Interpret a psql boolean variable value, where setting it with no value also means true.
+ */
+static bool PsqlBooleanValue(const wxString &value)
+{
+  wxString lower = value.Lower();
+  return lower.empty() || lower == _T("on") || lower == _T("true") || lower == _T("yes") || lower == _T("1");
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlSetVariable(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  PsqlArgumentsParser tkz(parameters);
+  if (!tkz.HasMoreArguments())
+    return NeedMore;
+  wxString name = tkz.GetNextArgument();
+  wxString value;
+  while (tkz.HasMoreArguments())
+    value += tkz.GetNextArgument();
+
+  // variables are not interpolated, so only the ones that control execution matter
+  if (name == _T("ON_ERROR_STOP"))
+    stopOnError = PsqlBooleanValue(value);
+  return NeedMore;
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlUnsetVariable(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  PsqlArgumentsParser tkz(parameters);
+  if (tkz.HasMoreArguments() && tkz.GetNextArgument() == _T("ON_ERROR_STOP"))
+    stopOnError = false;
+  return NeedMore;
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlInclude(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  return Include(_T("i"), parameters, t, false);
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlIncludeRelative(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  return Include(_T("ir"), parameters, t, true);
+}
+
+/**
+ * Execute a file in place of the include command.
+ *
+ * The file is mapped into memory rather than read, so a large dump
+ * can be included without loading it all.
+ *
+ * @param relative Resolve the filename relative to the directory of the including file
+ */
+ScriptExecution::NextState ScriptExecution::Include(const wxString &command, const wxString &parameters, const ExecutionLexer::Token &t, bool relative)
+{
+  PsqlArgumentsParser tkz(parameters);
+  if (!tkz.HasMoreArguments()) {
+    ReportInternalError(wxString::Format(_("\\%s: no filename given"), command.c_str()), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+  if (sources.size() > MaxIncludeDepth) {
+    ReportInternalError(wxString::Format(_("\\%s: files nested too deeply"), command.c_str()), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+
+  wxFileName filename(tkz.GetNextArgument());
+  if (relative) {
+    wxString including = sources.back()->GetFilename();
+    if (including.empty()) including = owner->scriptFilename;
+    if (!including.empty()) filename.MakeAbsolute(wxFileName(including).GetPath());
+  }
+
+  std::auto_ptr<MappedScriptSource> source(new MappedScriptSource(filename.GetFullPath()));
+  wxString error;
+  if (!source->Open(error)) {
+    ReportInternalError(error, parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+
+  sources.push_back(source.release());
+  return NeedMore;
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlBeginParallel(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  PsqlArgumentsParser tkz(parameters);
+  long connections;
+  if (!tkz.HasMoreArguments() || !tkz.GetNextArgument().ToLong(&connections) || connections < 1) {
+    ReportInternalError(_("\\parallel: expected number of connections"), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+
+  parallelBlock.reset(new ScriptParallelBlock(owner, connections, stopOnError));
+  collectingParallel = true;
+  parallelLocation = LocationOf(t);
+  return NeedMore;
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlEndParallel(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  if (!collectingParallel) {
+    ReportInternalError(_("\\endparallel without \\parallel"), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+  return ExecuteParallelBlock();
+}
+
+/**
+ * Add the statement in the query buffer to the \parallel block being gathered.
+ */
+ScriptExecution::NextState ScriptExecution::AddParallelStatement()
+{
+  queryBufferExecuted = true;
+  if (!CanPipeline()) {
+    ReportInternalError(_("COPY can't be used inside a \\parallel block"), queryBuffer, lastSql.position);
+    ReportLocation(lastSql);
+    BumpErrors();
+    return NeedMore;
+  }
+  parallelBlock->Add(ScriptParallelBlock::Statement(queryBuffer, lastSql.position, DescribeLocation(lastSql)));
+  return NeedMore;
+}
+
+ScriptExecution::NextState ScriptExecution::ExecuteParallelBlock()
+{
+  collectingParallel = false;
+  // a statement without a terminating semicolon still belongs to the block
+  if (!queryBuffer.empty() && !queryBufferExecuted)
+    AddParallelStatement();
+
+  if (parallelBlock->empty()) {
+    parallelBlock.reset();
+    return NeedMore;
+  }
+
+  // the combined result is reported against the \parallel command
+  lastSql = parallelLocation;
+  parallelBlock->Start(owner->server, owner->db->DbName());
+  return NoMore;
+}
+
+ScriptExecution::NextState ScriptExecution::PsqlBenchmark(const wxString &parameters, const ExecutionLexer::Token &t)
+{
+  ScriptBenchmark::Settings settings;
+  PsqlArgumentsParser tkz(parameters);
+  while (tkz.HasMoreArguments()) {
+    wxString arg = tkz.GetNextArgument();
+    wxString name = arg.BeforeFirst(_T('=')).Lower();
+    wxString value = arg.AfterFirst(_T('='));
+    unsigned long number;
+    if (!value.ToULong(&number)) {
+      ReportInternalError(wxString::Format(_("\\bench: invalid option \"%s\""), arg.c_str()), parameters, t);
+      BumpErrors();
+      return NeedMore;
+    }
+    if (name == _T("count") && number > 0)
+      settings.executions = number;
+    else if (name == _T("duration") && number > 0)
+      settings.duration = number;
+    else if (name == _T("warmup"))
+      settings.warmup = number;
+    else if (name == _T("connections") && number > 0)
+      settings.connections = number;
+    else {
+      ReportInternalError(wxString::Format(_("\\bench: invalid option \"%s\""), arg.c_str()), parameters, t);
+      BumpErrors();
+      return NeedMore;
+    }
+  }
+
+  if (queryBuffer.empty()) {
+    ReportInternalError(_("\\bench: query buffer is empty"), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+  if (!CanPipeline()) {
+    ReportInternalError(_("\\bench: COPY can't be benchmarked"), parameters, t);
+    BumpErrors();
+    return NeedMore;
+  }
+
+  owner->CloseCursor();
+  queryBufferExecuted = true;
+  benchmark.reset(new ScriptBenchmark(owner, queryBuffer, settings, lastSql.position));
+  benchmark->Start(owner->server, owner->db->DbName());
+  return NoMore;
+}
+
 // Local Variables:
 // mode: c++
 // indent-tabs-mode: nil
@@ -8,7 +8,11 @@
 
 #include <map>
 #include "execution_lexer.h"
+#include "script_source.h"
 #include "script_query_work.h"
+#include "script_parallel_copy.h"
+#include "script_parallel_block.h"
+#include "script_benchmark.h"
 
 class ScriptEditorPane;
 
@@ -17,19 +21,29 @@ class ScriptEditorPane;
  */
 class ScriptExecution {
 public:
-  ScriptExecution(ScriptEditorPane *owner, wxCharBuffer buffer, unsigned length) :
-    owner(owner), buffer(buffer),
-    queryBuffer(this->buffer.data()),
-    lexer(this->buffer.data(), length),
-    lastSqlPosition(0), queryBufferExecuted(false),
-    rowsRetrieved(0), errorsEncountered(0)
+  /**
+   * Create execution of a script.
+   *
+   * @param source Script text, which the execution takes ownership of
+   */
+  ScriptExecution(ScriptEditorPane *owner, ScriptSource *source) :
+    owner(owner), sources(1, source),
+    queryBufferExecuted(false),
+    rowsRetrieved(0), errorsEncountered(0), copyColumnCount(0), copyBinary(false), copyTargetSet(false),
+    stopOnError(false), queryPending(false), cursorDeclared(false), cursorPrefixLength(0), collectingParallel(false)
   {
     stopwatch.Start();
+    ReadSettings();
   }
+  ~ScriptExecution();
 
   bool EncounteredErrors() const { return errorsEncountered > 0; }
   unsigned TotalRows() const { return rowsRetrieved; }
   long ElapsedTime() const { return stopwatch.Time(); }
+  /**
+   * @return description of how far through a file execution has got, or empty
+   */
+  wxString DescribeProgress() const { return sources.front()->DescribeProgress(); }
 
   /**
    * Work through the script buffer, and dispatch work to database connection as applicable.
@@ -50,6 +64,16 @@ public:
    */
   void ProcessQueryResult(ScriptQueryWork::Result*);
 
+  /**
+   * Process results of statements executed in pipeline mode by a database thread.
+   */
+  void ProcessPipelineResults(ScriptPipelineResults*);
+
+  /**
+   * Process a batch of rows streamed by a database thread.
+   */
+  void ProcessRowBatch(ScriptRowBatch*);
+
   /**
    * Process notice message received while running query.
    */
@@ -58,82 +82,90 @@ public:
 private:
   class QueryBuffer {
   public:
-    QueryBuffer(const char *buffer) : buffer(buffer) {}
     bool empty() const
     {
-      return tokens.empty() || !NonEmptyTokenExists();
+      return text.empty();
     }
     void clear()
     {
-      tokens.clear();
+      text.clear();
     }
-    void operator=(const ExecutionLexer::Token& t)
+    void operator=(const std::string& sql)
     {
-      tokens.clear();
-      tokens.push_back(t);
+      text = sql;
     }
-    void operator+=(const ExecutionLexer::Token& t)
+    void operator+=(const std::string& sql)
     {
-      tokens.push_back(t);
+      text += sql;
     }
     unsigned length() const
     {
-      return std::for_each(tokens.begin(), tokens.end(), AccumulateLength()).length;
+      return text.length();
     }
     operator std::string()
     {
-      return std::for_each(tokens.begin(), tokens.end(), AccumulateContent(buffer, length())).str;
+      return text;
     }
     operator wxString()
     {
-      std::string str = *this;
-      return wxString(str.c_str(), wxConvUTF8);
+      return wxString(text.c_str(), wxConvUTF8);
     }
 
   private:
-    const char * const buffer;
-    std::vector<ExecutionLexer::Token> tokens;
-    static bool TokenIsNonEmpty(const ExecutionLexer::Token& t)
-    {
-      return t.length > 0;
-    }
-    class AccumulateLength {
-    public:
-      AccumulateLength() : length(0) {}
-      void operator()(const ExecutionLexer::Token& t)
-      {
-        length += t.length;
-      }
-      unsigned length;
-    };
-    class AccumulateContent {
-    public:
-      AccumulateContent(const char* buffer) : buffer(buffer) {}
-      AccumulateContent(const char* buffer, unsigned length) : buffer(buffer)
-      {
-        str.reserve(length);
-      }
-      void operator()(const ExecutionLexer::Token& t)
-      {
-        str.append(buffer + t.offset, t.length);
-      }
-      std::string str;
-    private:
-      const char* const buffer;
-    };
-    bool NonEmptyTokenExists() const
-    {
-      return std::find_if(tokens.begin(), tokens.end(), TokenIsNonEmpty) != tokens.end();
-    }
+    // copied out of the script, since the script may be read a window at a time
+    std::string text;
+  };
+
+  /**
+   * Where a statement came from, for reporting its results.
+   */
+  class SqlLocation {
+  public:
+    SqlLocation() : position(0), line(0) {}
+    /**
+     * Position in the editor, or ResultsNotebook::NoScriptPosition for a statement from a file.
+     */
+    unsigned position;
+    /**
+     * File the statement was read from, or empty for the editor.
+     */
+    wxString file;
+    unsigned long line;
   };
 
   ScriptEditorPane *owner;
-  wxCharBuffer buffer;
+  /**
+   * Script being executed, followed by any files it has included.
+   */
+  std::vector<ScriptSource*> sources;
   QueryBuffer queryBuffer;
-  ExecutionLexer lexer;
-  unsigned lastSqlPosition;
+  SqlLocation lastSql;
   bool queryBufferExecuted;
   unsigned rowsRetrieved, errorsEncountered;
+  unsigned copyColumnCount;
+  bool copyBinary;
+  bool copyTargetSet;
+  wxString copyFile;
+  std::auto_ptr<ScriptParallelCopy> parallelCopy;
+  bool stopOnError;
+  bool pipelining;
+  unsigned pipelineWindow;
+  std::vector<std::string> pipelineStatements;
+  std::vector<SqlLocation> pipelineLocations;
+  std::vector<SqlLocation> pipelineSentLocations;
+  std::vector<ExecutionLexer::Token> heldTokens;
+  bool queryPending;
+  bool pageResults;
+  unsigned pageSize;
+  bool cursorDeclared;
+  unsigned cursorPrefixLength;
+  /**
+   * Statements of a \parallel block, gathered until \endparallel and then executed.
+   */
+  std::auto_ptr<ScriptParallelBlock> parallelBlock;
+  bool collectingParallel;
+  SqlLocation parallelLocation;
+  std::auto_ptr<ScriptBenchmark> benchmark;
   wxStopWatch stopwatch;
 
   enum NextState {
@@ -146,38 +178,88 @@ private:
   static const std::map<wxString, PsqlCommandHandler> psqlCommandHandlers;
   static std::map<wxString, PsqlCommandHandler> InitPsqlCommandHandlers();
 
+  NextState PsqlCopy(const wxString &args, const ExecutionLexer::Token &t);
+  NextState PsqlParallelCopy(const wxString &args, const ExecutionLexer::Token &t);
   NextState PsqlChangeDatabase(const wxString &args, const ExecutionLexer::Token &t);
   NextState PsqlExecuteQueryBuffer(const wxString &args, const ExecutionLexer::Token &t);
   NextState PsqlPrintQueryBuffer(const wxString &args, const ExecutionLexer::Token &t);
   NextState PsqlResetQueryBuffer(const wxString &args, const ExecutionLexer::Token &t);
   NextState PsqlPrintMessage(const wxString &args, const ExecutionLexer::Token &t);
   NextState PsqlQuitExecution(const wxString &args, const ExecutionLexer::Token &t);
+  NextState PsqlSetVariable(const wxString &args, const ExecutionLexer::Token &t);
+  NextState PsqlUnsetVariable(const wxString &args, const ExecutionLexer::Token &t);
+  NextState PsqlInclude(const wxString &args, const ExecutionLexer::Token &t);
+  NextState PsqlIncludeRelative(const wxString &args, const ExecutionLexer::Token &t);
+  NextState Include(const wxString &command, const wxString &args, const ExecutionLexer::Token &t, bool relative);
+  NextState PsqlBeginParallel(const wxString &args, const ExecutionLexer::Token &t);
+  NextState PsqlEndParallel(const wxString &args, const ExecutionLexer::Token &t);
+  NextState AddParallelStatement();
+  NextState ExecuteParallelBlock();
+  NextState PsqlBenchmark(const wxString &args, const ExecutionLexer::Token &t);
+
+  /**
+   * Limit on files including each other, to catch a file that includes itself.
+   */
+  static const unsigned MaxIncludeDepth = 16;
 
   NextState ProcessExecution();
   void FinishExecution();
+  void ReadSettings();
+  NextState ExecuteStatement();
+  bool CanPipeline();
+  bool CanPageResults();
+  void SendPipeline();
   void BeginQuery();
+  void SendQuery(const std::string &sql);
   void BeginPutCopyData();
+  void BeginGetCopyData();
+
+  /**
+   * A \copy command, rewritten as a COPY to or from the client.
+   */
+  class CopyCommand {
+  public:
+    bool from;
+    wxString filename;
+    wxString options;
+    std::string sql;
+  };
+  bool ParseCopyCommand(const wxString &command, const wxString &parameters, const ExecutionLexer::Token &t, CopyCommand &copy);
 
   void ReportInternalError(const wxString &error, const wxString &command, unsigned scriptPosition);
+  void ReportInternalError(const wxString &error, const wxString &command, const ExecutionLexer::Token &t);
+  void ReportLocation(const SqlLocation &location);
+  wxString DescribeLocation(const SqlLocation &location);
+  SqlLocation LocationOf(const ExecutionLexer::Token &t);
 
-  wxString GetWXString(const ExecutionLexer::Token &token) const { return lexer.GetWXString(token); }
+  wxString GetWXString(const ExecutionLexer::Token &token) const { return sources.back()->GetWXString(token); }
 
-  ExecutionLexer::Token NextToken() { return lexer.Pull(); }
-  ExecutionLexer::Token CopyDataToken() { return lexer.ReadCopyData(); }
+  ExecutionLexer::Token PullToken();
+  ExecutionLexer::Token NextToken()
+  {
+    if (heldTokens.empty()) return PullToken();
+    ExecutionLexer::Token t = heldTokens.back();
+    heldTokens.pop_back();
+    return t;
+  }
+  /**
+   * Return a token to be pulled again, once the statements already
+   * pipelined have completed.
+   */
+  void HoldToken(const ExecutionLexer::Token &t) { heldTokens.push_back(t); }
 
-  void AppendSql(const ExecutionLexer::Token& token)
+  void AppendSql(const ExecutionLexer::Token& token, const std::string &sql)
   {
     if (queryBuffer.empty() || queryBufferExecuted) {
       queryBufferExecuted = false;
-      queryBuffer = token;
-      lastSqlPosition = token.offset;
+      queryBuffer = sql;
+      lastSql = LocationOf(token);
     }
     else {
-      queryBuffer += token;
+      queryBuffer += sql;
     }
   }
 
-  char CharAt(unsigned offset) const { return buffer.data()[offset]; }
   void BumpErrors() { ++errorsEncountered; }
   void AddRows(unsigned rows) { rowsRetrieved += rows; }
 };
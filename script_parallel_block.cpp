@@ -0,0 +1,164 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#include "script_parallel_block.h"
+#include "script_editor_pane.h"
+#include "results_notebook.h"
+
+BEGIN_EVENT_TABLE(ScriptParallelBlock, wxEvtHandler)
+  PQWX_SCRIPT_QUERY_COMPLETE(wxID_ANY, ScriptParallelBlock::OnStatementComplete)
+END_EVENT_TABLE()
+
+ScriptParallelBlock::~ScriptParallelBlock()
+{
+  for (std::vector<Connection>::iterator iter = connections.begin(); iter != connections.end(); iter++) {
+    if (iter->db != NULL) {
+      iter->db->Dispose();
+      delete iter->db;
+    }
+  }
+}
+
+void ScriptParallelBlock::Start(const ServerConnection &server, const wxString &dbname)
+{
+  wxASSERT(!statements.empty());
+  for (unsigned i = 0; i < statements.size(); i++)
+    pending.push_back(i);
+
+  connections.resize(connectionCount < statements.size() ? connectionCount : statements.size());
+  stopwatch.Start();
+  for (unsigned i = 0; i < connections.size(); i++) {
+    Connection &connection = connections[i];
+    connection.db = new DatabaseConnection(server, dbname);
+    connection.db->Connect(new BlockConnectionCallback(this, i));
+    connection.db->Relabel(wxString::Format(_("Parallel %u"), i + 1));
+    // queued until the connection is made
+    Dispatch(i);
+  }
+
+  wxLogDebug(_T("Executing %u statements over %u connections"), statements.size(), connections.size());
+}
+
+void ScriptParallelBlock::Dispatch(unsigned index)
+{
+  Connection &connection = connections[index];
+  connection.statement = -1;
+  if (connection.failed || pending.empty()) return;
+  if (stopOnError && failedStatements > 0) return;
+
+  connection.statement = pending.front();
+  pending.pop_front();
+  connection.db->AddWork(new ScriptQueryWork(this, statements[connection.statement].sql, false, 0, connection.statement));
+}
+
+void ScriptParallelBlock::PostConnectionFailure(int connection, const wxString &message)
+{
+  ScriptExecutionWork::Result *result = new ScriptExecutionWork::Result();
+  result->copyError = wxString::Format(_("Unable to connect: %s"), message.c_str());
+  wxCommandEvent event(PQWX_ScriptQueryComplete);
+  event.SetClientData(result);
+  // no statement: the connection is identified instead
+  event.SetInt(-1);
+  event.SetExtraLong(connection);
+  AddPendingEvent(event);
+}
+
+void ScriptParallelBlock::ReportResult(const Statement &statement, ScriptExecutionWork::Result *result)
+{
+  ResultsNotebook *results = owner->GetOrCreateResultsBook();
+
+  if (result->status == PGRES_TUPLES_OK) {
+    results->ScriptResultSet(result->statusTag, result->data, statement.scriptPosition);
+  }
+  else if (result->status == PGRES_COMMAND_OK) {
+    results->ScriptCommandCompleted(result->statusTag, statement.scriptPosition);
+  }
+  else if (result->status == PGRES_FATAL_ERROR) {
+    results->ScriptError(result->error, statement.scriptPosition);
+    if (!statement.location.empty())
+      results->ScriptEcho(statement.location, statement.scriptPosition);
+    ++failedStatements;
+  }
+}
+
+void ScriptParallelBlock::OnStatementComplete(wxCommandEvent &event)
+{
+  ScriptExecutionWork::Result *result = (ScriptExecutionWork::Result*) event.GetClientData();
+  wxASSERT(result != NULL);
+
+  if (event.GetInt() < 0) {
+    unsigned index = event.GetExtraLong();
+    wxASSERT(index < connections.size());
+    Connection &connection = connections[index];
+    unsigned scriptPosition = connection.statement >= 0 ? statements[connection.statement].scriptPosition : ResultsNotebook::NoScriptPosition;
+    owner->GetOrCreateResultsBook()->ScriptInternalError(wxString::Format(_("Connection %u: %s"), index + 1, result->copyError.c_str()), scriptPosition);
+    connection.failed = true;
+    if (connection.statement >= 0) {
+      // give the statement to one of the other connections, starting it now if one is idle
+      pending.push_front(connection.statement);
+      connection.statement = -1;
+      for (unsigned i = 0; i < connections.size(); i++) {
+        if (!connections[i].failed && connections[i].statement < 0) {
+          Dispatch(i);
+          break;
+        }
+      }
+    }
+  }
+  else {
+    unsigned index = 0;
+    while (index < connections.size() && connections[index].statement != event.GetInt())
+      ++index;
+    wxASSERT(index < connections.size());
+    ReportResult(statements[event.GetInt()], result);
+    ++completedStatements;
+    Dispatch(index);
+  }
+  delete result;
+
+  if (!Running())
+    Finish();
+}
+
+bool ScriptParallelBlock::Running() const
+{
+  for (std::vector<Connection>::const_iterator iter = connections.begin(); iter != connections.end(); iter++) {
+    if (iter->statement >= 0) return true;
+  }
+  return false;
+}
+
+void ScriptParallelBlock::Finish()
+{
+  ScriptExecutionWork::Result *result = new ScriptExecutionWork::Result();
+  result->newConnectionState = owner->GetConnectionState();
+  result->elapsed = stopwatch.Time();
+  result->complete = true;
+  // each statement has already reported its own results, so there is only a summary to show
+  result->status = PGRES_EMPTY_QUERY;
+
+  unsigned notExecuted = statements.size() - completedStatements;
+  if (failedStatements > 0 || notExecuted > 0) {
+    result->copyError = wxString::Format(_("%u of %u statements failed"), failedStatements, statements.size());
+    if (notExecuted > 0)
+      result->copyError << wxString::Format(_(", %u not executed"), notExecuted);
+  }
+  else {
+    result->copySummary = wxString::Format(_("%u statements executed over %u connections in %ldms"),
+                                           statements.size(), connections.size(), result->elapsed);
+  }
+
+  wxCommandEvent event(PQWX_ScriptQueryComplete);
+  event.SetClientData(result);
+  owner->AddPendingEvent(event);
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
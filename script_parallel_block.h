@@ -0,0 +1,134 @@
+/**
+ * @file
+ * Running independent statements from a script over several connections at once.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __script_parallel_block_h
+#define __script_parallel_block_h
+
+#include <vector>
+#include <deque>
+#include <string>
+#include "wx/event.h"
+#include "wx/stopwatch.h"
+#include "server_connection.h"
+#include "database_connection.h"
+#include "script_query_work.h"
+
+class ScriptEditorPane;
+
+/**
+ * Execute the statements of a \parallel block over several connections at once.
+ *
+ * Each connection takes the next statement from the block as soon as
+ * it has finished its previous one, so statements start in script
+ * order but may finish in any order. Each statement's results are
+ * shown as it finishes, against its own position in the script.
+ *
+ * The statements run in separate sessions, so they each commit
+ * independently, and settings made on the script's own connection do
+ * not apply to them.
+ *
+ * When all the statements have finished, a combined result is posted
+ * to the script editor, summarising the block.
+ */
+class ScriptParallelBlock : public wxEvtHandler {
+public:
+  /**
+   * A statement from the block.
+   */
+  class Statement {
+  public:
+    Statement(const std::string &sql, unsigned scriptPosition, const wxString &location) :
+      sql(sql), scriptPosition(scriptPosition), location(location) {}
+    std::string sql;
+    /**
+     * Position of the statement in the script, for messages.
+     */
+    unsigned scriptPosition;
+    /**
+     * Where the statement was read from a file, or empty for the editor.
+     */
+    wxString location;
+  };
+
+  /**
+   * Create block.
+   *
+   * @param connectionCount Number of connections to use: fewer are used for fewer statements
+   * @param stopOnError Start no more statements once one has failed
+   */
+  ScriptParallelBlock(ScriptEditorPane *owner, unsigned connectionCount, bool stopOnError) :
+    owner(owner), connectionCount(connectionCount), stopOnError(stopOnError), completedStatements(0), failedStatements(0) {}
+  ~ScriptParallelBlock();
+
+  /**
+   * Add a statement to the block.
+   */
+  void Add(const Statement &statement) { statements.push_back(statement); }
+  /**
+   * @return true if no statements have been added
+   */
+  bool empty() const { return statements.empty(); }
+
+  /**
+   * Open the connections and start executing statements.
+   *
+   * @param server Server to connect to, with the script's credentials
+   * @param dbname Database to connect to
+   */
+  void Start(const ServerConnection &server, const wxString &dbname);
+
+private:
+  class Connection {
+  public:
+    Connection() : db(NULL), statement(-1), failed(false) {}
+    DatabaseConnection *db;
+    /**
+     * Statement being executed, or -1 if none.
+     */
+    int statement;
+    bool failed;
+  };
+
+  class BlockConnectionCallback : public ConnectionCallback {
+  public:
+    BlockConnectionCallback(ScriptParallelBlock *owner, int connection) : owner(owner), connection(connection) {}
+    void OnConnection(bool usedPassword) {}
+    void OnConnectionFailed(const PgError& error) { owner->PostConnectionFailure(connection, error.GetPrimary()); }
+    void OnConnectionNeedsPassword() { owner->PostConnectionFailure(connection, _("a password is required")); }
+  private:
+    ScriptParallelBlock * const owner;
+    const int connection;
+  };
+
+  ScriptEditorPane * const owner;
+  const unsigned connectionCount;
+  const bool stopOnError;
+  std::vector<Statement> statements;
+  /**
+   * Statements not yet started, in script order.
+   */
+  std::deque<unsigned> pending;
+  std::vector<Connection> connections;
+  unsigned completedStatements, failedStatements;
+  wxStopWatch stopwatch;
+
+  void Dispatch(unsigned connection);
+  void PostConnectionFailure(int connection, const wxString &message);
+  void ReportResult(const Statement &statement, ScriptExecutionWork::Result *result);
+  bool Running() const;
+  void Finish();
+
+  void OnStatementComplete(wxCommandEvent &event);
+
+  DECLARE_EVENT_TABLE()
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,200 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#include "wx/filename.h"
+#include "script_parallel_copy.h"
+#include "script_editor_pane.h"
+#include "results_notebook.h"
+
+BEGIN_EVENT_TABLE(ScriptParallelCopy, wxEvtHandler)
+  PQWX_SCRIPT_COPY_PROGRESS(wxID_ANY, ScriptParallelCopy::OnCopyProgress)
+  PQWX_SCRIPT_QUERY_COMPLETE(wxID_ANY, ScriptParallelCopy::OnStreamComplete)
+END_EVENT_TABLE()
+
+ScriptParallelCopy::~ScriptParallelCopy()
+{
+  for (std::vector<Stream>::iterator iter = streams.begin(); iter != streams.end(); iter++) {
+    if (iter->db != NULL) {
+      iter->db->Dispose();
+      delete iter->db;
+    }
+  }
+}
+
+bool ScriptParallelCopy::Start(const wxString &filename_, const std::string &copySql, unsigned streamCount, wxString &error)
+{
+  filename = filename_;
+
+  wxFile file;
+  {
+    wxLogNull noLogging;
+    if (!file.Open(filename)) {
+      error = wxString::Format(_("Unable to open %s"), filename.c_str());
+      return false;
+    }
+  }
+  wxFileOffset size = file.Length();
+  if (size == wxInvalidOffset) {
+    error = wxString::Format(_("Unable to read %s"), filename.c_str());
+    return false;
+  }
+
+  wxFileOffset worthwhile = size / MinimumChunkSize;
+  if ((wxFileOffset) streamCount > worthwhile) streamCount = worthwhile > 1 ? (unsigned) worthwhile : 1;
+
+  std::vector<wxFileOffset> boundaries;
+  boundaries.push_back(0);
+  for (unsigned i = 1; i < streamCount; i++) {
+    wxFileOffset boundary = FindLineStart(file, size * i / streamCount, size);
+    if (boundary == wxInvalidOffset) {
+      error = wxString::Format(_("Unable to read %s"), filename.c_str());
+      return false;
+    }
+    if (boundary > boundaries.back() && boundary < size)
+      boundaries.push_back(boundary);
+  }
+  boundaries.push_back(size);
+  file.Close();
+
+  streams.resize(boundaries.size() - 1);
+  stopwatch.Start();
+  for (unsigned i = 0; i < streams.size(); i++) {
+    Stream &stream = streams[i];
+    stream.start = boundaries[i];
+    stream.length = boundaries[i + 1] - boundaries[i];
+    stream.db = new DatabaseConnection(server, dbname);
+    stream.db->Connect(new StreamConnectionCallback(this, i));
+    stream.db->Relabel(wxString::Format(_("Bulk load %u"), i + 1));
+    stream.db->AddWork(new ScriptPutCopyFileWork(this, filename, copySql, stream.start, stream.length, i));
+  }
+
+  wxLogDebug(_T("Loading %s (%s) over %u connections"), filename.c_str(), wxFileName::GetHumanReadableSize(wxULongLong(size)).c_str(), streams.size());
+  return true;
+}
+
+wxFileOffset ScriptParallelCopy::FindLineStart(wxFile &file, wxFileOffset offset, wxFileOffset size)
+{
+  wxLogNull noLogging;
+  if (file.Seek(offset) == wxInvalidOffset) return wxInvalidOffset;
+
+  char buffer[4096];
+  while (offset < size) {
+    ssize_t got = file.Read(buffer, sizeof(buffer));
+    if (got == wxInvalidOffset) return wxInvalidOffset;
+    if (got == 0) break;
+    for (ssize_t i = 0; i < got; i++) {
+      if (buffer[i] == '\n') return offset + i + 1;
+    }
+    offset += got;
+  }
+  return size;
+}
+
+void ScriptParallelCopy::PostConnectionFailure(int stream, const wxString &message)
+{
+  ScriptExecutionWork::Result *result = new ScriptExecutionWork::Result();
+  result->copyError = wxString::Format(_("Unable to connect: %s"), message.c_str());
+  wxCommandEvent event(PQWX_ScriptQueryComplete);
+  event.SetClientData(result);
+  event.SetInt(stream);
+  AddPendingEvent(event);
+}
+
+wxString ScriptParallelCopy::DescribeRates() const
+{
+  long elapsed = stopwatch.Time();
+  if (elapsed <= 0) return wxEmptyString;
+  wxString rates;
+  for (std::vector<Stream>::const_iterator iter = streams.begin(); iter != streams.end(); iter++) {
+    if (!rates.empty()) rates << _T(", ");
+    rates << (unsigned long) ((double) iter->rows * 1000 / elapsed);
+  }
+  return wxString::Format(_("rows/s per stream: %s"), rates.c_str());
+}
+
+void ScriptParallelCopy::OnCopyProgress(wxCommandEvent &event)
+{
+  ScriptCopyProgress *progress = (ScriptCopyProgress*) event.GetClientData();
+  wxASSERT(progress != NULL);
+  wxASSERT(event.GetInt() >= 0 && (unsigned) event.GetInt() < streams.size());
+
+  Stream &stream = streams[event.GetInt()];
+  stream.bytes = progress->bytes;
+  stream.rows = progress->rows;
+  delete progress;
+
+  wxULongLong bytes = 0;
+  unsigned long rows = 0;
+  for (std::vector<Stream>::const_iterator iter = streams.begin(); iter != streams.end(); iter++) {
+    bytes += iter->bytes;
+    rows += iter->rows;
+  }
+
+  wxCommandEvent summary(PQWX_ScriptCopyProgress);
+  summary.SetClientData(new ScriptCopyProgress(bytes, rows, DescribeRates()));
+  owner->AddPendingEvent(summary);
+}
+
+void ScriptParallelCopy::OnStreamComplete(wxCommandEvent &event)
+{
+  ScriptExecutionWork::Result *result = (ScriptExecutionWork::Result*) event.GetClientData();
+  wxASSERT(result != NULL);
+  unsigned stream = event.GetInt() + 1;
+  ResultsNotebook *results = owner->GetOrCreateResultsBook();
+
+  if (!result->copyError.empty()) {
+    results->ScriptInternalError(wxString::Format(_("Stream %u: %s"), stream, result->copyError.c_str()), scriptPosition);
+    ++failedStreams;
+  }
+  else if (result->status == PGRES_FATAL_ERROR) {
+    results->ScriptError(result->error, scriptPosition);
+    ++failedStreams;
+  }
+  else {
+    unsigned long rows = result->tuplesProcessedCountValid ? result->tuplesProcessedCount : 0;
+    totalRows += rows;
+    long elapsed = result->elapsed > 0 ? result->elapsed : 1;
+    results->ScriptEcho(wxString::Format(_("Stream %u: %s, %lu rows (%lu rows/s)"), stream, result->copySummary.c_str(),
+                                         rows, (unsigned long) ((double) rows * 1000 / elapsed)), scriptPosition);
+  }
+  delete result;
+
+  if (++finishedStreams == streams.size())
+    Finish();
+}
+
+void ScriptParallelCopy::Finish()
+{
+  ScriptExecutionWork::Result *result = new ScriptExecutionWork::Result();
+  result->newConnectionState = owner->GetConnectionState();
+  result->elapsed = stopwatch.Time();
+  result->complete = true;
+  if (failedStreams > 0) {
+    result->copyError = wxString::Format(_("%u of %u streams failed to load %s"), failedStreams, streams.size(), filename.c_str());
+  }
+  else {
+    wxULongLong bytes = 0;
+    for (std::vector<Stream>::const_iterator iter = streams.begin(); iter != streams.end(); iter++)
+      bytes += iter->bytes;
+    long elapsed = result->elapsed > 0 ? result->elapsed : 1;
+    result->status = PGRES_COMMAND_OK;
+    result->statusTag = wxString::Format(_T("COPY %lu"), totalRows);
+    result->copySummary = wxString::Format(_("%s loaded from %s over %u connections, %lu rows/s"),
+                                           wxFileName::GetHumanReadableSize(bytes).c_str(), filename.c_str(), streams.size(),
+                                           (unsigned long) ((double) totalRows * 1000 / elapsed));
+  }
+
+  wxCommandEvent event(PQWX_ScriptQueryComplete);
+  event.SetClientData(result);
+  owner->AddPendingEvent(event);
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
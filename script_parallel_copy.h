@@ -0,0 +1,115 @@
+/**
+ * @file
+ * Loading a file into a table over several connections at once.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __script_parallel_copy_h
+#define __script_parallel_copy_h
+
+#include <vector>
+#include <string>
+#include "wx/event.h"
+#include "wx/longlong.h"
+#include "wx/file.h"
+#include "wx/stopwatch.h"
+#include "server_connection.h"
+#include "database_connection.h"
+#include "script_query_work.h"
+
+class ScriptEditorPane;
+
+/**
+ * Load a delimited file into a table over several connections at once.
+ *
+ * The file is split into roughly equal chunks at line boundaries, and
+ * each chunk is sent by its own COPY on its own connection, so a load
+ * that is limited by a single stream's round trips can use several.
+ *
+ * The streams commit independently. To load all-or-nothing, load into
+ * a staging table, and merge that into the target table afterwards.
+ *
+ * Each line is assumed to be one row, so CSV with quoted newlines
+ * can't be split like this, and neither can binary data or a file
+ * with a header line.
+ *
+ * When all the streams have finished, a combined result is posted to
+ * the script editor as if a single COPY had been executed.
+ */
+class ScriptParallelCopy : public wxEvtHandler {
+public:
+  /**
+   * Create loader.
+   *
+   * @param server Server to connect to, with the script's credentials
+   * @param dbname Database to connect to
+   * @param scriptPosition Position of the command in the script, for messages
+   */
+  ScriptParallelCopy(ScriptEditorPane *owner, const ServerConnection &server, const wxString &dbname, unsigned scriptPosition) :
+    owner(owner), server(server), dbname(dbname), scriptPosition(scriptPosition), finishedStreams(0), failedStreams(0), totalRows(0) {}
+  ~ScriptParallelCopy();
+
+  /**
+   * Smallest chunk of the file worth giving a stream of its own.
+   */
+  static const long MinimumChunkSize = 1024 * 1024;
+
+  /**
+   * Split the file and start the streams.
+   *
+   * @param copySql COPY ... FROM STDIN command each stream executes
+   * @param streams Number of streams to use: fewer are used for a small file
+   * @param error Set to a description of the problem if the file can't be read
+   * @return false if the file can't be read
+   */
+  bool Start(const wxString &filename, const std::string &copySql, unsigned streams, wxString &error);
+
+private:
+  class Stream {
+  public:
+    Stream() : db(NULL), start(0), length(0), bytes(0), rows(0) {}
+    DatabaseConnection *db;
+    wxFileOffset start;
+    wxFileOffset length;
+    wxULongLong bytes;
+    unsigned long rows;
+  };
+
+  class StreamConnectionCallback : public ConnectionCallback {
+  public:
+    StreamConnectionCallback(ScriptParallelCopy *owner, int stream) : owner(owner), stream(stream) {}
+    void OnConnection(bool usedPassword) {}
+    void OnConnectionFailed(const PgError& error) { owner->PostConnectionFailure(stream, error.GetPrimary()); }
+    void OnConnectionNeedsPassword() { owner->PostConnectionFailure(stream, _("a password is required")); }
+  private:
+    ScriptParallelCopy * const owner;
+    const int stream;
+  };
+
+  ScriptEditorPane * const owner;
+  const ServerConnection server;
+  const wxString dbname;
+  const unsigned scriptPosition;
+  wxString filename;
+  std::vector<Stream> streams;
+  unsigned finishedStreams, failedStreams;
+  unsigned long totalRows;
+  wxStopWatch stopwatch;
+
+  static wxFileOffset FindLineStart(wxFile &file, wxFileOffset offset, wxFileOffset size);
+  void PostConnectionFailure(int stream, const wxString &message);
+  wxString DescribeRates() const;
+  void Finish();
+
+  void OnCopyProgress(wxCommandEvent &event);
+  void OnStreamComplete(wxCommandEvent &event);
+
+  DECLARE_EVENT_TABLE()
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
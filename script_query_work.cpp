@@ -6,13 +6,23 @@
     #include "wx/wx.h"
 #endif
 
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#ifdef __WXMSW__
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
+#include "wx/file.h"
+#include "wx/filename.h"
 #include "script_query_work.h"
 
 void ScriptExecutionWork::Result::ReadStatus(DatabaseConnection *db, PGconn *conn, PGresult *rs)
 {
   status = PQresultStatus(rs);
   if (status == PGRES_TUPLES_OK) {
-    data = std::auto_ptr<QueryResults>(new QueryResults(rs));
     newConnectionState = Idle;
   }
   else if (status == PGRES_FATAL_ERROR) {
@@ -41,64 +51,631 @@ void ScriptExecutionWork::Result::ReadStatus(DatabaseConnection *db, PGconn *con
     tuplesProcessedCountValid = tuplesCount.ToULong(&tuplesProcessedCount);
   }
   oidValue = PQoidValue(rs);
+  if (status == PGRES_COPY_OUT) {
+    copyColumnCount = PQnfields(rs);
+    copyBinary = PQbinaryTuples(rs) != 0;
+  }
+
+  // copying the values lets repeated text be dictionary-encoded, which is much smaller than the libpq result
+  streamed = false;
+  if (status == PGRES_TUPLES_OK)
+    data = std::auto_ptr<QueryResults>(new QueryResults(rs, QueryResults::CopyValues));
+  PQclear(rs);
 }
 
-void ScriptQueryWork::DoWork()
+bool ScriptQueryWork::Send()
 {
-  wxStopWatch stopwatch;
+  output = new Result();
+  stopwatch.Start();
+  microStopwatch.Start();
 
+  SendQueryParams(sql.c_str(), 0, NULL, NULL);
+
+#if PG_VERSION_NUM >= 90200
+  if (streamRows)
+    streaming = PQsetSingleRowMode(conn) != 0;
+#endif
+
+  return true;
+}
+
+bool ScriptDeclareCursorWork::Send()
+{
   output = new Result();
-  db->LogSql(sql.c_str());
   stopwatch.Start();
+  microStopwatch.Start();
 
-  PGresult *rs = PQexecParams(conn, sql.c_str(), 0, NULL, NULL, NULL, NULL, 0);
-  wxASSERT(rs != NULL);
+  SendQuery(sql.c_str());
 
-  output->ReadStatus(db, conn, rs);
+  return true;
+}
 
-  PQclear(rs);
+void ScriptQueryWork::ProcessResult(PGresult *rs)
+{
+  if (streaming) {
+    ExecStatusType status = PQresultStatus(rs);
+#if PG_VERSION_NUM >= 90200
+    if (status == PGRES_SINGLE_TUPLE) {
+      try {
+        if (!batcher.InProgress()) batcher.Begin(rs);
+        batcher.AppendRow(rs);
+      } catch (...) {
+        PQclear(rs);
+        throw;
+      }
+      PQclear(rs);
+      return;
+    }
+#endif
+    if (status == PGRES_TUPLES_OK) {
+      // the final result of a streamed set carries no rows itself, but still describes the fields
+      if (!batcher.InProgress()) batcher.Begin(rs);
+      batcher.Finish(wxString(PQcmdStatus(rs), wxConvUTF8));
+    }
+    else if (batcher.InProgress()) {
+      batcher.Finish();
+    }
+  }
+
+  ScriptExecutionWork::ProcessResult(rs);
+  output->streamed = streaming;
+}
+
+bool ScriptCursorWork::Send()
+{
+  output = new Result();
+  stopwatch.Start();
+
+  SendQuery(sql.c_str());
+
+  return true;
+}
+
+void ScriptRowBatcher::Begin(const PGresult *rs)
+{
+  wxASSERT(layout == NULL);
+  layout = PQcopyResult(rs, PG_COPYRES_ATTRS);
+  if (layout == NULL) throw PgResourceFailure();
+  batchStopwatch.Start();
+}
+
+void ScriptRowBatcher::Begin(unsigned columnCount)
+{
+  wxASSERT(layout == NULL);
+  layout = PQmakeEmptyPGresult(NULL, PGRES_TUPLES_OK);
+  if (layout == NULL) throw PgResourceFailure();
+
+  std::vector<std::string> names(columnCount);
+  std::vector<PGresAttDesc> attrs(columnCount);
+  for (unsigned i = 0; i < columnCount; i++) {
+    char name[32];
+    sprintf(name, "column%u", i + 1);
+    names[i] = name;
+    attrs[i].name = const_cast<char*>(names[i].c_str());
+    attrs[i].tableid = InvalidOid;
+    attrs[i].columnid = 0;
+    attrs[i].format = 0;
+    attrs[i].typid = 25; // text
+    attrs[i].typlen = -1;
+    attrs[i].atttypmod = -1;
+  }
+  if (!PQsetResultAttrs(layout, columnCount, columnCount > 0 ? &attrs[0] : NULL))
+    throw PgResourceFailure();
+  batchStopwatch.Start();
+}
+
+bool ScriptRowBatcher::BeginRow()
+{
+  wxASSERT(layout != NULL);
+  if (rowLimit > 0 && resultSetRows >= rowLimit) {
+    ++discardedRows;
+    return false;
+  }
+  if (batch == NULL) {
+    batch = PQcopyResult(layout, PG_COPYRES_ATTRS);
+    if (batch == NULL) throw PgResourceFailure();
+  }
+  return true;
+}
+
+void ScriptRowBatcher::SetField(int fieldNum, const char *value, int length)
+{
+  if (!PQsetvalue(batch, batchRows, fieldNum, const_cast<char*>(value), value == NULL ? -1 : length))
+    throw PgResourceFailure();
+}
 
+void ScriptRowBatcher::EndRow()
+{
+  ++batchRows;
+  ++resultSetRows;
+  if (batchRows >= BatchSize || batchStopwatch.Time() >= BatchInterval)
+    SendBatch(false, wxEmptyString);
+}
+
+void ScriptRowBatcher::AppendRow(const PGresult *rs)
+{
+  if (!BeginRow()) return;
+
+  int fieldCount = PQnfields(rs);
+  for (int fieldNum = 0; fieldNum < fieldCount; fieldNum++) {
+    if (PQgetisnull(rs, 0, fieldNum))
+      SetField(fieldNum, NULL, -1);
+    else
+      SetField(fieldNum, PQgetvalue(rs, 0, fieldNum), PQgetlength(rs, 0, fieldNum));
+  }
+
+  EndRow();
+}
+
+void ScriptRowBatcher::Finish(const wxString &statusTag)
+{
+  wxASSERT(layout != NULL);
+
+  // an empty result set is still sent, so that its columns are shown
+  if (batch == NULL && resultSetRows == 0) {
+    batch = PQcopyResult(layout, PG_COPYRES_ATTRS);
+    if (batch == NULL) throw PgResourceFailure();
+  }
+  SendBatch(true, statusTag);
+
+  PQclear(layout);
+  layout = NULL;
+  resultSetRows = 0;
+  discardedRows = 0;
+}
+
+void ScriptRowBatcher::SendBatch(bool finished, const wxString &statusTag)
+{
+  ScriptRowBatch *rows = new ScriptRowBatch();
+  if (batch != NULL) {
+    rows->data = std::auto_ptr<QueryResults>(new QueryResults(batch, QueryResults::CopyValues));
+    PQclear(batch);
+    batch = NULL;
+    batchRows = 0;
+  }
+  rows->finished = finished;
+  rows->statusTag = statusTag;
+  rows->discardedRows = discardedRows;
+
+  wxCommandEvent event(PQWX_ScriptRowsReceived);
+  event.SetClientData(rows);
+  dest->AddPendingEvent(event);
+
+  batchStopwatch.Start();
+}
+
+/*
+ * Undo the escaping of a field in COPY text format.
+ */
+static void UnescapeCopyField(const char *p, const char *end, std::string &output)
+{
+  output.clear();
+  while (p < end) {
+    char c = *p++;
+    if (c != '\\' || p == end) {
+      output += c;
+      continue;
+    }
+    c = *p++;
+    switch (c) {
+    case 'b': output += '\b'; break;
+    case 'f': output += '\f'; break;
+    case 'n': output += '\n'; break;
+    case 'r': output += '\r'; break;
+    case 't': output += '\t'; break;
+    case 'v': output += '\v'; break;
+    case 'x':
+      if (p < end && isxdigit((unsigned char) *p)) {
+        int value = 0;
+        for (int digits = 0; digits < 2 && p < end && isxdigit((unsigned char) *p); digits++, p++)
+          value = value * 16 + (isdigit((unsigned char) *p) ? *p - '0' : tolower((unsigned char) *p) - 'a' + 10);
+        output += (char) value;
+      }
+      else {
+        output += c;
+      }
+      break;
+    default:
+      if (c >= '0' && c <= '7') {
+        int value = c - '0';
+        for (int digits = 1; digits < 3 && p < end && *p >= '0' && *p <= '7'; digits++, p++)
+          value = value * 8 + (*p - '0');
+        output += (char) value;
+      }
+      else {
+        output += c;
+      }
+      break;
+    }
+  }
+}
+
+void ScriptCopyWork::ReportProgress(wxULongLong bytes, unsigned long rows)
+{
+  wxCommandEvent event(PQWX_ScriptCopyProgress);
+  event.SetClientData(new ScriptCopyProgress(bytes, rows));
+  event.SetInt(stream);
+  dest->AddPendingEvent(event);
+}
+
+wxString ScriptCopyWork::DescribeTransfer(wxULongLong bytes) const
+{
+  long elapsed = stopwatch.Time();
+  if (elapsed <= 0) return wxFileName::GetHumanReadableSize(bytes);
+  wxULongLong rate = bytes * wxULongLong(1000) / wxULongLong(elapsed);
+  return wxString::Format(_("%s (%s/s)"), wxFileName::GetHumanReadableSize(bytes).c_str(), wxFileName::GetHumanReadableSize(rate).c_str());
+}
+
+void ScriptCopyWork::CollectResults()
+{
+  PGresult *rs;
+  while ((rs = PQgetResult(conn)) != NULL) {
+    bool final = AsyncDatabaseWork::IsFinalResult(rs);
+    output->ReadStatus(db, conn, rs);
+    if (final) break;
+  }
   output->Finalise(stopwatch.Time(), conn);
 }
 
-void ScriptPutCopyDataWork::DoWork()
+void ScriptGetCopyDataWork::DoWork()
 {
-  wxStopWatch stopwatch;
+  output = new ScriptExecutionWork::Result();
+  stopwatch.Start();
 
+  wxFile file;
+  bool writing = false;
+  if (!filename.empty()) {
+    // wxFile reports its own errors through wxLog, which shouldn't be used from here
+    wxLogNull noLogging;
+    writing = file.Create(filename, true);
+    if (!writing)
+      output->copyError = wxString::Format(_("Unable to create %s"), filename.c_str());
+  }
+  else if (binary) {
+    output->copyError = _("Binary COPY data can only be saved to a file");
+  }
+  else {
+    batcher.Begin(columnCount);
+  }
+
+  std::vector<char> buffer;
+  if (writing) buffer.reserve(WriteBufferSize);
+  wxULongLong bytes = 0;
+  unsigned long rows = 0;
+  wxStopWatch progressStopwatch;
+
+  char *data;
+  int length;
+  try {
+    while ((length = PQgetCopyData(conn, &data, 0)) > 0) {
+      if (writing) {
+        buffer.insert(buffer.end(), data, data + length);
+        if (buffer.size() >= WriteBufferSize) {
+          wxLogNull noLogging;
+          writing = file.Write(&buffer[0], buffer.size()) == buffer.size();
+          buffer.clear();
+          if (!writing) output->copyError = wxString::Format(_("Error writing to %s"), filename.c_str());
+        }
+      }
+      else if (batcher.InProgress()) {
+        ShowRow(data, length);
+      }
+      PQfreemem(data);
+      bytes += length;
+      ++rows;
+      if (progressStopwatch.Time() >= ProgressInterval) {
+        ReportProgress(bytes, rows);
+        progressStopwatch.Start();
+      }
+    }
+  } catch (...) {
+    // the rest of the data still has to be read before the connection can be used again
+    PQfreemem(data);
+    while ((length = PQgetCopyData(conn, &data, 0)) > 0)
+      PQfreemem(data);
+    throw;
+  }
+
+  if (writing && !buffer.empty()) {
+    wxLogNull noLogging;
+    writing = file.Write(&buffer[0], buffer.size()) == buffer.size();
+    if (!writing) output->copyError = wxString::Format(_("Error writing to %s"), filename.c_str());
+  }
+  if (file.IsOpened()) {
+    wxLogNull noLogging;
+    if (!file.Close() && writing) {
+      writing = false;
+      output->copyError = wxString::Format(_("Error writing to %s"), filename.c_str());
+    }
+  }
+  if (writing)
+    output->copySummary = wxString::Format(_("%s written to %s"), DescribeTransfer(bytes).c_str(), filename.c_str());
+  ReportProgress(bytes, rows);
+
+  // the completion tag is reported with the command result
+  if (batcher.InProgress())
+    batcher.Finish();
+
+  CollectResults();
+}
+
+void ScriptGetCopyDataWork::ShowRow(const char *data, int length)
+{
+  if (!batcher.BeginRow()) return;
+
+  if (length > 0 && data[length - 1] == '\n') --length;
+  const char *end = data + length;
+  const char *p = data;
+  std::string value;
+  unsigned fieldNum = 0;
+  while (fieldNum < columnCount) {
+    const char *fieldEnd = p;
+    while (fieldEnd < end && *fieldEnd != '\t') ++fieldEnd;
+    if (fieldEnd - p == 2 && p[0] == '\\' && p[1] == 'N') {
+      batcher.SetField(fieldNum, NULL, -1);
+    }
+    else {
+      UnescapeCopyField(p, fieldEnd, value);
+      batcher.SetField(fieldNum, value.data(), value.length());
+    }
+    ++fieldNum;
+    if (fieldEnd >= end) break;
+    p = fieldEnd + 1;
+  }
+  for (; fieldNum < columnCount; fieldNum++)
+    batcher.SetField(fieldNum, NULL, -1);
+
+  batcher.EndRow();
+}
+
+void ScriptPutCopyFileWork::DoWork()
+{
+  output = new ScriptExecutionWork::Result();
+  stopwatch.Start();
+
+  // the data is pushed as fast as the server takes it, so let libpq wait for the socket
+  bool nonblocking = PQisnonblocking(conn);
+  if (nonblocking) PQsetnonblocking(conn, 0);
+
+  if (!copySql.empty() && !StartCopy()) {
+    if (nonblocking) PQsetnonblocking(conn, 1);
+    return;
+  }
+
+  wxFile file;
+  wxString failure;
+  wxULongLong bytes = 0;
+  unsigned long rows = 0;
+  {
+    wxLogNull noLogging;
+    if (!file.Open(filename) || (start > 0 && file.Seek(start) == wxInvalidOffset))
+      failure = wxString::Format(_("Unable to open %s"), filename.c_str());
+  }
+
+  if (failure.empty()) {
+    std::vector<char> chunk(ChunkSize);
+    wxStopWatch progressStopwatch;
+    wxFileOffset remaining = length;
+    while (remaining != 0) {
+      size_t wanted = remaining < 0 || remaining > (wxFileOffset) ChunkSize ? ChunkSize : (size_t) remaining;
+      ssize_t got;
+      {
+        wxLogNull noLogging;
+        got = file.Read(&chunk[0], wanted);
+      }
+      if (got == wxInvalidOffset) {
+        failure = wxString::Format(_("Error reading %s"), filename.c_str());
+        break;
+      }
+      if (got == 0) break;
+      // a failure here leaves the connection broken, which is reported by the result
+      if (PQputCopyData(conn, &chunk[0], got) != 1) break;
+      bytes += got;
+      if (remaining > 0) remaining -= got;
+      rows += std::count(chunk.begin(), chunk.begin() + got, '\n');
+      if (progressStopwatch.Time() >= ProgressInterval) {
+        ReportProgress(bytes, rows);
+        progressStopwatch.Start();
+      }
+    }
+  }
+
+  // ending the COPY with an error message makes the server abandon it
+  PQputCopyEnd(conn, failure.empty() ? NULL : (const char*) failure.utf8_str());
+  ReportProgress(bytes, rows);
+
+  CollectResults();
+  if (nonblocking) PQsetnonblocking(conn, 1);
+
+  if (!failure.empty())
+    output->copyError = failure;
+  else if (output->status == PGRES_COMMAND_OK)
+    output->copySummary = wxString::Format(_("%s read from %s"), DescribeTransfer(bytes).c_str(), filename.c_str());
+}
+
+bool ScriptPutCopyDataWork::Send()
+{
   output = new Result();
+  stopwatch.Start();
 
   wxLogDebug(_T("Putting %u bytes of COPY data"), token.length);
 
-  int rc = PQputCopyData(conn, buffer + token.offset, token.length);
-  if (rc < 0) {
-    wxLogDebug(_T("PQputCopyData failed"));
+  if (Put() < 0) {
     output->error = PgError(conn);
-    return;
+    return false;
   }
 
-  wxLogDebug(_T("Finishing COPY"));
+  return true;
+}
 
-  rc = PQputCopyEnd(conn, NULL);
-  if (rc < 0) {
-    wxLogDebug(_T("PQputCopyEnd failed"));
-    output->error = PgError(conn);
-    return;
+bool ScriptPutCopyDataWork::SendMore()
+{
+  // a failure leaves the connection broken, which is reported by the result
+  return Put() != 0;
+}
+
+/**
+ * Queue the data and the end of the COPY.
+ *
+ * @return 1 once both are queued, 0 if the output buffer is full, or -1 on failure
+ */
+int ScriptPutCopyDataWork::Put()
+{
+  if (!dataQueued) {
+    int rc = PQputCopyData(conn, buffer + token.offset, token.length);
+    if (rc < 0) wxLogDebug(_T("PQputCopyData failed"));
+    if (rc <= 0) return rc;
+    dataQueued = true;
+    wxLogDebug(_T("Finishing COPY"));
   }
 
+  int rc = PQputCopyEnd(conn, NULL);
+  if (rc < 0) wxLogDebug(_T("PQputCopyEnd failed"));
+  if (rc <= 0) return rc;
+
   wxLogDebug(_T("Getting statement result"));
+  return 1;
+}
 
-  PGresult *rs;
-  do {
-    rs = PQgetResult(conn);
-    if (rs != NULL) {
-      output->ReadStatus(db, conn, rs);
+bool ScriptPutCopyFileWork::StartCopy()
+{
+  db->LogSql(copySql.c_str());
+  PGresult *rs = PQexec(conn, copySql.c_str());
+  if (rs != NULL && PQresultStatus(rs) == PGRES_COPY_IN) {
+    PQclear(rs);
+    return true;
+  }
+
+  if (rs == NULL) {
+    output->copyError = wxString(PQerrorMessage(conn), wxConvUTF8);
+  }
+  else {
+    // PQexec has already read any further results
+    output->ReadStatus(db, conn, rs);
+  }
+  output->Finalise(stopwatch.Time(), conn);
+  return false;
+}
+
+#if PG_VERSION_NUM >= 140000
+void ScriptPipelineWork::DoWork()
+{
+  output = new ScriptPipelineResults();
+  stopwatch.Start();
+  microStopwatch.Start();
+
+  // sending and receiving are interleaved, so neither can be allowed to block
+  bool nonblocking = PQisnonblocking(conn);
+  if (!nonblocking) PQsetnonblocking(conn, 1);
+
+  try {
+    if (!PQenterPipelineMode(conn))
+      ThrowPipelineFailure(statements.front().c_str());
+
+    for (std::vector<std::string>::const_iterator iter = statements.begin(); iter != statements.end(); iter++) {
+      db->LogSql(iter->c_str());
+      if (!PQsendQueryParams(conn, iter->c_str(), 0, NULL, NULL, NULL, NULL, 0))
+        ThrowPipelineFailure(iter->c_str());
+      if (!PQpipelineSync(conn))
+        ThrowPipelineFailure(iter->c_str());
     }
-  } while (rs != NULL);
 
-  PQclear(rs);
+    ReadResults();
 
-  output->Finalise(stopwatch.Time(), conn);
+    PQexitPipelineMode(conn);
+  } catch (...) {
+    if (!nonblocking) PQsetnonblocking(conn, 0);
+    delete output;
+    output = NULL;
+    throw;
+  }
+  if (!nonblocking) PQsetnonblocking(conn, 0);
+
+  // the transaction status is only meaningful once the pipeline has finished
+  if (!output->results.empty()) {
+    for (unsigned i = 0; i + 1 < output->results.size(); i++) {
+      if (output->results[i]->newConnectionState == Idle)
+        output->results[i]->newConnectionState = initialState;
+    }
+    ScriptExecutionWork::Result *last = output->results.back();
+    last->Finalise(last->elapsed, conn);
+  }
+}
+
+void ScriptPipelineWork::ReadResults()
+{
+  unsigned syncsPending = statements.size();
+  std::auto_ptr<ScriptExecutionWork::Result> current;
+  long lastElapsed = 0;
+  wxLongLong lastElapsedMicros = 0;
+
+  while (syncsPending > 0) {
+    if (PQisBusy(conn)) {
+      int flushed = PQflush(conn);
+      if (flushed < 0) ThrowPipelineFailure(statements.front().c_str());
+      WaitForSocket(flushed > 0);
+      if (!PQconsumeInput(conn)) ThrowPipelineFailure(statements.front().c_str());
+      continue;
+    }
+
+    PGresult *rs = PQgetResult(conn);
+    if (rs == NULL) {
+      // end of one statement's results
+      if (current.get() != NULL) {
+        long elapsed = stopwatch.Time();
+        wxLongLong elapsedMicros = microStopwatch.Time();
+        current->elapsed = elapsed - lastElapsed;
+        current->elapsedMicros = elapsedMicros - lastElapsedMicros;
+        lastElapsed = elapsed;
+        lastElapsedMicros = elapsedMicros;
+        current->complete = true;
+        output->results.push_back(current.release());
+      }
+      continue;
+    }
+
+    ExecStatusType status = PQresultStatus(rs);
+    if (status == PGRES_PIPELINE_SYNC) {
+      --syncsPending;
+      PQclear(rs);
+    }
+    else {
+      if (current.get() == NULL) current.reset(new ScriptExecutionWork::Result());
+      current->ReadStatus(db, conn, rs);
+    }
+  }
+}
+
+void ScriptPipelineWork::WaitForSocket(bool writing)
+{
+  int socketFd = PQsocket(conn);
+  do {
+#ifdef __WXMSW__
+    fd_set readfds, writefds;
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    FD_SET(socketFd, &readfds);
+    if (writing) FD_SET(socketFd, &writefds);
+    int rc = select(socketFd + 1, &readfds, &writefds, NULL, NULL);
+#else
+    struct pollfd pfd;
+    pfd.fd = socketFd;
+    pfd.events = POLLIN | (writing ? POLLOUT : 0);
+    int rc = poll(&pfd, 1, -1);
+#endif
+    if (rc > 0) return;
+    if (rc < 0 && errno != EINTR) throw PgLostConnection();
+  } while (true);
 }
+
+void ScriptPipelineWork::ThrowPipelineFailure(const char *sql) const
+{
+  if (PQstatus(conn) == CONNECTION_BAD)
+    throw PgLostConnection();
+  throw PgInvalidQuery(sql, wxString(PQerrorMessage(conn), wxConvUTF8));
+}
+#endif
+
 // Local Variables:
 // mode: c++
 // indent-tabs-mode: nil
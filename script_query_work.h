@@ -7,17 +7,22 @@
 #define __script_query_work_h
 
 #include <memory>
+#include "wx/longlong.h"
+#include "wx/filefn.h"
 #include "pg_error.h"
 #include "database_work.h"
 #include "execution_lexer.h"
 #include "script_events.h"
+#include "micro_stopwatch.h"
 
-class ScriptExecutionWork : public DatabaseWork {
+class ScriptExecutionWork : public AsyncDatabaseWork {
 public:
   /**
    * Create work object
+   *
+   * @param stream Identifies the query in the events posted, where several run at once
    */
-  ScriptExecutionWork(wxEvtHandler *dest) : dest(dest) {}
+  ScriptExecutionWork(wxEvtHandler *dest, int stream = 0) : dest(dest), stream(stream) {}
 
   /**
    * Execution result.
@@ -26,6 +31,9 @@ public:
   public:
     /**
      * Read result status.
+     *
+     * This takes ownership of the result: any rows are copied into a
+     * compact result set and the libpq result is cleared.
      */
     void ReadStatus(DatabaseConnection *db, PGconn *conn, PGresult *rs);
 
@@ -44,30 +52,57 @@ public:
     bool complete;
     std::auto_ptr<QueryResults> data;
     long elapsed;
+    wxLongLong elapsedMicros;
     PgError error;
     wxString statusTag;
     unsigned long tuplesProcessedCount;
     Oid oidValue;
     bool tuplesProcessedCountValid;
     DatabaseConnectionState newConnectionState;
+    bool streamed;
+    int copyColumnCount;
+    bool copyBinary;
+    wxString copySummary;
+    wxString copyError;
     friend class ScriptExecution;
     friend class ScriptExecutionWork;
     friend class ScriptQueryWork;
     friend class ScriptPutCopyDataWork;
+    friend class ScriptCopyWork;
+    friend class ScriptGetCopyDataWork;
+    friend class ScriptPutCopyFileWork;
+    friend class ScriptParallelCopy;
+    friend class ScriptParallelBlock;
+    friend class ScriptPipelineWork;
+    friend class ScriptEditorPane;
+    friend class ScriptBenchmark;
   };
 
+  void ProcessResult(PGresult *rs)
+  {
+    output->ReadStatus(db, conn, rs);
+  }
+
+  void ResultsComplete()
+  {
+    output->Finalise(stopwatch.Time(), conn);
+    output->elapsedMicros = microStopwatch.Time();
+  }
+
   void NotifyFinished()
   {
     wxCommandEvent event(PQWX_ScriptQueryComplete);
     event.SetClientData(output);
+    event.SetInt(stream);
     dest->AddPendingEvent(event);
   }
 
-private:
-  wxEvtHandler *dest;
-
 protected:
+  wxEvtHandler *dest;
+  const int stream;
   Result *output;
+  wxStopWatch stopwatch;
+  MicroStopWatch microStopwatch;
 
   static DatabaseConnectionState Decode(PGTransactionStatusType txStatus) {
     if (txStatus == PQTRANS_IDLE)
@@ -82,31 +117,428 @@ protected:
   }
 };
 
+/**
+ * A batch of rows streamed from a result set.
+ */
+class ScriptRowBatch {
+public:
+  ScriptRowBatch() : finished(false), discardedRows(0) {}
+  /**
+   * Rows received since the previous batch, or NULL if there are none.
+   */
+  std::auto_ptr<QueryResults> data;
+  /**
+   * True if this is the last batch for the result set.
+   */
+  bool finished;
+  /**
+   * Command status of the finished result set, or empty if there is
+   * none to report (e.g. it was cut short by an error).
+   */
+  wxString statusTag;
+  /**
+   * Number of rows discarded from the result set because of the row limit.
+   */
+  unsigned long discardedRows;
+};
+
+/**
+ * Collects rows as they are streamed from the server, and passes them
+ * to the script editor in batches.
+ *
+ * The rows are gathered into a libpq result with the same columns as
+ * the result set, and each batch is copied into a compact result set
+ * before being posted.
+ */
+class ScriptRowBatcher {
+public:
+  /**
+   * Number of rows collected before a batch is sent.
+   */
+  static const unsigned BatchSize = 1000;
+  /**
+   * Longest time in milliseconds for which rows are held before a batch is sent.
+   */
+  static const long BatchInterval = 250;
+
+  /**
+   * @param rowLimit Maximum number of rows to keep from each result
+   * set, or zero for no limit. Rows beyond the limit are counted and
+   * thrown away.
+   */
+  ScriptRowBatcher(wxEvtHandler *dest, unsigned long rowLimit = 0) :
+    dest(dest), rowLimit(rowLimit), layout(NULL), batch(NULL), batchRows(0), resultSetRows(0), discardedRows(0) {}
+  ~ScriptRowBatcher()
+  {
+    if (batch != NULL) PQclear(batch);
+    if (layout != NULL) PQclear(layout);
+  }
+
+  /**
+   * Start a result set, with columns described by a libpq result.
+   */
+  void Begin(const PGresult *rs);
+  /**
+   * Start a result set of text columns, named "column1", "column2" etc.
+   */
+  void Begin(unsigned columnCount);
+  /**
+   * @return true if a result set has been started and not yet finished
+   */
+  bool InProgress() const { return layout != NULL; }
+
+  /**
+   * Start a row.
+   *
+   * @return false if the row limit has been reached, in which case the
+   * row is counted as discarded and its fields should not be set
+   */
+  bool BeginRow();
+  /**
+   * Set a field of the current row.
+   *
+   * @param value Field value, or NULL for a null field
+   */
+  void SetField(int fieldNum, const char *value, int length);
+  /**
+   * Finish the current row, sending a batch if one is due.
+   */
+  void EndRow();
+  /**
+   * Add the single row of a libpq result.
+   */
+  void AppendRow(const PGresult *rs);
+
+  /**
+   * Send any remaining rows as the final batch of the result set.
+   */
+  void Finish(const wxString &statusTag = wxEmptyString);
+
+private:
+  wxEvtHandler * const dest;
+  const unsigned long rowLimit;
+  PGresult *layout;
+  PGresult *batch;
+  unsigned batchRows;
+  unsigned long resultSetRows;
+  unsigned long discardedRows;
+  wxStopWatch batchStopwatch;
+
+  void SendBatch(bool finished, const wxString &statusTag);
+};
+
 /**
  * Execute a query from a script on the database.
+ *
+ * If requested, and libpq supports it, rows are fetched in single-row
+ * mode and passed back to the editor in batches as they arrive, so a
+ * large result set never has to be held by libpq all at once.
  */
 class ScriptQueryWork : public ScriptExecutionWork {
 public:
   /**
    * Create work object
+   *
+   * @param streamRows Pass rows back in batches as they arrive
+   * @param rowLimit Maximum number of rows to keep from each streamed
+   * result set, or zero for no limit. Rows beyond the limit are read
+   * and discarded, leaving the connection and any transaction intact.
+   * @param stream Identifies the query in the events posted, where several run at once
+   */
+  ScriptQueryWork(wxEvtHandler *dest, const std::string &sql, bool streamRows = false, unsigned long rowLimit = 0, int stream = 0) :
+    ScriptExecutionWork(dest, stream), sql(sql), streamRows(streamRows), streaming(false), batcher(dest, rowLimit) {}
+
+  bool Send();
+  void ProcessResult(PGresult *rs);
+protected:
+  std::string sql;
+private:
+  const bool streamRows;
+  bool streaming;
+  ScriptRowBatcher batcher;
+};
+
+/**
+ * Declare a cursor for a query and fetch the first page from it.
+ *
+ * The BEGIN, DECLARE and FETCH are sent together as a simple query,
+ * since the extended protocol only accepts a single command. The
+ * results posted are those of the last command executed.
+ */
+class ScriptDeclareCursorWork : public ScriptQueryWork {
+public:
+  ScriptDeclareCursorWork(wxEvtHandler *dest, const std::string &sql) : ScriptQueryWork(dest, sql) {}
+
+  bool Send();
+};
+
+/**
+ * Progress of a COPY transfer.
+ */
+class ScriptCopyProgress {
+public:
+  ScriptCopyProgress(wxULongLong bytes, unsigned long rows, const wxString &detail = wxEmptyString) : bytes(bytes), rows(rows), detail(detail) {}
+  wxULongLong bytes;
+  unsigned long rows;
+  /**
+   * Additional description, such as the rates of individual streams.
+   */
+  wxString detail;
+};
+
+/**
+ * Transfer COPY data between the server and a file (or the script).
+ *
+ * This has to block in libpq while the data is transferred, so it
+ * isn't driven asynchronously.
+ */
+class ScriptCopyWork : public DatabaseWork {
+public:
+  /**
+   * Interval between progress reports, in milliseconds.
+   */
+  static const long ProgressInterval = 250;
+
+  /**
+   * Create work object
+   *
+   * @param stream Identifies the transfer in the events posted, where several run at once
    */
-  ScriptQueryWork(wxEvtHandler *dest, const std::string &sql) : ScriptExecutionWork(dest), sql(sql) {}
+  ScriptCopyWork(wxEvtHandler *dest, int stream = 0) : dest(dest), output(NULL), stream(stream) {}
+
+  void NotifyFinished()
+  {
+    wxCommandEvent event(PQWX_ScriptQueryComplete);
+    event.SetClientData(output);
+    event.SetInt(stream);
+    dest->AddPendingEvent(event);
+  }
+
+protected:
+  wxEvtHandler * const dest;
+  ScriptExecutionWork::Result *output;
+  const int stream;
+  wxStopWatch stopwatch;
+
+  /**
+   * Post the amount of data transferred so far to the editor.
+   */
+  void ReportProgress(wxULongLong bytes, unsigned long rows);
+  /**
+   * Describe the amount of data transferred and the rate.
+   */
+  wxString DescribeTransfer(wxULongLong bytes) const;
+  /**
+   * Read the results that follow the end of the COPY data.
+   */
+  void CollectResults();
+};
+
+/**
+ * Receive the data from a COPY ... TO STDOUT.
+ *
+ * The data is either written to a file, or shown as a result set. It
+ * is written to the file as it arrives, without being held in memory,
+ * so the server is held back by the speed of the disk rather than the
+ * data piling up in the client.
+ */
+class ScriptGetCopyDataWork : public ScriptCopyWork {
+public:
+  /**
+   * Create work object
+   *
+   * @param filename File to write the data to, or empty to show it as a result set
+   * @param columnCount Number of columns in the data
+   * @param binary True if the data is in binary COPY format, which can't be shown as a result set
+   * @param rowLimit Maximum number of rows to show, or zero for no limit
+   */
+  ScriptGetCopyDataWork(wxEvtHandler *dest, const wxString &filename, unsigned columnCount, bool binary, unsigned long rowLimit = 0) :
+    ScriptCopyWork(dest), filename(filename), columnCount(columnCount), binary(binary), batcher(dest, rowLimit) {}
+
+  /**
+   * Amount of data buffered before writing to the file.
+   */
+  static const size_t WriteBufferSize = 256 * 1024;
 
   void DoWork();
+
 private:
-  std::string sql;
+  const wxString filename;
+  const unsigned columnCount;
+  const bool binary;
+  ScriptRowBatcher batcher;
+
+  void ShowRow(const char *data, int length);
 };
 
-class ScriptPutCopyDataWork : public ScriptExecutionWork {
+/**
+ * Send the contents of a file as the data for a COPY ... FROM STDIN.
+ *
+ * The file is read and sent in fixed-size chunks, so it never has to
+ * be held in memory, let alone in the editor.
+ *
+ * This blocks while the server takes the data, so on the reactor
+ * engine it is run on a helper thread rather than the reactor's own.
+ */
+class ScriptPutCopyFileWork : public ScriptCopyWork {
 public:
-  ScriptPutCopyDataWork(wxEvtHandler *dest, const ExecutionLexer::Token &token, const char *buffer) : ScriptExecutionWork(dest), buffer(buffer), token(token) {}
+  /**
+   * Create work object to send a file in response to a COPY already started.
+   */
+  ScriptPutCopyFileWork(wxEvtHandler *dest, const wxString &filename) :
+    ScriptCopyWork(dest), filename(filename), start(0), length(-1) {}
+
+  /**
+   * Create work object to issue a COPY and send part of a file for it.
+   *
+   * @param copySql COPY ... FROM STDIN command to execute first
+   * @param start Offset in the file to start sending from
+   * @param length Number of bytes to send, or -1 to send the rest of the file
+   */
+  ScriptPutCopyFileWork(wxEvtHandler *dest, const wxString &filename, const std::string &copySql, wxFileOffset start, wxFileOffset length, int stream) :
+    ScriptCopyWork(dest, stream), filename(filename), copySql(copySql), start(start), length(length) {}
+
+  /**
+   * Amount of data read from the file and sent at a time.
+   */
+  static const size_t ChunkSize = 64 * 1024;
 
   void DoWork();
+
+private:
+  const wxString filename;
+  const std::string copySql;
+  const wxFileOffset start;
+  const wxFileOffset length;
+
+  bool StartCopy();
+};
+
+/**
+ * Send COPY data from the script itself.
+ *
+ * On a non-blocking connection, the data may not all be queued at
+ * once: the rest is queued as the connection drains, rather than
+ * waiting for it.
+ */
+class ScriptPutCopyDataWork : public ScriptExecutionWork {
+public:
+  ScriptPutCopyDataWork(wxEvtHandler *dest, const ExecutionLexer::Token &token, const char *buffer) : ScriptExecutionWork(dest), buffer(buffer), token(token), dataQueued(false) {}
+
+  bool Send();
+  bool SendMore();
 private:
   const char *buffer;
   ExecutionLexer::Token token;
+  bool dataQueued;
+
+  int Put();
 };
 
+/**
+ * Fetch the next page of rows from the cursor behind a paged result
+ * set, or close the cursor.
+ *
+ * The result is passed back to the script editor rather than to the
+ * script execution, since pages are fetched as the results grid is
+ * scrolled, usually after execution has finished.
+ */
+class ScriptCursorWork : public ScriptExecutionWork {
+public:
+  /**
+   * Create work object
+   *
+   * @param cursorName Cursor the SQL refers to, passed back with the result
+   */
+  ScriptCursorWork(wxEvtHandler *dest, const std::string &cursorName, const std::string &sql) :
+    ScriptExecutionWork(dest), cursorName(cursorName), sql(sql) {}
+
+  bool Send();
+
+  void NotifyFinished()
+  {
+    wxCommandEvent event(PQWX_ScriptCursorFetched);
+    event.SetClientData(output);
+    event.SetString(wxString(cursorName.c_str(), wxConvUTF8));
+    dest->AddPendingEvent(event);
+  }
+
+private:
+  const std::string cursorName;
+  const std::string sql;
+};
+
+/**
+ * Results of a batch of statements executed in pipeline mode.
+ */
+class ScriptPipelineResults {
+public:
+  ~ScriptPipelineResults()
+  {
+    for (std::vector<ScriptExecutionWork::Result*>::iterator iter = results.begin(); iter != results.end(); iter++)
+      delete *iter;
+  }
+  /**
+   * Result of each statement executed, in the order they were sent.
+   */
+  std::vector<ScriptExecutionWork::Result*> results;
+};
+
+#if PG_VERSION_NUM >= 140000
+/**
+ * Execute a batch of statements using libpq's pipeline mode.
+ *
+ * All the statements are sent before any results are read, so the
+ * batch costs one round trip rather than one per statement. Each
+ * statement is sent separately with the extended query protocol, so
+ * each must be a single command, and COPY can't be used.
+ *
+ * Each statement is followed by a sync, so it commits (or fails) on
+ * its own, exactly as if it had been sent by itself. That also means
+ * the statements after a failure are still executed, so a script that
+ * stops on the first error can't be pipelined.
+ *
+ * Results are read whole, rather than streamed.
+ *
+ * libpq can't report the transaction status until the whole pipeline
+ * has been read, so only the last result carries the new connection
+ * state: the others leave it as it was before the batch was sent.
+ * Each result is timed from the completion of the one before it.
+ */
+class ScriptPipelineWork : public DatabaseWork {
+public:
+  /**
+   * Create work object
+   *
+   * @param statements SQL of each statement
+   * @param initialState Connection state before the batch is sent
+   */
+  ScriptPipelineWork(wxEvtHandler *dest, const std::vector<std::string> &statements, DatabaseConnectionState initialState) :
+    dest(dest), statements(statements), initialState(initialState), output(NULL) {}
+
+  void DoWork();
+
+  void NotifyFinished()
+  {
+    wxCommandEvent event(PQWX_ScriptPipelineComplete);
+    event.SetClientData(output);
+    dest->AddPendingEvent(event);
+  }
+
+private:
+  wxEvtHandler * const dest;
+  const std::vector<std::string> statements;
+  const DatabaseConnectionState initialState;
+  ScriptPipelineResults *output;
+  wxStopWatch stopwatch;
+  MicroStopWatch microStopwatch;
+
+  void ReadResults();
+  void WaitForSocket(bool writing);
+  void ThrowPipelineFailure(const char *sql) const;
+};
+#endif
+
 #endif
 
 // Local Variables:
@@ -0,0 +1,135 @@
+#include "wx/wxprec.h"
+#ifdef __BORLANDC__
+    #pragma hdrstop
+#endif
+#ifndef WX_PRECOMP
+    #include "wx/wx.h"
+#endif
+
+#include <string.h>
+#include "wx/filename.h"
+#include "script_source.h"
+#include "script_query_work.h"
+
+DatabaseWork *BufferScriptSource::PutCopyData(wxEvtHandler *dest)
+{
+  return new ScriptPutCopyDataWork(dest, lexer.ReadCopyData(), buffer.data());
+}
+
+bool MappedScriptSource::Open(wxString &error)
+{
+  if (!file.Open(filename, error)) return false;
+  StartWindow(0, WindowSize);
+  return true;
+}
+
+void MappedScriptSource::StartWindow(wxFileOffset start, size_t size)
+{
+  // new windows never start beyond the old one, so lines can be counted up to here first
+  CountLines(start);
+
+  lexer.reset();
+  window = file.Map(start, size);
+  if (window == NULL) {
+    if (start < file.Length())
+      wxLogError(_("Unable to map %s at offset %s"), filename.c_str(), wxLongLong(start).ToString().c_str());
+    window = "";
+    windowStart = file.Length();
+    windowLength = 0;
+  }
+  else {
+    windowStart = start;
+    windowLength = (wxFileOffset) size < file.Length() - start ? size : (size_t) (file.Length() - start);
+  }
+  lexer.reset(new ExecutionLexer(window, windowLength));
+}
+
+ExecutionLexer::Token MappedScriptSource::Pull()
+{
+  if (lexer.get() == NULL) return ExecutionLexer::Token(ExecutionLexer::Token::END);
+
+  do {
+    ExecutionLexer::Token t = lexer->Pull();
+    if (t.type == ExecutionLexer::Token::END) {
+      if (AtEnd()) return t;
+      // everything in this window has been used
+      StartWindow(windowStart + windowLength, WindowSize);
+    }
+    else if (t.offset + t.length < windowLength || AtEnd()) {
+      return ExecutionLexer::Token(t.type, (unsigned) (windowStart + t.offset), t.length);
+    }
+    else if (t.offset == 0) {
+      // token is bigger than the window
+      StartWindow(windowStart, windowLength * 2);
+    }
+    else {
+      // token may continue beyond the window, so lex it again from its start
+      StartWindow(windowStart + t.offset, WindowSize);
+    }
+  } while (true);
+}
+
+wxFileOffset MappedScriptSource::FindCopyDataEnd(wxFileOffset start, wxFileOffset &resume)
+{
+  StartWindow(start, WindowSize);
+  do {
+    const char *end = window + windowLength;
+    const char *p = window;
+    while ((p = (const char*) memchr(p, '\\', end - p)) != NULL) {
+      if (p + 1 == end) break; // escape split by the window
+      if (p[1] == '.') {
+        wxFileOffset terminator = windowStart + (p - window);
+        resume = terminator + 2;
+        return terminator;
+      }
+      // skip the escaped character
+      p += 2;
+    }
+    if (AtEnd()) {
+      // well, this is really an error
+      resume = file.Length();
+      return file.Length();
+    }
+    StartWindow(p != NULL ? windowStart + (p - window) : windowStart + windowLength, WindowSize);
+  } while (true);
+}
+
+DatabaseWork *MappedScriptSource::PutCopyData(wxEvtHandler *dest)
+{
+  wxFileOffset start = windowStart + lexer->Position();
+  wxFileOffset resume;
+  wxFileOffset end = FindCopyDataEnd(start, resume);
+  StartWindow(resume, WindowSize);
+  return new ScriptPutCopyFileWork(dest, filename, std::string(), start, end - start, 0);
+}
+
+void MappedScriptSource::CountLines(wxFileOffset to)
+{
+  if (to <= lineCountedTo) return;
+  wxASSERT(lineCountedTo >= windowStart && to <= windowStart + (wxFileOffset) windowLength);
+  const char *p = window + (lineCountedTo - windowStart);
+  const char *end = window + (to - windowStart);
+  while ((p = (const char*) memchr(p, '\n', end - p)) != NULL) {
+    ++p;
+    ++linesCounted;
+  }
+  lineCountedTo = to;
+}
+
+unsigned long MappedScriptSource::LineAt(unsigned offset)
+{
+  CountLines(windowStart + (offset - (unsigned) windowStart));
+  return linesCounted;
+}
+
+wxString MappedScriptSource::DescribeProgress() const
+{
+  if (file.Length() == 0 || lexer.get() == NULL) return wxEmptyString;
+  wxFileOffset position = windowStart + lexer->Position();
+  return wxString::Format(_("%s %d%%"), wxFileName(filename).GetFullName().c_str(), (int) (position * 100 / file.Length()));
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
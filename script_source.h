@@ -0,0 +1,155 @@
+/**
+ * @file
+ * Sources of script text to execute: the editor buffer, or a file.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __script_source_h
+#define __script_source_h
+
+#include <string>
+#include <memory>
+#include "wx/string.h"
+#include "wx/buffer.h"
+#include "execution_lexer.h"
+#include "mapped_file.h"
+
+class DatabaseWork;
+class wxEvtHandler;
+
+/**
+ * Script text being executed, split into tokens.
+ *
+ * Token text is only available until the next token is pulled.
+ */
+class ScriptSource {
+public:
+  virtual ~ScriptSource() {}
+
+  /**
+   * Pull the next token from the script.
+   */
+  virtual ExecutionLexer::Token Pull() = 0;
+
+  /**
+   * Read the COPY data following the statement just pulled, and create
+   * work to send it to the server.
+   */
+  virtual DatabaseWork *PutCopyData(wxEvtHandler *dest) = 0;
+
+  /**
+   * Get the (UTF-8) text of a token.
+   */
+  virtual std::string GetString(const ExecutionLexer::Token &t) const = 0;
+
+  /**
+   * Get the text of a token as a wxString.
+   */
+  wxString GetWXString(const ExecutionLexer::Token &t) const
+  {
+    std::string str = GetString(t);
+    return Utf8ToWxString(str.data(), str.length());
+  }
+
+  /**
+   * @return name of the file being executed, or empty for the editor
+   * buffer, whose token offsets are relative to EditorPosition()
+   */
+  virtual wxString GetFilename() const { return wxEmptyString; }
+
+  /**
+   * @return position in the editor of the start of the script text
+   */
+  virtual unsigned EditorPosition() const { return 0; }
+
+  /**
+   * @return line number (from 1) of a token offset: only valid for
+   * offsets of tokens pulled since the last one asked about
+   */
+  virtual unsigned long LineAt(unsigned offset) { return 0; }
+
+  /**
+   * @return description of how far through the script execution has
+   * got, or empty if there is nothing useful to say
+   */
+  virtual wxString DescribeProgress() const { return wxEmptyString; }
+};
+
+/**
+ * Script text from the editor.
+ */
+class BufferScriptSource : public ScriptSource {
+public:
+  /**
+   * @param start Position in the editor the text was taken from, when it
+   * is only a part of the editor buffer
+   */
+  BufferScriptSource(const wxCharBuffer &buffer, unsigned length, unsigned start = 0) : buffer(buffer), lexer(this->buffer.data(), length), start(start) {}
+
+  ExecutionLexer::Token Pull() { return lexer.Pull(); }
+  DatabaseWork *PutCopyData(wxEvtHandler *dest);
+  std::string GetString(const ExecutionLexer::Token &t) const { return std::string(buffer.data() + t.offset, t.length); }
+  unsigned EditorPosition() const { return start; }
+
+private:
+  wxCharBuffer buffer;
+  ExecutionLexer lexer;
+  const unsigned start;
+};
+
+/**
+ * Script text read from a file, mapped into memory a window at a time.
+ *
+ * Token offsets are offsets into the file, truncated to 32 bits: they
+ * are only used to find the text of the most recent tokens, which are
+ * always inside the current window.
+ *
+ * COPY data is not read into memory at all: once its end has been
+ * found, it is sent to the server directly from the file.
+ */
+class MappedScriptSource : public ScriptSource {
+public:
+  MappedScriptSource(const wxString &filename) :
+    filename(filename), windowStart(0), windowLength(0), window(NULL), lineCountedTo(0), linesCounted(1) {}
+
+  /**
+   * Amount of the file mapped at once, unless a single token needs more.
+   */
+  static const size_t WindowSize = 16 * 1024 * 1024;
+
+  /**
+   * Open the file.
+   *
+   * @param error Set to a description of the problem if the file can't be opened
+   */
+  bool Open(wxString &error);
+
+  ExecutionLexer::Token Pull();
+  DatabaseWork *PutCopyData(wxEvtHandler *dest);
+  std::string GetString(const ExecutionLexer::Token &t) const { return std::string(window + (t.offset - (unsigned) windowStart), t.length); }
+  wxString GetFilename() const { return filename; }
+  unsigned long LineAt(unsigned offset);
+  wxString DescribeProgress() const;
+
+private:
+  const wxString filename;
+  MappedFile file;
+  wxFileOffset windowStart;
+  size_t windowLength;
+  const char *window;
+  std::auto_ptr<ExecutionLexer> lexer;
+  wxFileOffset lineCountedTo;
+  unsigned long linesCounted;
+
+  bool AtEnd() const { return windowStart + (wxFileOffset) windowLength >= file.Length(); }
+  void StartWindow(wxFileOffset start, size_t size);
+  void CountLines(wxFileOffset to);
+  wxFileOffset FindCopyDataEnd(wxFileOffset start, wxFileOffset &resume);
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
@@ -19,6 +19,21 @@
  * no-arg constructor.
  */
 class SqlDictionary {
+public:
+  /**
+   * Format in which a statement's results should be requested.
+   */
+  enum ResultFormat {
+    /**
+     * All values are returned as text.
+     */
+    TextResults = 0,
+    /**
+     * All values are returned in binary format. Only suitable for
+     * statements whose columns can be decoded by ResultColumns.
+     */
+    BinaryResults = 1
+  };
 protected:
   /**
    * Create an empty dictionary.
@@ -27,37 +42,50 @@ protected:
   /**
    * Add a SQL statement requiring a particular minimum server version.
    */
-  void AddSql(const wxString &name, const char *sql, int majorVersion, int minorVersion) { AddSql(name, Statement(sql, majorVersion * 10000 + minorVersion * 100)); }
+  void AddSql(const wxString &name, const char *sql, int majorVersion, int minorVersion, ResultFormat resultFormat = TextResults) { AddSql(name, Statement(sql, majorVersion * 10000 + minorVersion * 100, resultFormat)); }
   /**
    * Add a default SQL statement.
    */
-  void AddSql(const wxString &name, const char *sql) { AddSql(name, Statement(sql)); }
+  void AddSql(const wxString &name, const char *sql, ResultFormat resultFormat = TextResults) { AddSql(name, Statement(sql, MIN_VERSION, resultFormat)); }
 public:
   /**
    * Gets the SQL text for a specified name and server version.
    */
   const char *GetSql(const wxString &name, int serverVersion) const {
-    std::map<wxString, std::set<Statement> >::const_iterator ptr = data.find(name);
-    wxASSERT_MSG(ptr != data.end(), name);
-    for (std::set<Statement>::const_reverse_iterator iter = ptr->second.rbegin(); iter != ptr->second.rend(); iter++) {
-      if (serverVersion >= iter->minVersion) {
-        return iter->sql;
-      }
-    }
-    wxFAIL_MSG(name);
-    return NULL;
+    const Statement *stmt = FindStatement(name, serverVersion);
+    return stmt ? stmt->sql : NULL;
+  }
+  /**
+   * Gets the format results should be requested in for a specified name and server version.
+   */
+  ResultFormat GetResultFormat(const wxString &name, int serverVersion) const {
+    const Statement *stmt = FindStatement(name, serverVersion);
+    return stmt ? stmt->resultFormat : TextResults;
   }
 private:
   static const int MIN_VERSION = 0;
   class Statement {
   public:
-    Statement(const char *sql, int minVersion = MIN_VERSION) : sql(sql), minVersion(minVersion) {}
+    Statement(const char *sql, int minVersion = MIN_VERSION, ResultFormat resultFormat = TextResults) : sql(sql), minVersion(minVersion), resultFormat(resultFormat) {}
     const char *sql;
     int minVersion;
+    ResultFormat resultFormat;
     bool operator< (const Statement &other) const {
       return minVersion < other.minVersion;
     }
   };
+  const Statement *FindStatement(const wxString &name, int serverVersion) const {
+    std::map<wxString, std::set<Statement> >::const_iterator ptr = data.find(name);
+    wxASSERT_MSG(ptr != data.end(), name);
+    if (ptr == data.end()) return NULL;
+    for (std::set<Statement>::const_reverse_iterator iter = ptr->second.rbegin(); iter != ptr->second.rend(); iter++) {
+      if (serverVersion >= iter->minVersion) {
+        return &(*iter);
+      }
+    }
+    wxFAIL_MSG(name);
+    return NULL;
+  }
   void AddSql(const wxString &name, Statement stmt) {
     data[name].insert(stmt);
   };
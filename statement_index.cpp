@@ -0,0 +1,316 @@
+#include <algorithm>
+#include <string.h>
+#include <ctype.h>
+#include "statement_index.h"
+
+void StatementIndex::Clear()
+{
+  lineStates.assign(1, State());
+  lineStarts.assign(1, 0);
+  starts.clear();
+  ends.clear();
+  documentLength = 0;
+}
+
+void StatementIndex::Rebuild(const Source &source)
+{
+  Clear();
+  unsigned lineCount = source.LineCount();
+  if (lineCount == 0) return;
+
+  lineStates.reserve(lineCount);
+  lineStarts.reserve(lineCount);
+  State state;
+  unsigned offset = 0;
+  for (unsigned line = 0; line < lineCount; line++) {
+    if (line > 0) {
+      lineStates.push_back(state);
+      lineStarts.push_back(offset);
+    }
+    std::string text = source.GetLine(line);
+    LexLine(text, offset, state);
+    offset += text.length();
+  }
+  documentLength = offset;
+}
+
+void StatementIndex::Edit(const Source &source, unsigned line, int linesAdded, int lengthDelta)
+{
+  unsigned lineCount = source.LineCount();
+  if (lineStates.size() != lineCount - linesAdded || line >= lineStates.size()) {
+    // out of step with the text, so start again
+    Rebuild(source);
+    return;
+  }
+
+  // renumber the saved line checkpoints to match the edited text-
+  // checkpoints after the edited lines are kept to compare against
+  if (linesAdded > 0) {
+    lineStates.insert(lineStates.begin() + line + 1, linesAdded, State());
+    lineStarts.insert(lineStarts.begin() + line + 1, linesAdded, 0);
+  }
+  else if (linesAdded < 0) {
+    lineStates.erase(lineStates.begin() + line + 1, lineStates.begin() + line + 1 - linesAdded);
+    lineStarts.erase(lineStarts.begin() + line + 1, lineStarts.begin() + line + 1 - linesAdded);
+  }
+  unsigned lastEdited = line + (linesAdded > 0 ? linesAdded : 0);
+  for (unsigned i = lastEdited + 1; i < lineStarts.size(); i++)
+    lineStarts[i] += lengthDelta;
+  documentLength += lengthDelta;
+
+  // set aside the boundaries from the first edited line onwards, in
+  // their old positions
+  unsigned offset = lineStarts[line];
+  std::vector<unsigned> oldStarts(std::lower_bound(starts.begin(), starts.end(), offset), starts.end());
+  std::vector<unsigned> oldEnds(std::lower_bound(ends.begin(), ends.end(), offset), ends.end());
+  starts.resize(starts.size() - oldStarts.size());
+  ends.resize(ends.size() - oldEnds.size());
+
+  State state = lineStates[line];
+  unsigned current = line;
+  while (current < lineCount) {
+    if (current > line) {
+      if (current > lastEdited && state == lineStates[current]) {
+        // caught up with the state from before the edit: the rest is unchanged
+        unsigned resume = offset - lengthDelta;
+        for (std::vector<unsigned>::const_iterator iter = std::lower_bound(oldStarts.begin(), oldStarts.end(), resume); iter != oldStarts.end(); iter++)
+          starts.push_back(*iter + lengthDelta);
+        for (std::vector<unsigned>::const_iterator iter = std::lower_bound(oldEnds.begin(), oldEnds.end(), resume); iter != oldEnds.end(); iter++)
+          ends.push_back(*iter + lengthDelta);
+        return;
+      }
+      lineStates[current] = state;
+      lineStarts[current] = offset;
+    }
+    std::string text = source.GetLine(current);
+    LexLine(text, offset, state);
+    offset += text.length();
+    ++current;
+  }
+}
+
+bool StatementIndex::FindStatement(unsigned position, unsigned &start, unsigned &end) const
+{
+  std::vector<unsigned>::const_iterator iter = std::upper_bound(starts.begin(), starts.end(), position);
+  if (iter == starts.begin()) return false;
+  GetStatement(iter - starts.begin() - 1, start, end);
+  return true;
+}
+
+void StatementIndex::GetStatement(unsigned index, unsigned &start, unsigned &end) const
+{
+  start = starts[index];
+  std::vector<unsigned>::const_iterator iter = std::upper_bound(ends.begin(), ends.end(), start);
+  end = iter == ends.end() ? documentLength : *iter;
+}
+
+static bool WordIs(const std::string &word, const char *keyword)
+{
+  unsigned i = 0;
+  for (; i < word.length() && keyword[i] != '\0'; i++) {
+    if (tolower((unsigned char) word[i]) != keyword[i]) return false;
+  }
+  return i == word.length() && keyword[i] == '\0';
+}
+
+void StatementIndex::EndWord(const std::string &word, State &state)
+{
+  if (state.copy == State::FirstWord) {
+    state.copy = WordIs(word, "copy") ? State::Copy : State::NotCopy;
+  }
+  else if (state.copy == State::Copy && WordIs(word, "stdin")) {
+    state.copy = State::CopyFromStdin;
+  }
+}
+
+unsigned StatementIndex::PassDollarMarker(const std::string &text, unsigned pos, State &state)
+{
+  // digit after dollar is a positional parameter, not a quote
+  if (pos + 1 < text.length() && isdigit((unsigned char) text[pos + 1])) return pos + 1;
+
+  unsigned end = pos + 1;
+  while (end < text.length() && (isalnum((unsigned char) text[end]) || text[end] == '_' || (unsigned char) text[end] >= 0x80))
+    ++end;
+  if (end >= text.length() || text[end] != '$') return pos + 1;
+
+  std::string marker(text, pos, end - pos + 1);
+  if (!state.dollarQuotes.empty() && state.dollarQuotes.back() == marker)
+    state.dollarQuotes.pop_back();
+  else
+    state.dollarQuotes.push_back(marker);
+  return end + 1;
+}
+
+void StatementIndex::LexLine(const std::string &text, unsigned offset, State &state)
+{
+  const char *data = text.data();
+  unsigned length = text.length();
+  unsigned pos = 0;
+  std::string word;
+
+  while (pos < length) {
+    char c = data[pos];
+    switch (state.mode) {
+    case State::Between:
+      if (isspace((unsigned char) c)) {
+        ++pos;
+        break;
+      }
+      starts.push_back(offset + pos);
+      if (c == '\\') {
+        state.mode = State::Psql;
+        ++pos;
+      }
+      else {
+        state.mode = State::Sql;
+        state.copy = State::FirstWord;
+      }
+      break;
+
+    case State::Sql:
+      if (!state.dollarQuotes.empty()) {
+        // dollar-quoted text can only be ended by its marker
+        const char *dollar = (const char*) memchr(data + pos, '$', length - pos);
+        if (dollar == NULL) {
+          pos = length;
+          break;
+        }
+        pos = PassDollarMarker(text, dollar - data, state);
+        break;
+      }
+      if (isalnum((unsigned char) c) || c == '_' || (unsigned char) c >= 0x80 || (c == '$' && !word.empty())) {
+        word += c;
+        ++pos;
+        break;
+      }
+      if (!word.empty()) {
+        EndWord(word, state);
+        word.clear();
+      }
+      if (c == '$') {
+        pos = PassDollarMarker(text, pos, state);
+      }
+      else if (c == '\'') {
+        state.mode = State::SingleQuote;
+        ++pos;
+      }
+      else if (c == '"') {
+        state.mode = State::DoubleQuote;
+        ++pos;
+      }
+      else if (c == '-' && pos + 1 < length && data[pos + 1] == '-') {
+        pos = length;
+      }
+      else if (c == '/' && pos + 1 < length && data[pos + 1] == '*') {
+        state.mode = State::BlockComment;
+        state.commentDepth = 1;
+        pos += 2;
+      }
+      else if (c == ';') {
+        ++pos;
+        if (state.copy == State::CopyFromStdin) {
+          state.mode = State::CopyData;
+        }
+        else {
+          ends.push_back(offset + pos);
+          state.mode = State::Between;
+        }
+      }
+      else if (c == '\\') {
+        ends.push_back(offset + pos);
+        starts.push_back(offset + pos);
+        state.mode = State::Psql;
+        ++pos;
+      }
+      else {
+        ++pos;
+      }
+      break;
+
+    case State::SingleQuote:
+    case State::DoubleQuote:
+    case State::PsqlQuote:
+      {
+        char quote = state.mode == State::DoubleQuote ? '"' : '\'';
+        const char *close = (const char*) memchr(data + pos, quote, length - pos);
+        if (close == NULL) {
+          pos = length;
+          break;
+        }
+        pos = close - data + 1;
+        if (pos < length && data[pos] == quote) {
+          ++pos;
+          break;
+        }
+        state.mode = state.mode == State::PsqlQuote ? State::Psql : State::Sql;
+      }
+      break;
+
+    case State::BlockComment:
+      if (c == '*' && pos + 1 < length && data[pos + 1] == '/') {
+        pos += 2;
+        if (--state.commentDepth == 0) state.mode = State::Sql;
+      }
+      else if (c == '/' && pos + 1 < length && data[pos + 1] == '*') {
+        pos += 2;
+        ++state.commentDepth;
+      }
+      else {
+        ++pos;
+      }
+      break;
+
+    case State::Psql:
+      if (c == '\n') {
+        ends.push_back(offset + pos);
+        state.mode = State::Between;
+        ++pos;
+      }
+      else if (c == '\\' && pos + 1 < length && data[pos + 1] == '\\') {
+        ends.push_back(offset + pos);
+        state.mode = State::Between;
+        pos += 2;
+      }
+      else if (c == '\\') {
+        ends.push_back(offset + pos);
+        starts.push_back(offset + pos);
+        ++pos;
+      }
+      else if (c == '\'') {
+        state.mode = State::PsqlQuote;
+        ++pos;
+      }
+      else {
+        ++pos;
+      }
+      break;
+
+    case State::CopyData:
+      {
+        const char *backslash = (const char*) memchr(data + pos, '\\', length - pos);
+        if (backslash == NULL) {
+          pos = length;
+          break;
+        }
+        pos = backslash - data;
+        if (pos + 1 < length && data[pos + 1] == '.') {
+          pos += 2;
+          ends.push_back(offset + pos);
+          state.mode = State::Between;
+        }
+        else {
+          pos += 2;
+        }
+      }
+      break;
+    }
+  }
+
+  // words don't continue onto the next line
+  if (!word.empty()) EndWord(word, state);
+}
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
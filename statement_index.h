@@ -0,0 +1,148 @@
+/**
+ * @file
+ * Incrementally-maintained index of the statements in a script.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __statement_index_h
+#define __statement_index_h
+
+#include <string>
+#include <vector>
+
+/**
+ * Index of where each statement in a script starts and ends.
+ *
+ * This follows the same rules as ExecutionLexer for splitting a
+ * script into SQL statements and psql commands, but rather than
+ * lexing the whole script from the beginning it records the lexer
+ * state (quoting, dollar-quote markers, comment nesting) at the start
+ * of each line. When lines are edited, lexing restarts from the
+ * checkpoint at the start of the first edited line, and stops as soon
+ * as the state at the start of a line after the edit matches the
+ * state recorded there before the edit: everything after that point
+ * is unchanged, apart from moving by the length of the edit.
+ *
+ * Statement boundaries are held in sorted arrays, so finding the
+ * statement at a position is a binary search.
+ *
+ * COPY ... FROM STDIN data following a statement is counted as part
+ * of that statement.
+ */
+class StatementIndex {
+public:
+  /**
+   * Text being indexed, read a line at a time.
+   */
+  class Source {
+  public:
+    virtual ~Source() {}
+    /**
+     * @return number of lines in the text; the last line may be empty
+     */
+    virtual unsigned LineCount() const = 0;
+    /**
+     * @return UTF-8 content of a line, including its line terminator
+     */
+    virtual std::string GetLine(unsigned line) const = 0;
+  };
+
+  StatementIndex() : documentLength(0) { Clear(); }
+
+  /**
+   * Index the entire text.
+   */
+  void Rebuild(const Source &source);
+
+  /**
+   * Update the index after an edit.
+   *
+   * The edit must already have been applied to the source.
+   *
+   * @param line Line where the edit started
+   * @param linesAdded Number of lines inserted (or, if negative, removed)
+   * @param lengthDelta Number of bytes inserted (or, if negative, removed)
+   */
+  void Edit(const Source &source, unsigned line, int linesAdded, int lengthDelta);
+
+  /**
+   * Find the statement containing a position, or the one before it if
+   * the position is between statements.
+   *
+   * @param start Populated with the offset of the start of the statement
+   * @param end Populated with the offset just after the end of the statement
+   * @return false if there is no statement at or before the position
+   */
+  bool FindStatement(unsigned position, unsigned &start, unsigned &end) const;
+
+  /**
+   * @return number of statements in the text
+   */
+  unsigned StatementCount() const { return starts.size(); }
+
+  /**
+   * Get the extent of a statement by index.
+   */
+  void GetStatement(unsigned index, unsigned &start, unsigned &end) const;
+
+private:
+  /**
+   * Lexer state, as at the start of a line.
+   */
+  class State {
+  public:
+    enum Mode {
+      /**
+       * Between statements
+       */
+      Between,
+      Sql,
+      SingleQuote,
+      DoubleQuote,
+      BlockComment,
+      Psql,
+      PsqlQuote,
+      /**
+       * Data following COPY ... FROM STDIN
+       */
+      CopyData
+    };
+    /**
+     * Progress recognising a COPY ... FROM STDIN statement.
+     */
+    enum CopyStatus {
+      FirstWord,
+      NotCopy,
+      Copy,
+      CopyFromStdin
+    };
+    State() : mode(Between), copy(FirstWord), commentDepth(0) {}
+    Mode mode;
+    CopyStatus copy;
+    unsigned commentDepth;
+    std::vector<std::string> dollarQuotes;
+    bool operator==(const State &other) const
+    {
+      return mode == other.mode && copy == other.copy && commentDepth == other.commentDepth && dollarQuotes == other.dollarQuotes;
+    }
+    bool operator!=(const State &other) const { return !(*this == other); }
+  };
+
+  std::vector<State> lineStates;
+  std::vector<unsigned> lineStarts;
+  std::vector<unsigned> starts;
+  std::vector<unsigned> ends;
+  unsigned documentLength;
+
+  void Clear();
+  void LexLine(const std::string &text, unsigned offset, State &state);
+  static unsigned PassDollarMarker(const std::string &text, unsigned pos, State &state);
+  static void EndWord(const std::string &word, State &state);
+};
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End:
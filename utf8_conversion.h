@@ -0,0 +1,115 @@
+/**
+ * @file
+ * Fast conversion of UTF-8 text from the server into wxStrings.
+ * @author Steve Haslam <araqnid@googlemail.com>
+ */
+
+#ifndef __utf8_conversion_h
+#define __utf8_conversion_h
+
+#include <string.h>
+#include "wx/string.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * Test whether a buffer contains only ASCII characters.
+ *
+ * With SSE2 available, this examines 16 bytes at a time.
+ */
+inline bool IsAscii(const char *data, size_t length)
+{
+  size_t pos = 0;
+#ifdef __SSE2__
+  for (; pos + 16 <= length; pos += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*) (data + pos));
+    if (_mm_movemask_epi8(bytes) != 0) return false;
+  }
+#endif
+  for (; pos < length; pos++) {
+    if ((unsigned char) data[pos] & 0x80) return false;
+  }
+  return true;
+}
+
+#if wxUSE_UNICODE
+/**
+ * Widen an ASCII buffer into wide characters.
+ *
+ * This checks the input as it goes, and stops as soon as it finds a
+ * byte that isn't ASCII.
+ *
+ * @return false if the input was not entirely ASCII, in which case the output is incomplete
+ */
+inline bool WidenAscii(const char *data, size_t length, wxChar *output)
+{
+  size_t pos = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for (; pos + 16 <= length; pos += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*) (data + pos));
+    if (_mm_movemask_epi8(bytes) != 0) return false;
+    __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    if (sizeof(wxChar) == 2) {
+      _mm_storeu_si128((__m128i*) (output + pos), low);
+      _mm_storeu_si128((__m128i*) (output + pos + 8), high);
+    }
+    else {
+      _mm_storeu_si128((__m128i*) (output + pos), _mm_unpacklo_epi16(low, zero));
+      _mm_storeu_si128((__m128i*) (output + pos + 4), _mm_unpackhi_epi16(low, zero));
+      _mm_storeu_si128((__m128i*) (output + pos + 8), _mm_unpacklo_epi16(high, zero));
+      _mm_storeu_si128((__m128i*) (output + pos + 12), _mm_unpackhi_epi16(high, zero));
+    }
+  }
+#endif
+  for (; pos < length; pos++) {
+    unsigned char c = data[pos];
+    if (c & 0x80) return false;
+    output[pos] = c;
+  }
+  return true;
+}
+#endif
+
+/**
+ * Convert UTF-8 text into a wxString.
+ *
+ * Text that is entirely ASCII, as nearly all catalogue and result
+ * data is, is widened directly. Only text containing multi-byte
+ * sequences goes through the general (and validating) wxConvUTF8
+ * conversion.
+ */
+inline wxString Utf8ToWxString(const char *data, size_t length)
+{
+  if (length == 0) return wxEmptyString;
+#if wxUSE_UNICODE
+  wxString result;
+  bool ascii;
+  {
+    wxStringBufferLength buffer(result, length);
+    ascii = WidenAscii(data, length, buffer);
+    buffer.SetLength(ascii ? length : 0);
+  }
+  if (ascii) return result;
+#else
+  if (IsAscii(data, length)) return wxString(data, length);
+#endif
+  return wxString(data, wxConvUTF8, length);
+}
+
+/**
+ * Convert nul-terminated UTF-8 text into a wxString.
+ */
+inline wxString Utf8ToWxString(const char *data)
+{
+  return Utf8ToWxString(data, strlen(data));
+}
+
+#endif
+
+// Local Variables:
+// mode: c++
+// indent-tabs-mode: nil
+// End: